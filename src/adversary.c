@@ -0,0 +1,410 @@
+/*
+ *      adversary.c
+ *
+ * Checks the parser against sources made to be as slow as possible to scan
+ * or parse: names whose hashes all fall in the same slots of the symbol
+ * table, deeply nested parentheses and FOR statements, comments which are
+ * never closed, a line too long to read in one go, and an error in every
+ * statement.  Each source is made
+ * at four sizes, each twice the last, and checked with each engine.  The
+ * check fails if the parser crashes, as it would when its stack runs out, or
+ * if its time grows faster than the size of the source.
+ *
+ * Input: The parser to check, and optionally a scale by which to multiply
+ * 	the size of every source.
+ *
+ * Output: The best time of each source at each size, and how quickly the
+ * 	time grows with the size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "hasher.h"
+
+// the sizes each source is made at, each twice the last
+#define STEPS 4
+// the best of this many runs is kept
+#define RUNS 3
+// the largest power of the size the time may grow by
+#define MAX_GROWTH 1.5
+// the time below which growth is lost in the noise
+#define NOISE 0.05
+// the low bits of the hash shared by the colliding names
+#define COLLIDE_BITS 15
+
+typedef struct{
+	const char * name;
+	void (*write)(FILE *, long);
+	long size;
+	int streamed;
+} adversary;
+
+typedef struct{
+	const char * name;
+	const char * options[4];
+} engine;
+
+static const engine engines[] = {
+	{"plain", {NULL}},
+	{"pipelined", {"-p", NULL}},
+	{"split -j 2", {"-j", "2", NULL}},
+	{"batch -j 2", {"--batch", "-j", "2", NULL}},
+	{"table", {"-g", "table", NULL}},
+};
+
+/*
+ *
+ * name: nameAt
+ *
+ * Spells out a name for a number, as Q followed by letters, so every name is
+ * a valid variable and none is reserved.
+ *
+ * @param	name	filled with the name
+ * @param	number	the number
+ */
+static void nameAt(char * name, long number){
+	int i = 0;
+
+	name[i++] = 'Q';
+	do{
+		name[i++] = 'A' + number % 26;
+		number /= 26;
+	}while(number > 0);
+	name[i] = '\0';
+}
+
+/*
+ *
+ * name: writeColliding
+ *
+ * Declares names whose hashes share their low COLLIDE_BITS bits, so they
+ * crowd into a few runs of slots until the symbol table is far larger, and
+ * assigns to each of them several times.  The names are slow to find, so
+ * those found are kept for the larger sources.
+ *
+ * @param	out	the source to write
+ * @param	count	the number of names
+ */
+static void writeColliding(FILE * out, long count){
+	static char (* names)[MAX_TOKEN_LEN + 1] = NULL;
+	static long found = 0, number = 0;
+	char name[MAX_TOKEN_LEN + 1];
+	long i;
+	int use;
+
+	if(found < count){
+		names = realloc(names, count * sizeof(names[0]));
+		if(names == NULL){
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	while(found < count){
+		nameAt(name, number++);
+		if((hashName(name, strlen(name)) & ((1 << COLLIDE_BITS) - 1)) == 0){
+			strcpy(names[found++], name);
+		}
+	}
+
+	fprintf(out, "PROGRAM COLLIDE\nVAR\n");
+	for(i=0;i<count;i++){
+		fprintf(out, "%s%s", i == 0 ? "    " : (i % 8 == 0 ? ",\n    " : ", "), names[i]);
+	}
+	fprintf(out, " : INTEGER\nBEGIN\n");
+	for(use=0;use<4;use++){
+		for(i=0;i<count;i++){
+			fprintf(out, "    %s := %ld;\n", names[i], i);
+		}
+	}
+	fprintf(out, "    %s := 0\nEND.\n", names[0]);
+}
+
+/*
+ *
+ * name: writeParens
+ *
+ * Nests parentheses as deeply as asked within one expression.
+ *
+ * @param	out	the source to write
+ * @param	depth	the depth
+ */
+static void writeParens(FILE * out, long depth){
+	long i;
+
+	fprintf(out, "PROGRAM PARENS\nVAR\n    X : INTEGER\nBEGIN\n    X := ");
+	for(i=0;i<depth;i++){
+		fputs("( ", out);
+	}
+	fputs("1", out);
+	for(i=0;i<depth;i++){
+		fputs(" )", out);
+	}
+	fprintf(out, "\nEND.\n");
+}
+
+/*
+ *
+ * name: writeLoops
+ *
+ * Nests FOR statements as deeply as asked, each with a single statement as
+ * its body.
+ *
+ * @param	out	the source to write
+ * @param	depth	the depth
+ */
+static void writeLoops(FILE * out, long depth){
+	long i;
+
+	fprintf(out, "PROGRAM LOOPS\nVAR\n    X : INTEGER\nBEGIN\n");
+	for(i=0;i<depth;i++){
+		fputs("FOR X := 1 TO 2 DO\n", out);
+	}
+	fprintf(out, "X := 1\nEND.\n");
+}
+
+/*
+ *
+ * name: writeComment
+ *
+ * Opens a comment which runs on over every line to the end of the source.
+ *
+ * @param	out	the source to write
+ * @param	lines	the number of lines in the comment
+ */
+static void writeComment(FILE * out, long lines){
+	long i;
+
+	fprintf(out, "PROGRAM COMMENT\nVAR\n    X : INTEGER\nBEGIN\n    (* never closed\n");
+	for(i=0;i<lines;i++){
+		fputs("    X := X + 1; (* and again ) * ( * \n", out);
+	}
+}
+
+/*
+ *
+ * name: writeLongLine
+ *
+ * Writes a whole program on one line, with a long expression.
+ *
+ * @param	out	the source to write
+ * @param	terms	the number of terms in the expression
+ */
+static void writeLongLine(FILE * out, long terms){
+	long i;
+
+	fprintf(out, "PROGRAM LINE VAR X : INTEGER BEGIN X := 1");
+	for(i=0;i<terms;i++){
+		fputs(" + X", out);
+	}
+	fprintf(out, " END.\n");
+}
+
+/*
+ *
+ * name: writeErrors
+ *
+ * Writes a statement in error on every line, each followed by a block the
+ * parser goes into while skipping ahead, so the blocks nest as deeply as
+ * there are lines.
+ *
+ * @param	out	the source to write
+ * @param	lines	the number of statements
+ */
+static void writeErrors(FILE * out, long lines){
+	long i;
+
+	fprintf(out, "PROGRAM ERRORS\nVAR\n    X : INTEGER\nBEGIN\n");
+	for(i=0;i<lines;i++){
+		fputs("X X := ( BEGIN\n", out);
+	}
+	for(i=0;i<lines;i++){
+		fputs(i == lines - 1 ? "END;\n" : "END\n", out);
+	}
+	fprintf(out, "X := 1\nEND.\n");
+}
+
+static const adversary adversaries[] = {
+	{"colliding names", writeColliding, 2000, 0},
+	{"nested parentheses", writeParens, 125000, 0},
+	{"nested FOR", writeLoops, 125000, 0},
+	{"unclosed comment", writeComment, 250000, 0},
+	{"one long line", writeLongLine, 1000000, 1},
+	{"errors everywhere", writeErrors, 125000, 0},
+};
+
+static double seconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ *
+ * name: runParser
+ *
+ * Runs the parser once over a source, quietly.  A streamed source is fed
+ * to it through a pipe, a block at a time.
+ *
+ * @param	parser	the parser to run
+ * @param	fileName	the source
+ * @param	with	the engine
+ * @param	streamed	1 to feed the source through stdin
+ * @param	taken	set to the time taken
+ * @return	0 if the parser finished, otherwise the signal which killed it
+ */
+static int runParser(char * parser, char * fileName, const engine * with,
+		int streamed, double * taken){
+	char block[65536];
+	char * argv[8];
+	int feed[2], status, argc = 0, i, source;
+	ssize_t got;
+	double start;
+	pid_t child;
+
+	argv[argc++] = parser;
+	argv[argc++] = "--check-only";
+	for(i=0; with->options[i] != NULL; i++){
+		argv[argc++] = (char *)with->options[i];
+	}
+	argv[argc++] = streamed ? "-" : fileName;
+	argv[argc] = NULL;
+
+	if(streamed && pipe(feed) != 0){
+		return -1;
+	}
+	start = seconds();
+	child = fork();
+	if(child == 0){
+		if(streamed){
+			dup2(feed[0], STDIN_FILENO);
+			close(feed[0]);
+			close(feed[1]);
+		}
+		execv(parser, argv);
+		_exit(127);
+	}
+	if(child < 0){
+		return -1;
+	}
+	if(streamed){
+		close(feed[0]);
+		source = open(fileName, O_RDONLY);
+		while(source >= 0 && (got = read(source, block, sizeof(block))) > 0){
+			if(write(feed[1], block, got) != got){
+				break;
+			}
+		}
+		if(source >= 0){
+			close(source);
+		}
+		close(feed[1]);
+	}
+	if(waitpid(child, &status, 0) < 0){
+		return -1;
+	}
+	*taken = seconds() - start;
+	if(WIFSIGNALED(status)){
+		return WTERMSIG(status);
+	}
+	return WEXITSTATUS(status) == 127 ? -1 : 0;
+}
+
+int main(int argc, char** argv){
+	char fileName[] = "/tmp/adversaryXXXXXX";
+	double times[STEPS], taken, growth;
+	double scale = 1;
+	int a, e, step, run, killed, failed = 0;
+	int fd;
+	long size;
+	FILE * out;
+
+	if(argc < 2){
+		printf("usage: %s parser [scale]\n", argv[0]);
+		return 1;
+	}
+	if(argc > 2){
+		scale = atof(argv[2]);
+	}
+	// a broken pipe to a crashed parser is reported as the crash
+	signal(SIGPIPE, SIG_IGN);
+	fd = mkstemp(fileName);
+	if(fd < 0){
+		printf("Could not create %s!\n", fileName);
+		return 1;
+	}
+	close(fd);
+
+	printf("%-20s %-11s", "source", "engine");
+	for(step=0;step<STEPS;step++){
+		printf("  %8s%d", "x", 1 << step);
+	}
+	printf("  growth\n");
+	for(a=0; a < (int)(sizeof(adversaries) / sizeof(adversaries[0])); a++){
+		for(e=0; e < (int)(sizeof(engines) / sizeof(engines[0])); e++){
+			// a streamed source can only be read by the plain engine
+			if(adversaries[a].streamed && e > 0){
+				continue;
+			}
+			printf("%-20s %-11s", adversaries[a].name, engines[e].name);
+			fflush(stdout);
+			killed = 0;
+			for(step=0; step<STEPS && !killed; step++){
+				size = (long)(adversaries[a].size * scale) << step;
+				out = fopen(fileName, "w");
+				if(out == NULL){
+					printf("Could not write %s!\n", fileName);
+					return 1;
+				}
+				adversaries[a].write(out, size);
+				fclose(out);
+
+				times[step] = -1;
+				for(run=0; run<RUNS && !killed; run++){
+					killed = runParser(argv[1], fileName, &engines[e],
+							adversaries[a].streamed, &taken);
+					if(times[step] < 0 || taken < times[step]){
+						times[step] = taken;
+					}
+				}
+				if(!killed){
+					printf("  %8.3fs", times[step]);
+					fflush(stdout);
+				}
+			}
+
+			if(killed < 0){
+				printf("  could not run %s\n", argv[1]);
+				unlink(fileName);
+				return 1;
+			}
+			if(killed){
+				printf("  FAILED, killed by signal %d\n", killed);
+				failed = 1;
+				continue;
+			}
+			// the growth is the power of the size the time grew by over the
+			// last two doublings
+			growth = log2(times[STEPS-1] / times[STEPS-3]) / 2;
+			if(times[STEPS-1] > NOISE && growth > MAX_GROWTH){
+				printf("  %6.2f FAILED\n", growth);
+				failed = 1;
+			}
+			else{
+				printf("  %6.2f\n", growth);
+			}
+		}
+	}
+	unlink(fileName);
+	return failed;
+}
@@ -0,0 +1,150 @@
+/*
+ *      arena.c
+ *
+ * This file contains a bump allocator.  Everything allocated from an arena
+ * is released at once by resetting it, and its memory is kept to be handed
+ * out again.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "arena.h"
+
+// every allocation is rounded up to keep the next one aligned
+#define ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+/*
+ *
+ * name: initArena
+ *
+ * Prepares an empty arena.  No memory is taken until the first allocation.
+ *
+ * @param	memory	the arena to prepare
+ */
+void initArena(arena * memory){
+	memory->first = NULL;
+	memory->current = NULL;
+}
+
+/*
+ *
+ * name: newChunk
+ *
+ * Allocates a chunk which can hold at least the given number of bytes.
+ *
+ * @param	size	the number of bytes needed
+ * @return	the new chunk, NULL if out of memory
+ */
+static chunk * newChunk(size_t size){
+	chunk * block;
+	if(size < ARENA_CHUNK){
+		size = ARENA_CHUNK;
+	}
+	block = malloc(ALIGN(sizeof(chunk)) + size);
+	if(block != NULL){
+		block->next = NULL;
+		block->size = size;
+		block->used = 0;
+	}
+	return block;
+}
+
+/*
+ *
+ * name: arenaAlloc
+ *
+ * Hands out the given number of bytes from the arena.  Chunks kept from
+ * before the last reset are reused before any new one is allocated.
+ *
+ * @param	memory	the arena to allocate from
+ * @param	size	the number of bytes needed
+ * @return	the memory, NULL if out of memory
+ */
+void * arenaAlloc(arena * memory, size_t size){
+	chunk * block = memory->current;
+	chunk * fresh;
+	void * result;
+
+	size = ALIGN(size);
+	while(block == NULL || block->used + size > block->size){
+		if(block != NULL && block->next != NULL){
+			// chunks past the current one are unused since the last reset
+			block = block->next;
+			block->used = 0;
+			continue;
+		}
+		fresh = newChunk(size);
+		if(fresh == NULL){
+			return NULL;
+		}
+		if(block == NULL){
+			memory->first = fresh;
+		}
+		else{
+			block->next = fresh;
+		}
+		block = fresh;
+	}
+	memory->current = block;
+	result = (char *)block + ALIGN(sizeof(chunk)) + block->used;
+	block->used += size;
+	return result;
+}
+
+/*
+ *
+ * name: arenaCalloc
+ *
+ * Hands out the given number of bytes from the arena, cleared to zero.
+ *
+ * @param	memory	the arena to allocate from
+ * @param	size	the number of bytes needed
+ * @return	the memory, NULL if out of memory
+ */
+void * arenaCalloc(arena * memory, size_t size){
+	void * result = arenaAlloc(memory, size);
+	if(result != NULL){
+		memset(result, 0, size);
+	}
+	return result;
+}
+
+/*
+ *
+ * name: resetArena
+ *
+ * Releases everything allocated from the arena.  The chunks are kept, and
+ * each is marked empty again as allocation reaches it, so this takes the
+ * same time however much was allocated.
+ *
+ * @param	memory	the arena to reset
+ */
+void resetArena(arena * memory){
+	memory->current = memory->first;
+	if(memory->first != NULL){
+		memory->first->used = 0;
+	}
+}
+
+/*
+ *
+ * name: freeArena
+ *
+ * Returns all of the arena's memory to the system.
+ *
+ * @param	memory	the arena to free
+ */
+void freeArena(arena * memory){
+	chunk * block = memory->first;
+	chunk * next;
+	while(block != NULL){
+		next = block->next;
+		free(block);
+		block = next;
+	}
+	memory->first = NULL;
+	memory->current = NULL;
+}
@@ -0,0 +1,32 @@
+/*
+ *      arena.h
+ *
+ * This file contains a bump allocator.  Everything allocated from an arena
+ * is released at once by resetting it, and its memory is kept to be handed
+ * out again.
+ *
+ */
+
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+
+typedef struct chunk{
+	struct chunk * next;
+	size_t size;
+	size_t used;
+} chunk;
+
+typedef struct{
+	chunk * first;
+	chunk * current;
+} arena;
+
+void initArena(arena *);
+void * arenaAlloc(arena *, size_t);
+void * arenaCalloc(arena *, size_t);
+void resetArena(arena *);
+void freeArena(arena *);
+
+#endif
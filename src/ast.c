@@ -0,0 +1,181 @@
+/*
+ *      ast.c
+ *
+ * This file contains the syntax tree the parser builds as it checks a
+ * source, laid out flat in post-order in the session's arena.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "arena.h"
+#include "output.h"
+#include "hasher.h"
+#include "ast.h"
+
+// the names of the kinds of node, by kind
+static const char * kindNames[] = {"PROG", "DECLARATIONS", "DECLARE",
+	"STATEMENTS", "ASSIGN", "READ", "WRITE", "FOR", "ADD", "SUBTRACT",
+	"MULTIPLY", "DIVIDE", "NEGATE", "VARIABLE", "INTEGER", "INTEGER"};
+
+/*
+ *
+ * name: initTree
+ *
+ * Prepares an empty tree with room for the nodes expected, or at least
+ * TREE_NODES, which grows as nodes are added.  All of its memory comes from
+ * the given arena, and is released when that is reset.  Without an arena
+ * the tree keeps no nodes at all.
+ *
+ * @param	tree	the tree to prepare
+ * @param	memory	the arena to allocate from, or NULL to keep nothing
+ * @param	expected	the number of nodes expected
+ * @return	1 if successful, 0 if out of memory
+ */
+int initTree(astTree * tree, arena * memory, long expected){
+	tree->memory = memory;
+	tree->count = 0;
+	tree->wide = NULL;
+	tree->wideCount = 0;
+	tree->wideCapacity = 0;
+	if(memory == NULL){
+		tree->nodes = NULL;
+		tree->capacity = 0;
+		return 1;
+	}
+	if(expected > INT_MAX / 2){
+		expected = INT_MAX / 2;
+	}
+	tree->capacity = expected > TREE_NODES ? expected : TREE_NODES;
+	tree->nodes = arenaAlloc(memory, tree->capacity * sizeof(astNode));
+	return tree->nodes != NULL;
+}
+
+/*
+ *
+ * name: growTree
+ *
+ * Moves the nodes of a full tree to a larger array, which holds the nodes
+ * wanted if that is more than half as many again, and is twice the size
+ * otherwise.  The old array is left in the arena until it is reset.
+ *
+ * @param	tree	the tree to grow
+ * @param	wanted	the number of nodes expected in all, or 0 if not known
+ * @return	1 if successful, 0 if out of memory or the tree can hold no more
+ */
+int growTree(astTree * tree, long wanted){
+	astNode * bigger;
+	long capacity;
+
+	if(tree->capacity > INT_MAX / 2){
+		return 0;
+	}
+	if(wanted > INT_MAX / 2){
+		wanted = INT_MAX / 2;
+	}
+	capacity = wanted > tree->capacity + tree->capacity / 2 ? wanted : tree->capacity * 2;
+	bigger = arenaAlloc(tree->memory, capacity * sizeof(astNode));
+	if(bigger == NULL){
+		return 0;
+	}
+	memcpy(bigger, tree->nodes, tree->count * sizeof(astNode));
+	tree->nodes = bigger;
+	tree->capacity = capacity;
+	return 1;
+}
+
+/*
+ *
+ * name: addInteger
+ *
+ * Adds a node for an integer.  One which fits in a node is kept within it,
+ * and a wider one is kept in the tree's wide integers.
+ *
+ * @param	tree	the tree
+ * @param	position	the packed position of the integer
+ * @param	value	the integer
+ * @return	the index of the node, -1 if out of memory
+ */
+int addInteger(astTree * tree, unsigned long long position, long long value){
+	long long * bigger;
+
+	if(value <= INT_MAX || !treeKept(tree)){
+		return addNode(tree, NODE_INTEGER, tree->count, position, (int)value);
+	}
+	if(tree->wideCount == tree->wideCapacity){
+		tree->wideCapacity = tree->wideCapacity ? tree->wideCapacity * 2 : 64;
+		bigger = arenaAlloc(tree->memory, tree->wideCapacity * sizeof(long long));
+		if(bigger == NULL){
+			return -1;
+		}
+		if(tree->wideCount > 0){
+			memcpy(bigger, tree->wide, tree->wideCount * sizeof(long long));
+		}
+		tree->wide = bigger;
+	}
+	tree->wide[tree->wideCount] = value;
+	return addNode(tree, NODE_WIDE, tree->count, position, tree->wideCount++);
+}
+
+/*
+ *
+ * name: nodeInteger
+ *
+ * @param	tree	the tree
+ * @param	node	a NODE_INTEGER or NODE_WIDE
+ * @return	the integer of the node
+ */
+long long nodeInteger(const astTree * tree, const astNode * node){
+	return node->kind == NODE_WIDE ? tree->wide[node->value] : node->value;
+}
+
+/*
+ *
+ * name: printTree
+ *
+ * Prints every node in order, which is the order the tree is laid out in,
+ * with the nodes its subtree starts at and what it holds.
+ *
+ * @param	tree	the tree to print
+ * @param	symbols	the symbol table its symbol ids refer to
+ * @param	output	the sink to print to
+ */
+void printTree(const astTree * tree, const symbolTable * symbols, outputSink * output){
+	const astNode * node;
+	const symbol * entry;
+	unsigned int i;
+
+	sinkPrintf(output, "\tNode\tFrom\tLine\tKind\t\tValue\n");
+	sinkPrintf(output, "\t----\t----\t----\t------------\t------------\n");
+	for(i=0; i<tree->count; i++){
+		node = &tree->nodes[i];
+		sinkPrintf(output, "\t%u\t%u\t%d\t%-12s\t", i, node->first,
+				tokenLine(*node), kindNames[node->kind]);
+		switch(node->kind){
+			case NODE_PROG:
+			case NODE_ASSIGN:
+			case NODE_FOR:
+			case NODE_VARIABLE:
+				entry = &symbols->symbols[node->value];
+				sinkPrintf(output, "%.*s\n", entry->length, symbolName(entry));
+				break;
+			case NODE_INTEGER:
+			case NODE_WIDE:
+				sinkPrintf(output, "%lld\n", nodeInteger(tree, node));
+				break;
+			case NODE_DECLARATIONS:
+			case NODE_DECLARE:
+			case NODE_STATEMENTS:
+			case NODE_READ:
+			case NODE_WRITE:
+				sinkPrintf(output, "%d\n", node->value);
+				break;
+			default:
+				sinkPrintf(output, "\n");
+		}
+	}
+}
@@ -0,0 +1,110 @@
+/*
+ *      ast.h
+ *
+ * This file contains the syntax tree the parser builds as it checks a
+ * source.  The nodes are laid out flat in post-order, each after all of its
+ * children, so walking the tree is a scan of one array.  Each node records
+ * the index its subtree starts at, from which its children can be found,
+ * and variables are referred to by their symbol ids.
+ *
+ */
+
+#ifndef ast_h
+#define ast_h
+
+#include "config.h"
+#include "arena.h"
+#include "output.h"
+#include "hasher.h"
+
+// the kinds of node, and what their values hold:
+//	NODE_PROG	the symbol of the program's name; declarations, statements
+//	NODE_DECLARATIONS	the number of NODE_DECLAREs under it
+//	NODE_DECLARE	the number of NODE_VARIABLEs it declares
+//	NODE_STATEMENTS	the number of statements under it
+//	NODE_ASSIGN	the symbol assigned; variable, expression
+//	NODE_READ, NODE_WRITE	the number of NODE_VARIABLEs under it
+//	NODE_FOR	the symbol of the index; variable, from, to, body
+//	NODE_ADD to NODE_DIVIDE	nothing; left, right
+//	NODE_NEGATE	nothing; operand
+//	NODE_VARIABLE	the symbol
+//	NODE_INTEGER	the integer
+//	NODE_WIDE	the index of an integer too wide for a node in the tree's
+//		wide integers
+enum {NODE_PROG, NODE_DECLARATIONS, NODE_DECLARE, NODE_STATEMENTS, NODE_ASSIGN,
+	NODE_READ, NODE_WRITE, NODE_FOR, NODE_ADD, NODE_SUBTRACT, NODE_MULTIPLY,
+	NODE_DIVIDE, NODE_NEGATE, NODE_VARIABLE, NODE_INTEGER, NODE_WIDE, NODE_KINDS};
+
+// a node in 16 bytes.  Its subtree runs from first to the node itself, and
+// its position is packed as a token's is.
+typedef struct{
+	unsigned long long position : 56;
+	unsigned long long kind : 8;
+	unsigned int first;
+	int value;
+} astNode;
+
+// the tree, whose arrays come from the session's arena and are moved to
+// larger ones as they fill, the old ones being left until it is reset
+typedef struct{
+	astNode * nodes;
+	unsigned int count;
+	unsigned int capacity;
+	long long * wide;
+	unsigned int wideCount;
+	unsigned int wideCapacity;
+	arena * memory;
+} astTree;
+
+// the children of a node are found from the last back: the last is the node
+// before it, and each one before is the node before the last one's subtree
+#define lastChild(tree, index) ((index) - 1)
+#define previousChild(tree, child) ((tree)->nodes[child].first - 1)
+#define hasChildren(tree, index) ((tree)->nodes[index].first < (index))
+
+// false for a tree which keeps no nodes, whose nodes all have the index 0
+#define treeKept(tree) ((tree)->nodes != NULL)
+
+int initTree(astTree *, arena *, long);
+int growTree(astTree *, long);
+int addInteger(astTree *, unsigned long long, long long);
+long long nodeInteger(const astTree *, const astNode *);
+void printTree(const astTree *, const symbolTable *, outputSink *);
+
+/*
+ *
+ * name: addNode
+ *
+ * Adds a node after the children it was made from.  This is called for
+ * every node, so only a full tree, or one which keeps nothing, leaves the
+ * header.
+ *
+ * @param	tree	the tree
+ * @param	kind	the kind of node
+ * @param	first	the index its subtree starts at, its own index if it has
+ * 	no children
+ * @param	position	the packed position of the token it was made from
+ * @param	value	the value of the node, as its kind says
+ * @return	the index of the node, -1 if out of memory
+ */
+static inline int addNode(astTree * tree, int kind, unsigned int first,
+		unsigned long long position, int value){
+	astNode * node;
+
+	if(tree->count == tree->capacity){
+		if(!treeKept(tree)){
+			return 0;
+		}
+		if(!growTree(tree, 0)){
+			return -1;
+		}
+	}
+	node = &tree->nodes[tree->count];
+	node->kind = kind;
+	node->first = first;
+	node->position = position;
+	node->value = value;
+	return tree->count++;
+}
+
+#endif
@@ -0,0 +1,685 @@
+/*
+ *      batch.c
+ *
+ * This file contains batch checking.  The files are shared out between a
+ * pool of threads in even runs, and a thread which finishes its own run
+ * steals half of what is left of another's.  Each thread parses with a
+ * session of its own, so nothing but the reserved word table is shared.
+ *
+ * When the files are read ahead by a loader, the threads instead take each
+ * file as soon as it has been read.
+ *
+ * Only the errors of each file are reported, one line each, and optionally
+ * the symbols it declares, and they are printed in the order the files were
+ * given however the work was shared out.  A summary is printed at the end.
+ * With a result cache, a file which has been checked before simply has its
+ * errors and symbols printed again.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "line.h"
+#include "source.h"
+#include "hasher.h"
+#include "output.h"
+#include "session.h"
+#include "util.h"
+#include "grammar.h"
+#include "batch.h"
+#include "loader.h"
+#include "cache.h"
+#include "trace.h"
+
+// the files left to a thread, the first in the low half and the end in the
+// high half, so both can be changed at once.  Each is on a cache line of its
+// own.
+typedef struct{
+	_Atomic unsigned long long range;
+	char padding[56];
+} workQueue;
+
+#define packRange(first, end) (((unsigned long long)(end) << 32) | (unsigned int)(first))
+#define rangeFirst(range) ((int)((range) & 0xffffffff))
+#define rangeEnd(range) ((int)((range) >> 32))
+
+// what was found in one file
+typedef struct{
+	char * report;
+	size_t length;
+	int failed;
+	int done;
+} fileResult;
+
+typedef struct{
+	fileList * files;
+	const keywordTable * keywords;
+	int engine;
+	outputSink * output;
+	fileResult * results;
+	workQueue * queues;
+	fileLoader * loader;
+	resultCache * cache;
+	atomic_int cached;
+	int symbols;
+	int workers;
+	pthread_mutex_t lock;
+	int printed;
+	int failures;
+} batchRun;
+
+typedef struct{
+	batchRun * run;
+	int id;
+} batchWorker;
+
+/*
+ *
+ * name: addName
+ *
+ * Adds a copy of a file name to the end of a list.
+ *
+ * @param	list	the list to add to
+ * @param	name	the name to add
+ * @param	record	the corpus record of that name, or NULL for a file
+ * @return	1 if successful, 0 if out of memory
+ */
+static int addName(fileList * list, const char * name, const corpusRecord * record){
+	const corpusRecord ** records;
+	char ** names;
+	int capacity;
+
+	if(list->count == list->capacity){
+		capacity = list->capacity ? list->capacity * 2 : 64;
+		names = realloc(list->names, capacity * sizeof(char *));
+		if(names == NULL){
+			return 0;
+		}
+		list->names = names;
+		records = realloc(list->records, capacity * sizeof(corpusRecord *));
+		if(records == NULL){
+			return 0;
+		}
+		list->records = records;
+		list->capacity = capacity;
+	}
+	list->records[list->count] = record;
+	list->names[list->count] = strdup(name);
+	return list->names[list->count++] != NULL;
+}
+
+/*
+ *
+ * name: addDirectory
+ *
+ * Adds every file below a directory, in order of name so the list is the
+ * same from run to run.
+ *
+ * @param	list	the list to add to
+ * @param	path	the directory
+ * @return	1 if successful, 0 if out of memory or unreadable
+ */
+static int addDirectory(fileList * list, const char * path){
+	struct dirent ** entries;
+	char * name;
+	int count, i;
+	int ok = 1;
+
+	count = scandir(path, &entries, NULL, alphasort);
+	if(count < 0){
+		return 0;
+	}
+	for(i=0;i<count;i++){
+		if(ok && strcmp(entries[i]->d_name, ".") != 0 && strcmp(entries[i]->d_name, "..") != 0){
+			name = malloc(strlen(path) + strlen(entries[i]->d_name) + 2);
+			if(name == NULL){
+				ok = 0;
+			}
+			else{
+				sprintf(name, "%s/%s", path, entries[i]->d_name);
+				ok = addFiles(list, name);
+				free(name);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return ok;
+}
+
+/*
+ *
+ * name: addFiles
+ *
+ * Adds the files named by an argument to a list.  A directory adds every
+ * file below it, and a name starting with '@' is a manifest holding one
+ * name on each line.  Anything else is added as it is, so a file which
+ * cannot be opened is still reported in its place.
+ *
+ * @param	list	the list to add to
+ * @param	name	the file, directory or manifest
+ * @return	1 if successful, 0 if out of memory or unreadable
+ */
+int addFiles(fileList * list, char * name){
+	struct stat info;
+	FILE * manifest;
+	char * entry = NULL;
+	size_t size = 0;
+	ssize_t length;
+	int ok = 1;
+
+	if(name[0] == '@'){
+		manifest = strcmp(name + 1, "-") == 0 ? stdin : fopen(name + 1, "r");
+		if(manifest == NULL){
+			return 0;
+		}
+		while(ok && (length = getline(&entry, &size, manifest)) >= 0){
+			entry[strcspn(entry, "\r\n")] = '\0';
+			if(entry[0] != '\0'){
+				ok = addFiles(list, entry);
+			}
+		}
+		free(entry);
+		if(manifest != stdin){
+			fclose(manifest);
+		}
+		return ok;
+	}
+	if(stat(name, &info) == 0 && S_ISDIR(info.st_mode)){
+		return addDirectory(list, name);
+	}
+	return addName(list, name, NULL);
+}
+
+/*
+ *
+ * name: addCorpus
+ *
+ * Adds every record of a corpus container or tar to a list.  The corpus is
+ * kept open until the list is released.
+ *
+ * @param	list	the list to add to
+ * @param	name	the corpus
+ * @return	1 if successful, 0 if out of memory, unreadable or damaged
+ */
+int addCorpus(fileList * list, char * name){
+	corpus * corpora;
+	corpus * added;
+	int i;
+
+	corpora = realloc(list->corpora, (list->corpusCount + 1) * sizeof(corpus));
+	if(corpora == NULL){
+		return 0;
+	}
+	list->corpora = corpora;
+	added = &list->corpora[list->corpusCount];
+	if(!openCorpus(added, name)){
+		return 0;
+	}
+	list->corpusCount++;
+	for(i=0;i<added->count;i++){
+		if(!addName(list, added->records[i].name, &added->records[i])){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: freeFiles
+ *
+ * Releases a list of file names, and closes its corpora.
+ *
+ * @param	list	the list to release
+ */
+void freeFiles(fileList * list){
+	int i;
+	for(i=0;i<list->count;i++){
+		free(list->names[i]);
+	}
+	for(i=0;i<list->corpusCount;i++){
+		closeCorpus(&list->corpora[i]);
+	}
+	free(list->names);
+	free(list->records);
+	free(list->corpora);
+	list->names = NULL;
+	list->records = NULL;
+	list->corpora = NULL;
+	list->count = 0;
+	list->capacity = 0;
+	list->corpusCount = 0;
+}
+
+/*
+ *
+ * name: takeFile
+ *
+ * Takes the first file left in a thread's own run.
+ *
+ * @param	run	the batch
+ * @param	id	the thread
+ * @return	the index of the file, -1 if the run is empty
+ */
+static int takeFile(batchRun * run, int id){
+	workQueue * queue = &run->queues[id];
+	unsigned long long range = atomic_load(&queue->range);
+	int first;
+
+	while((first = rangeFirst(range)) < rangeEnd(range)){
+		if(atomic_compare_exchange_weak(&queue->range, &range,
+				packRange(first + 1, rangeEnd(range)))){
+			return first;
+		}
+	}
+	return -1;
+}
+
+/*
+ *
+ * name: stealFile
+ *
+ * Steals the later half of another thread's run, keeping the rest of it as
+ * this thread's own.  Work is never added, so once every run is found empty
+ * there is nothing left to do.
+ *
+ * @param	run	the batch
+ * @param	id	the thread stealing
+ * @return	the index of the first file stolen, -1 if every run is empty
+ */
+static int stealFile(batchRun * run, int id){
+	workQueue * victim;
+	unsigned long long range;
+	int i, first, end, middle;
+
+	for(i=1;i<run->workers;i++){
+		victim = &run->queues[(id + i) % run->workers];
+		range = atomic_load(&victim->range);
+		while((first = rangeFirst(range)) < (end = rangeEnd(range))){
+			middle = first + (end - first) / 2;
+			if(atomic_compare_exchange_weak(&victim->range, &range,
+					packRange(first, middle))){
+				atomic_store(&run->queues[id].range, packRange(middle + 1, end));
+				return middle;
+			}
+		}
+	}
+	return -1;
+}
+
+/*
+ *
+ * name: nameLines
+ *
+ * Writes lines of errors, each after the name of the file they were found in.
+ *
+ * @param	report	the file's report
+ * @param	name	the name of the file
+ * @param	lines	the errors, one to a line
+ * @param	length	the length of the errors
+ */
+static void nameLines(FILE * report, const char * name, const char * lines, long length){
+	const char * end = lines + length;
+	const char * next;
+
+	while(lines < end){
+		next = memchr(lines, '\n', end - lines);
+		next = (next == NULL) ? end : next + 1;
+		fprintf(report, "%s:%.*s", name, (int)(next - lines), lines);
+		lines = next;
+	}
+}
+
+/*
+ *
+ * name: listSymbols
+ *
+ * Describes the symbols a file declared, one to a line without the name of
+ * the file, in the order they were declared.
+ *
+ * @param	list	the stream to describe them to
+ * @param	symbols	the symbol table the file ended with
+ */
+static void listSymbols(FILE * list, const symbolTable * symbols){
+	const symbol * found;
+
+	for(found = symbols->symbols; found < symbols->symbols + symbols->count; found++){
+		if(found->code != UNDECLARED){
+			fprintf(list, " declares %.*s %d\n", found->length, symbolName(found),
+					found->code);
+		}
+	}
+}
+
+/*
+ *
+ * name: parseFile
+ *
+ * Parses a file which has been opened, and describes its errors and, if
+ * asked for, its symbols, or looks them up in the cache if the file has
+ * been checked before.
+ *
+ * @param	run	the batch
+ * @param	source	the thread's session
+ * @param	input	the file
+ * @param	lines	set to its errors then its symbols, one to a line without
+ * 	the name of the file, allocated with malloc()
+ * @param	length	set to the length of the lines
+ * @return	1 if the file parsed, 0 otherwise
+ */
+static int parseFile(batchRun * run, sourceContainer * source, sourceBuffer * input,
+		char ** lines, size_t * length){
+	unsigned long long key = 0;
+	cacheEntry * known = NULL;
+	diagnostic * found;
+	FILE * errors;
+	size_t reportLength;
+	int parsed;
+
+	// only a source which is whole in memory can be hashed up front
+	if(run->cache != NULL && input->atEnd){
+		key = sourceKey(run->cache, input->data, input->length);
+		known = findResult(run->cache, key);
+	}
+	*lines = NULL;
+	*length = 0;
+	errors = open_memstream(lines, length);
+	if(errors == NULL){
+		return 0;
+	}
+	if(known != NULL){
+		atomic_fetch_add(&run->cached, 1);
+		fwrite(known->text, 1, known->reportLength, errors);
+		if(run->symbols){
+			fwrite(entrySymbols(known), 1, known->symbolLength, errors);
+		}
+		fclose(errors);
+		return !known->failed;
+	}
+	if(!startSession(source, input)){
+		fprintf(errors, " out of memory\n");
+		fclose(errors);
+		return 0;
+	}
+
+	parsed = parseProgram(source);
+	TRACE_COUNT(COUNT_LINES, source->current->lineNumber);
+	if(!parsed && source->diagnostics == NULL){
+		fprintf(errors, " parse failure\n");
+	}
+	for(found = source->diagnostics; found != NULL; found = found->next){
+		fprintf(errors, "%d:%d: %s (%s)\n", found->lineNumber, found->column,
+				found->message, found->tokenName);
+	}
+	// the symbols are always kept, so a later run may ask for them
+	fflush(errors);
+	reportLength = *length;
+	if(run->symbols || run->cache != NULL){
+		listSymbols(errors, &source->symbols);
+	}
+	fclose(errors);
+	// running out of memory says nothing of the source, so it is not kept
+	if(run->cache != NULL && input->atEnd && parsed >= 0){
+		storeResult(run->cache, key, !parsed, *lines, reportLength,
+				*lines + reportLength, *length - reportLength);
+	}
+	if(!run->symbols){
+		*length = reportLength;
+	}
+	return parsed > 0;
+}
+
+/*
+ *
+ * name: checkFile
+ *
+ * Parses one file with the thread's session, and writes up its errors.
+ *
+ * @param	run	the batch
+ * @param	source	the thread's session
+ * @param	index	the index of the file
+ * @param	loaded	the file already read by the loader, or NULL to open it
+ */
+static void checkFile(batchRun * run, sourceContainer * source, int index,
+		loadedFile * loaded){
+	fileResult * result = &run->results[index];
+	char * name = run->files->names[index];
+	const corpusRecord * record = run->files->records[index];
+	sourceBuffer input;
+	FILE * report;
+	char * lines;
+	size_t length;
+	int opened;
+	TRACE_BEGIN(checking);
+
+	result->report = NULL;
+	result->length = 0;
+	result->failed = 1;
+	report = open_memstream(&result->report, &result->length);
+	if(report == NULL){
+		if(loaded != NULL){
+			free(loaded->data);
+		}
+		return;
+	}
+	if(loaded != NULL){
+		opened = loaded->error == 0;
+		if(opened){
+			openMemory(&input, loaded->data, loaded->length);
+		}
+	}
+	else if(record != NULL){
+		openView(&input, record->text, record->length);
+		opened = 1;
+	}
+	else{
+		TRACE_BEGIN(opening);
+		opened = openSource(&input, name);
+		TRACE_END(TRACE_OPEN, opening);
+	}
+	if(!opened){
+		fprintf(report, "%s: could not open\n", name);
+	}
+	else{
+		TRACE_BEGIN(parsing);
+		result->failed = !parseFile(run, source, &input, &lines, &length);
+		TRACE_END(TRACE_PARSE, parsing);
+		nameLines(report, name, lines, length);
+		free(lines);
+		TRACE_BEGIN(closing);
+		closeSource(&input);
+		TRACE_END(TRACE_CLOSE, closing);
+	}
+	fclose(report);
+	TRACE_COUNT(COUNT_FILES, 1);
+	TRACE_NAMED(TRACE_FILE, checking, name);
+}
+
+/*
+ *
+ * name: printResults
+ *
+ * Marks a file as checked, and prints every checked file which is next in
+ * order.  The thread which finishes the file holding the others back prints
+ * them all.
+ *
+ * @param	run	the batch
+ * @param	index	the index of the file just checked
+ */
+static void printResults(batchRun * run, int index){
+	fileResult * result;
+
+	pthread_mutex_lock(&run->lock);
+	run->results[index].done = 1;
+	while(run->printed < run->files->count && run->results[run->printed].done){
+		result = &run->results[run->printed++];
+		if(result->length > 0){
+			sinkWrite(run->output, result->report, result->length);
+		}
+		free(result->report);
+		result->report = NULL;
+		run->failures += result->failed;
+	}
+	pthread_mutex_unlock(&run->lock);
+}
+
+/*
+ *
+ * name: checkFiles
+ *
+ * The body of a thread of the pool, which checks its own run of files and
+ * then steals from the others until no files are left, or which checks the
+ * files as the loader reads them.
+ *
+ * @param	data	the thread's batchWorker
+ * @return	NULL
+ */
+static void * checkFiles(void * data){
+	batchWorker * self = data;
+	batchRun * run = self->run;
+	sourceContainer source;
+	outputSink quiet;
+	loadedFile file;
+	int index;
+
+	// the listing of each file is not wanted, only its errors
+	initSink(&quiet, SINK_NULL, -1);
+	initSession(&source, run->keywords, &quiet);
+	source.engine = run->engine;
+	if(run->loader != NULL){
+		while(nextLoaded(run->loader, &file)){
+			checkFile(run, &source, file.index, &file);
+			printResults(run, file.index);
+		}
+	}
+	else{
+		while((index = takeFile(run, self->id)) >= 0 ||
+				(index = stealFile(run, self->id)) >= 0){
+			checkFile(run, &source, index, NULL);
+			printResults(run, index);
+		}
+	}
+	freeSession(&source);
+	return NULL;
+}
+
+/*
+ *
+ * name: runBatch
+ *
+ * Checks every file of a list on a pool of threads, printing the errors of
+ * each file in order and then a summary.
+ *
+ * @param	files	the files to check
+ * @param	keywords	the lookup table for reserved words
+ * @param	engine	the parser to check them with, ENGINE_DESCENT or
+ * 	ENGINE_TABLE
+ * @param	output	the sink to print to
+ * @param	workers	the number of threads, or 0 for one per processor
+ * @param	loading	LOAD_MAP to have each thread open its own files, or
+ * 	LOAD_URING or LOAD_THREADS to read them ahead with a loader
+ * @param	cache	the results of earlier runs, or NULL to check every file
+ * @param	symbols	true to print the symbols each file declares after its
+ * 	errors
+ * @return	the number of files which failed, -1 if the pool could not be
+ * 	started
+ */
+int runBatch(fileList * files, const keywordTable * keywords, int engine,
+		outputSink * output, int workers, int loading, resultCache * cache,
+		int symbols){
+	batchRun run;
+	batchWorker * pool;
+	pthread_t * threads;
+	struct timespec start, end;
+	double seconds;
+	int i, started;
+
+	if(workers < 1){
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if(workers > files->count){
+		workers = files->count;
+	}
+	if(workers < 1){
+		workers = 1;
+	}
+
+	run.files = files;
+	run.keywords = keywords;
+	run.engine = engine;
+	run.output = output;
+	run.workers = workers;
+	run.printed = 0;
+	run.failures = 0;
+	run.cache = cache;
+	run.symbols = symbols;
+	atomic_init(&run.cached, 0);
+	run.results = calloc(files->count + 1, sizeof(fileResult));
+	run.queues = aligned_alloc(64, workers * sizeof(workQueue));
+	pool = malloc(workers * sizeof(batchWorker));
+	threads = malloc(workers * sizeof(pthread_t));
+	if(run.results == NULL || run.queues == NULL || pool == NULL || threads == NULL){
+		free(run.results);
+		free(run.queues);
+		free(pool);
+		free(threads);
+		return -1;
+	}
+	pthread_mutex_init(&run.lock, NULL);
+
+	// each thread starts with an even run of the files
+	for(i=0;i<workers;i++){
+		atomic_init(&run.queues[i].range, packRange(
+				(long)files->count * i / workers, (long)files->count * (i + 1) / workers));
+		pool[i].run = &run;
+		pool[i].id = i;
+	}
+
+	initKernels();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	// without a loader each thread simply maps its own files, and the
+	// records of a corpus are mapped already
+	run.loader = (loading != LOAD_MAP && files->corpusCount == 0) ?
+			startLoader(files, loading) : NULL;
+	for(started=0;started<workers;started++){
+		if(pthread_create(&threads[started], NULL, checkFiles, &pool[started]) != 0){
+			break;
+		}
+	}
+	if(started == 0){
+		// the files are checked on this thread instead
+		checkFiles(&pool[0]);
+	}
+	for(i=0;i<started;i++){
+		pthread_join(threads[i], NULL);
+	}
+	if(run.loader != NULL){
+		stopLoader(run.loader);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	sinkPrintf(output, "\n%d files checked, %d failed", files->count, run.failures);
+	if(cache != NULL){
+		sinkPrintf(output, ", %d cached", atomic_load(&run.cached));
+	}
+	sinkPrintf(output, ", %.0f files/sec\n", seconds > 0 ? files->count / seconds : 0.0);
+
+	pthread_mutex_destroy(&run.lock);
+	free(run.results);
+	free(run.queues);
+	free(pool);
+	free(threads);
+	return run.failures;
+}
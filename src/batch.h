@@ -0,0 +1,35 @@
+/*
+ *      batch.h
+ *
+ * This file contains batch checking, which checks many files on a pool of
+ * threads and reports on them in the order they were given.  The files may
+ * also be the records of corpus containers.
+ *
+ */
+
+#ifndef batch_h
+#define batch_h
+
+#include "config.h"
+#include "hasher.h"
+#include "output.h"
+#include "corpus.h"
+#include "cache.h"
+
+// a growing list of file names, and of the corpora holding any of them
+typedef struct{
+	char ** names;
+	const corpusRecord ** records;
+	int count;
+	int capacity;
+	corpus * corpora;
+	int corpusCount;
+} fileList;
+
+int addFiles(fileList *, char *);
+int addCorpus(fileList *, char *);
+void freeFiles(fileList *);
+int runBatch(fileList *, const keywordTable *, int, outputSink *, int, int, resultCache *,
+		int);
+
+#endif
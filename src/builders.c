@@ -15,156 +15,175 @@
 #include "tokens.h"
 #include "line.h"
 #include "util.h"
+#include "lexer.h"
 #include "builders.h"
+#include "trace.h"
 
 /*
  *
  * name: buildToken
  *
- * Builds the next token into the given word from the current line.
+ * Runs the scanner DFA over the current line to find the span of the next
+ * token.  Nothing is copied, the span simply records where the token lies
+ * within the source buffer.  A comment left open at the end of the line is
+ * remembered so the next line carries on inside it.
  *
- * @param	word	the string to contain the read token
+ * Runs of whitespace, comment text and the body of a word or integer are
+ * passed over by skipBlanks(), findCommentEnd() and findStopper(), which
+ * step the same DFA or use SIMD to cover many characters at once.  A single
+ * blank and the first SHORT_RUN characters of a word are stepped here, as
+ * most runs end before a call would pay for itself.
+ *
+ * @param	where	the span to contain the location of the read token
  * @param	current	the line to be read from
- * @return	0 on success, 1 on integer, 2 on comment, -1 on error
+ * @return	the accepting state of the token, 0 if the line ran out first
  */
-int buildToken(char * word, line * current){
-	int i;
-	int wordPos = 0;
-	memset(word, '\0', MAX_TOKEN_LEN+1);
-	skipWhitespace(current);
-
-	for(i=current->scanIndex; i < MAX_LINE_LEN; i++){
-		wordPos = i - current->scanIndex; // current position in word
-		if(wordPos > MAX_TOKEN_LEN){
-			return -1;
-		}
-
-		// catch any tokens that were used as stoppers on last call
-		if(wordPos==0){
-			// test for special double tokens
-			if(current->line[i] == '(' && current->line[i+1] == '*'){
-				current->scanIndex = i + 2;
-				return 2;
-			}
-			if(current->line[i] == ':' && current->line[i+1] == '='){
-				word[wordPos] = ':';
-				word[wordPos+1] = '=';
-				current->scanIndex = i+2;
+int buildToken(span * where, line * current){
+	const unsigned char * text = (const unsigned char *)current->line;
+	int length = current->length;
+	int state = current->lexState;
+	int i = current->scanIndex;
+	int start, limit, next;
+
+	while(1){
+		if(state == S_COMMENT){
+			i = findCommentEnd(text, i, length);
+			if(i < 0){
+				// the comment carries on to the next line
+				current->lexState = S_COMMENT;
+				current->scanIndex = length;
+				where->offset = current->offset + length;
+				where->length = 0;
 				return 0;
 			}
-
-			// look for integers as well
-			if(isdigit(current->line[i])){
-				current->scanIndex = i;
-				buildInt(word, current);
-				return 1;
-			}
-
-			// stoppers are tokens too!
-			if(isstopper(current->line[i])){
-				word[wordPos] = current->line[i];
-				current->scanIndex = i+1;
-				return 0;
+		}
+		// most blanks between tokens are a single space, which is passed here
+		// rather than through a call
+		if(i < length && charClass[text[i]] == C_SPACE){
+			i++;
+			if(i < length && charClass[text[i]] == C_SPACE){
+				i = skipBlanks(text, i, length);
 			}
 		}
-
-		if(isstopper(current->line[i])){
-			current->scanIndex = i;
+		start = i;
+		if(i >= length){
+			// only whitespace and comments were left on the line
+			current->lexState = S_START;
+			current->scanIndex = length;
+			where->offset = current->offset + length;
+			where->length = 0;
 			return 0;
 		}
-		else{
-			word[wordPos] = current->line[i];
+
+		state = lexTable[S_START][text[i++]];
+		if(state >= LEX_ACCEPT){
+			// a single character token
+			break;
+		}
+		if(state != S_COLON && state != S_LPAREN){
+			// a word or integer, which runs until a stopper.  Most are short,
+			// so the first few characters are stepped here and only a longer
+			// run is handed to findStopper()
+			limit = i + SHORT_RUN < length ? i + SHORT_RUN : length;
+			while(i < limit && (next = lexTable[state][text[i]]) < LEX_ACCEPT){
+				state = next;
+				i++;
+			}
+			if(i == limit && i < length){
+				i = findStopper(text, i, length, &state);
+			}
+			state = lexEnd[state];
+			break;
 		}
 
-		if(wordPos == MAX_TOKEN_LEN){
-			return 0;
+		// the double tokens := and (*
+		state = (i < length) ? lexTable[state][text[i]] : lexEnd[state];
+		if(state == A_SYMBOL){
+			i++;
+			break;
+		}
+		if(state == A_SHORT){
+			state = A_SYMBOL;
+			break;
 		}
+		TRACE_COUNT(COUNT_COMMENTS, 1);
+		i++;
 	}
+
+	where->offset = current->offset + start;
+	where->length = i - start;
+	current->lexState = S_START;
 	current->scanIndex = i;
-	return 0;
+	return state;
 }
 
+// the messages of the scanner's errors, by error code
+static const char * errorMessages[] = {
+	"No error.",
+	"Token too long.",
+	"Invalid variable.",
+	"Invalid integer.",
+	"Integer too large."
+};
+
 /*
  *
- * name: buildInt
+ * name: errorMessage
  *
- * Builds an integer token into the given word from the current line.
+ * Looks up the message of a scanner error.  This is only needed when a
+ * diagnostic is printed, so tokens carry just the error code.
  *
- * @param	word	the string to be read into
- * @param	current	the line to be read from
- * @return	0 if unsuccessful, 1 if successful
+ * @param	error	the error code
+ * @return	the message of the error
  */
-int buildInt(char * word, line * current){
-	int j = 0;
-	int k;
-
-	memset(word, '\0', MAX_TOKEN_LEN+1);
-	word[j] = current->line[current->scanIndex];
-	j++;
-
-	for(k=current->scanIndex+1; (k < MAX_LINE_LEN) && (j < MAX_TOKEN_LEN); k++){
-		if(isdigit(current->line[k]) || !isstopper(current->line[k])){
-			// we will go ahead and copy invalid characters, but not stoppers.
-			// the invalid characters should be caught during integer validation.
-			word[j] = current->line[k];
-			j++;
-		}
-		else{
-			current->scanIndex = k;
-			return 1;
-		}
+const char * errorMessage(int error){
+	if(error < 0 || error >= (int)(sizeof(errorMessages) / sizeof(errorMessages[0]))){
+		return "Unknown error.";
 	}
-	return 0;
+	return errorMessages[error];
 }
 
 /*
  *
- * name: buildError
+ * name: buildItem
  *
- * Stores into the given token the give error value and associated message.
+ * Fills in the token found at the given span of the current line.  Only the
+ * location of the token is kept, its text stays in the source.  Any token
+ * but a variable starts with a value of 0.
  *
- * @param	token	the superToken to be read into
- * @param	error	the error code
+ * @param	item	the token to be built
+ * @param	current	the line the token was read from
+ * @param	where	the location of the token within the source
+ * @param	code	the token code to be assigned
  */
-void buildError(superToken * super, int error){
-	super->error = error;
-	switch(error){
-		case 0:
-			strcpy(super->message, "No error.");
-			break;
-
-		case 1:
-			strcpy(super->message, "Token too long.");
-			break;
-
-		case 2:
-			strcpy(super->message, "Invalid variable.");
-			break;
-
-		case 3:
-			strcpy(super->message, "Invalid integer.");
-			break;
-
-		default:
-			strcpy(super->message, "Unknown error.");
+void buildItem(token * item, line * current, span where, int code){
+	item->code = code;
+	item->error = NO_ERROR;
+	item->length = where.length > MAX_LENGTH ? MAX_LENGTH : where.length;
+	item->offset = where.offset;
+	item->position = packPosition(current->lineNumber,
+			where.offset - current->offset + 1);
+	// the symbol id and value share their room, so only a variable is given
+	// an id, which it keeps at -1 until it is interned
+	item->value = 0;
+	if(code == ID){
+		item->symbol = -1;
 	}
 }
 
 /*
  *
- * name: buildSuper
+ * name: tokenName
  *
- * A simple wrapper function to assign then given parameters to the superToken.
+ * Copies the name of a token out of the source in upper case.  The token
+ * must be on a line which is still held by the source, which is always so
+ * for the token just scanned.
  *
- * @param	super	the superToken to be built
- * @param	item	the token
- * @param	word	the token name to be assigned
- * @param	code	the token code to be assigned
+ * @param	dest	the string of at least the token's length plus one
+ * 	characters to write
+ * @param	input	the source the token was read from
+ * @param	item	the token to be named
  */
-void buildSuper(superToken * super, char * word, int code){
-	token item;
-	strcpy(item.name, word);
-	item.code = code;
-	super->item = item;
+void tokenName(char * dest, sourceBuffer * input, const token * item){
+	upCopy(dest, sourceText(input, item->offset), item->length);
 }
-
@@ -11,10 +11,11 @@
 
 #include "tokens.h"
 #include "line.h"
+#include "source.h"
 
-int buildToken(char *, line *);
-int buildInt(char *, line *);
-void buildError(superToken *, int);
-void buildSuper(superToken *, char *, int);
+int buildToken(span *, line *);
+const char * errorMessage(int);
+void buildItem(token *, line *, span, int);
+void tokenName(char *, sourceBuffer *, const token *);
 
 #endif
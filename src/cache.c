@@ -0,0 +1,436 @@
+/*
+ *      cache.c
+ *
+ * This file contains the result cache.  Sources are keyed by the xxHash64 of
+ * their text, seeded with a hash of the reserved word table, the parser
+ * checking them and the cache's version, so changing any of them makes
+ * every result a miss.
+ *
+ * The cache is read whole into an open addressing table when it is opened,
+ * sized so the results of a whole batch fit without it ever filling.  The
+ * threads of a batch search it and add to it at once, claiming an empty slot
+ * with a compare and swap.  Each result is stamped with the run which last
+ * used it, and when the cache is saved only the CACHE_LIMIT most recently
+ * used are kept.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "hasher.h"
+#include "cache.h"
+
+#define CACHE_MAGIC "SPSCACH1"
+
+// changed whenever the parser would find something different in a source
+#define CACHE_VERSION 3
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+#define rotate(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static unsigned long long read64(const char * at){
+	unsigned long long value;
+	memcpy(&value, at, 8);
+	return value;
+}
+
+static unsigned long long mixLane(unsigned long long lane, unsigned long long input){
+	lane += input * PRIME2;
+	lane = rotate(lane, 31);
+	return lane * PRIME1;
+}
+
+static unsigned long long mergeLane(unsigned long long hash, unsigned long long lane){
+	hash ^= mixLane(0, lane);
+	return hash * PRIME1 + PRIME4;
+}
+
+/*
+ *
+ * name: hashText
+ *
+ * Hashes text with xxHash64, taking 32 characters at a time in four lanes.
+ *
+ * @param	text	the text to hash
+ * @param	length	the length of the text
+ * @param	seed	the seed of the hash
+ * @return	the hash
+ */
+static unsigned long long hashText(const char * text, long length, unsigned long long seed){
+	const char * end = text + length;
+	unsigned long long hash, v1, v2, v3, v4;
+	unsigned int word;
+
+	if(length >= 32){
+		v1 = seed + PRIME1 + PRIME2;
+		v2 = seed + PRIME2;
+		v3 = seed;
+		v4 = seed - PRIME1;
+		do{
+			v1 = mixLane(v1, read64(text));
+			v2 = mixLane(v2, read64(text + 8));
+			v3 = mixLane(v3, read64(text + 16));
+			v4 = mixLane(v4, read64(text + 24));
+			text += 32;
+		}while(text <= end - 32);
+		hash = rotate(v1, 1) + rotate(v2, 7) + rotate(v3, 12) + rotate(v4, 18);
+		hash = mergeLane(hash, v1);
+		hash = mergeLane(hash, v2);
+		hash = mergeLane(hash, v3);
+		hash = mergeLane(hash, v4);
+	}
+	else{
+		hash = seed + PRIME5;
+	}
+	hash += length;
+
+	for(; text + 8 <= end; text += 8){
+		hash ^= mixLane(0, read64(text));
+		hash = rotate(hash, 27) * PRIME1 + PRIME4;
+	}
+	if(text + 4 <= end){
+		memcpy(&word, text, 4);
+		hash ^= word * PRIME1;
+		hash = rotate(hash, 23) * PRIME2 + PRIME3;
+		text += 4;
+	}
+	for(; text < end; text++){
+		hash ^= (unsigned char)*text * PRIME5;
+		hash = rotate(hash, 11) * PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+/*
+ *
+ * name: placeEntry
+ *
+ * Adds a result to the table unless one with its key is already there.
+ *
+ * @param	cache	the cache
+ * @param	entry	the result
+ * @return	1 if it was added, 0 if its key was already there or the table
+ * 	is full
+ */
+static int placeEntry(resultCache * cache, cacheEntry * entry){
+	unsigned long long slot = entry->key & cache->mask;
+	unsigned long long probes;
+	cacheEntry * found;
+
+	for(probes = 0; probes <= cache->mask; probes++){
+		found = atomic_load_explicit(&cache->slots[slot], memory_order_acquire);
+		if(found == NULL){
+			if(atomic_compare_exchange_strong_explicit(&cache->slots[slot], &found,
+					entry, memory_order_release, memory_order_acquire)){
+				atomic_fetch_add(&cache->count, 1);
+				return 1;
+			}
+		}
+		if(found->key == entry->key){
+			return 0;
+		}
+		slot = (slot + 1) & cache->mask;
+	}
+	return 0;
+}
+
+/*
+ *
+ * name: newEntry
+ *
+ * Allocates a result with room for its text.
+ *
+ * @param	reportLength	the length of its errors
+ * @param	symbolLength	the length of its symbols
+ * @return	the result, or NULL if out of memory
+ */
+static cacheEntry * newEntry(int reportLength, int symbolLength){
+	cacheEntry * entry = malloc(sizeof(cacheEntry) + reportLength + symbolLength);
+	if(entry != NULL){
+		entry->reportLength = reportLength;
+		entry->symbolLength = symbolLength;
+	}
+	return entry;
+}
+
+/*
+ *
+ * name: readEntries
+ *
+ * Reads the results saved in a cache file into the table.  A damaged file
+ * simply gives up, keeping what was read so far.
+ *
+ * @param	cache	the cache
+ * @param	in	the cache file, after its header
+ * @param	count	the number of results saved
+ */
+static void readEntries(resultCache * cache, FILE * in, long count){
+	unsigned long long key, used;
+	int numbers[3];
+	cacheEntry * entry;
+
+	while(count-- > 0){
+		if(fread(&key, 8, 1, in) != 1 || fread(&used, 8, 1, in) != 1 ||
+				fread(numbers, sizeof(int), 3, in) != 3 ||
+				numbers[1] < 0 || numbers[2] < 0){
+			return;
+		}
+		entry = newEntry(numbers[1], numbers[2]);
+		if(entry == NULL){
+			return;
+		}
+		entry->key = key;
+		atomic_init(&entry->used, used);
+		entry->failed = numbers[0];
+		if(fread(entry->text, 1, numbers[1] + numbers[2], in) != (size_t)(numbers[1] + numbers[2])){
+			free(entry);
+			return;
+		}
+		if(!placeEntry(cache, entry)){
+			free(entry);
+		}
+	}
+}
+
+/*
+ *
+ * name: openCache
+ *
+ * Reads a cache file, or starts an empty cache if there is none yet.
+ *
+ * @param	cache	the cache to fill
+ * @param	fileName	the cache file
+ * @param	keywords	the reserved words the sources will be checked with
+ * @param	engine	the parser they will be checked with
+ * @param	files	the number of sources which may be added
+ * @return	1 if successful, 0 if out of memory
+ */
+int openCache(resultCache * cache, const char * fileName, const keywordTable * keywords,
+		int engine, int files){
+	unsigned long long header[2] = {0, 0};
+	char magic[8];
+	unsigned long long size = 64;
+	unsigned long long seed = CACHE_VERSION;
+	FILE * in;
+	int i;
+
+	// the reserved words are hashed field by field, as the table has padding
+	seed = hashText((const char *)&keywords->seed, sizeof(keywords->seed), seed);
+	seed = hashText((const char *)&keywords->shift, sizeof(keywords->shift), seed);
+	for(i=0;i<MAX_KEYWORD_SLOTS;i++){
+		seed = hashText((const char *)&keywords->slots[i].key, sizeof(unsigned long long), seed);
+		seed = hashText((const char *)&keywords->slots[i].code, sizeof(int), seed);
+	}
+	// the parsers word some errors differently
+	seed = hashText((const char *)&engine, sizeof(engine), seed);
+	cache->tokens = seed;
+
+	in = fopen(fileName, "rb");
+	if(in != NULL && (fread(magic, 1, 8, in) != 8 || memcmp(magic, CACHE_MAGIC, 8) != 0 ||
+			fread(header, 8, 2, in) != 2 || header[1] > CACHE_LIMIT)){
+		header[0] = 0;
+		header[1] = 0;
+	}
+	while(size < 2 * (header[1] + files)){
+		size *= 2;
+	}
+
+	cache->fileName = strdup(fileName);
+	cache->run = header[0] + 1;
+	cache->mask = size - 1;
+	cache->slots = calloc(size, sizeof(cacheEntry *));
+	atomic_init(&cache->count, 0);
+	if(cache->fileName == NULL || cache->slots == NULL){
+		free(cache->fileName);
+		free(cache->slots);
+		if(in != NULL){
+			fclose(in);
+		}
+		return 0;
+	}
+	if(in != NULL){
+		readEntries(cache, in, header[1]);
+		fclose(in);
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: sourceKey
+ *
+ * Works out the key of a source's results.
+ *
+ * @param	cache	the cache
+ * @param	text	the whole text of the source
+ * @param	length	the length of the text
+ * @return	the key
+ */
+unsigned long long sourceKey(resultCache * cache, const char * text, long length){
+	return hashText(text, length, cache->tokens);
+}
+
+/*
+ *
+ * name: findResult
+ *
+ * Finds the results of a source, marking them as used by this run.
+ *
+ * @param	cache	the cache
+ * @param	key	the key of the source
+ * @return	the results, or NULL if the source has not been seen
+ */
+cacheEntry * findResult(resultCache * cache, unsigned long long key){
+	unsigned long long slot = key & cache->mask;
+	unsigned long long probes;
+	cacheEntry * found;
+
+	for(probes = 0; probes <= cache->mask; probes++){
+		found = atomic_load_explicit(&cache->slots[slot], memory_order_acquire);
+		if(found == NULL){
+			return NULL;
+		}
+		if(found->key == key){
+			atomic_store_explicit(&found->used, cache->run, memory_order_relaxed);
+			return found;
+		}
+		slot = (slot + 1) & cache->mask;
+	}
+	return NULL;
+}
+
+/*
+ *
+ * name: storeResult
+ *
+ * Adds the results of a source just checked.
+ *
+ * @param	cache	the cache
+ * @param	key	the key of the source
+ * @param	failed	true if the source did not parse
+ * @param	report	its errors, one to a line without the name of the source
+ * @param	length	the length of the errors
+ * @param	symbols	its declared symbols, in the same form
+ * @param	symbolLength	the length of the symbols
+ */
+void storeResult(resultCache * cache, unsigned long long key, int failed,
+		const char * report, int length, const char * symbols, int symbolLength){
+	cacheEntry * entry = newEntry(length, symbolLength);
+
+	if(entry != NULL){
+		entry->key = key;
+		atomic_init(&entry->used, cache->run);
+		entry->failed = failed;
+		memcpy(entry->text, report, length);
+		memcpy(entry->text + length, symbols, symbolLength);
+		if(!placeEntry(cache, entry)){
+			free(entry);
+		}
+	}
+}
+
+static int newestFirst(const void * left, const void * right){
+	unsigned long long a = atomic_load(&(*(cacheEntry * const *)left)->used);
+	unsigned long long b = atomic_load(&(*(cacheEntry * const *)right)->used);
+	return (a < b) - (a > b);
+}
+
+/*
+ *
+ * name: saveCache
+ *
+ * Writes the CACHE_LIMIT most recently used results back to the cache file.
+ * They are written to a new file which then replaces the old, so the file is
+ * never seen half written.
+ *
+ * @param	cache	the cache
+ * @return	1 if successful, 0 otherwise
+ */
+int saveCache(resultCache * cache){
+	cacheEntry ** entries;
+	cacheEntry * entry;
+	unsigned long long header[2];
+	unsigned long long used;
+	int numbers[3];
+	char * temporary;
+	FILE * out;
+	long count = 0, i;
+	int ok;
+
+	entries = malloc((atomic_load(&cache->count) + 1) * sizeof(cacheEntry *));
+	temporary = malloc(strlen(cache->fileName) + 5);
+	if(entries == NULL || temporary == NULL){
+		free(entries);
+		free(temporary);
+		return 0;
+	}
+	for(i=0;i<=(long)cache->mask;i++){
+		if(cache->slots[i] != NULL){
+			entries[count++] = cache->slots[i];
+		}
+	}
+	qsort(entries, count, sizeof(cacheEntry *), newestFirst);
+	if(count > CACHE_LIMIT){
+		count = CACHE_LIMIT;
+	}
+
+	sprintf(temporary, "%s.new", cache->fileName);
+	out = fopen(temporary, "wb");
+	ok = out != NULL;
+	if(ok){
+		header[0] = cache->run;
+		header[1] = count;
+		fwrite(CACHE_MAGIC, 1, 8, out);
+		fwrite(header, 8, 2, out);
+		for(i=0;i<count;i++){
+			entry = entries[i];
+			used = atomic_load(&entry->used);
+			numbers[0] = entry->failed;
+			numbers[1] = entry->reportLength;
+			numbers[2] = entry->symbolLength;
+			fwrite(&entry->key, 8, 1, out);
+			fwrite(&used, 8, 1, out);
+			fwrite(numbers, sizeof(int), 3, out);
+			fwrite(entry->text, 1, entry->reportLength + entry->symbolLength, out);
+		}
+		ok = fclose(out) == 0 && rename(temporary, cache->fileName) == 0;
+		if(!ok){
+			remove(temporary);
+		}
+	}
+	free(entries);
+	free(temporary);
+	return ok;
+}
+
+/*
+ *
+ * name: closeCache
+ *
+ * Releases everything the cache holds.
+ *
+ * @param	cache	the cache
+ */
+void closeCache(resultCache * cache){
+	unsigned long long i;
+
+	for(i=0;i<=cache->mask;i++){
+		free(cache->slots[i]);
+	}
+	free(cache->slots);
+	free(cache->fileName);
+}
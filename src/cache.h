@@ -0,0 +1,50 @@
+/*
+ *      cache.h
+ *
+ * This file contains the result cache, which remembers what was found in
+ * each source checked, keyed by a hash of its text and of the reserved
+ * words, so an unchanged source need not be checked again.
+ *
+ */
+
+#ifndef cache_h
+#define cache_h
+
+#include <stdatomic.h>
+
+#include "config.h"
+#include "hasher.h"
+
+// what was found in one source: its errors, one to a line without the name
+// of the source, followed by its declared symbols in the same form
+typedef struct{
+	unsigned long long key;
+	_Atomic unsigned long long used;
+	int failed;
+	int reportLength;
+	int symbolLength;
+	char text[];
+} cacheEntry;
+
+#define entrySymbols(entry) ((entry)->text + (entry)->reportLength)
+
+// an open addressing table of results, which threads may search and add to
+// at once without locking.  Results are never removed until it is saved.
+typedef struct{
+	char * fileName;
+	unsigned long long tokens;
+	unsigned long long run;
+	_Atomic(cacheEntry *) * slots;
+	unsigned long long mask;
+	atomic_int count;
+} resultCache;
+
+int openCache(resultCache *, const char *, const keywordTable *, int, int);
+unsigned long long sourceKey(resultCache *, const char *, long);
+cacheEntry * findResult(resultCache *, unsigned long long);
+void storeResult(resultCache *, unsigned long long, int, const char *, int,
+		const char *, int);
+int saveCache(resultCache *);
+void closeCache(resultCache *);
+
+#endif
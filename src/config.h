@@ -10,10 +10,28 @@
 #define CONFIG_H
 
 #define MAX_FILE_LEN 32
-#define MAX_LINE_LEN 80
-#define MAX_MESSAGE_LEN 32
 #define MAX_TOKENS 21
 #define MAX_TOKEN_LEN 8
-#define HASH_TABLE_SIZE 30
+#define SHORT_NAME 16
+#define SHORT_RUN 8
+#define HASH_TABLE_SIZE 32
+#define MAX_KEYWORD_SLOTS 256
+#define SOURCE_BLOCK 65536
+#define ARENA_CHUNK 65536
+#define TOKEN_RING 4096
+#define LEX_CHUNK (1 << 20)
+#define LEX_WINDOW 2
+#define OUTPUT_BLOCK 65536
+#define OUTPUT_PIECES 1024
+#define LOAD_WINDOW 64
+#define LOAD_READERS 4
+#define CACHE_LIMIT 65536
+#define MAX_NESTING 1000
+#define PROBE_BUDGET 16
+#define TREE_NODES 1024
+#define LL_STACK 256
+#define TRACE_EVENTS (1 << 22)
+#define TRACE_PROBE_BUCKETS 16
+#define TRACE_SLOWEST 10
 
 #endif
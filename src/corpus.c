@@ -0,0 +1,307 @@
+/*
+ *      corpus.c
+ *
+ * This file contains corpus containers.  The container is mapped once and
+ * its records are found from the index, or by walking the headers of a tar,
+ * so each source is scanned where it lies in the mapping.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "corpus.h"
+
+#define TAR_BLOCK 512
+
+/*
+ *
+ * name: readNumber
+ *
+ * Reads a little endian number of the container.
+ *
+ * @param	at	the first byte of the number
+ * @param	bytes	the number of bytes
+ * @return	the number
+ */
+static unsigned long long readNumber(const char * at, int bytes){
+	unsigned long long value = 0;
+	while(bytes-- > 0){
+		value = (value << 8) | (unsigned char)at[bytes];
+	}
+	return value;
+}
+
+/*
+ *
+ * name: addRecord
+ *
+ * Adds a record to a corpus.
+ *
+ * @param	holder	the corpus
+ * @param	capacity	the room in its records, grown as needed
+ * @param	name	the name of the record, allocated with malloc()
+ * @param	text	the text of the record
+ * @param	length	the length of the text
+ * @return	1 if successful, 0 if out of memory
+ */
+static int addRecord(corpus * holder, int * capacity, char * name, const char * text,
+		long length){
+	corpusRecord * bigger;
+
+	if(name == NULL){
+		return 0;
+	}
+	if(holder->count == *capacity){
+		bigger = realloc(holder->records, (*capacity ? *capacity * 2 : 256) * sizeof(corpusRecord));
+		if(bigger == NULL){
+			free(name);
+			return 0;
+		}
+		holder->records = bigger;
+		*capacity = *capacity ? *capacity * 2 : 256;
+	}
+	holder->records[holder->count].name = name;
+	holder->records[holder->count].text = text;
+	holder->records[holder->count].length = length;
+	holder->count++;
+	return 1;
+}
+
+/*
+ *
+ * name: readContainer
+ *
+ * Finds the records of a container from its index, checking that each lies
+ * within the file.
+ *
+ * @param	holder	the mapped corpus
+ * @return	1 if successful, 0 if the container is damaged
+ */
+static int readContainer(corpus * holder){
+	const char * data = holder->data;
+	unsigned long long count, index, offset, nameLength, length;
+	int capacity = 0;
+	unsigned long long i;
+
+	count = readNumber(data + 8, 8);
+	index = readNumber(data + 16, 8);
+	if(count > INT_MAX || index < CORPUS_HEADER || index > (unsigned long long)holder->size ||
+			(holder->size - index) / 8 < count){
+		return 0;
+	}
+	for(i=0;i<count;i++){
+		offset = readNumber(data + index + 8 * i, 8);
+		if(offset < CORPUS_HEADER || offset > index || index - offset < 12){
+			return 0;
+		}
+		nameLength = readNumber(data + offset, 4);
+		if(index - offset - 12 < nameLength){
+			return 0;
+		}
+		length = readNumber(data + offset + 4 + nameLength, 8);
+		if(index - offset - 12 - nameLength < length){
+			return 0;
+		}
+		if(!addRecord(holder, &capacity, strndup(data + offset + 4, nameLength),
+				data + offset + 12 + nameLength, length)){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: octal
+ *
+ * Reads an octal number from a tar header.
+ *
+ * @param	at	the field
+ * @param	size	the size of the field
+ * @return	the number, -1 if it is not one
+ */
+static long octal(const char * at, int size){
+	long value = 0;
+	int i = 0;
+
+	while(i < size && at[i] == ' '){
+		i++;
+	}
+	if(i == size || at[i] < '0' || at[i] > '7'){
+		return -1;
+	}
+	for(; i < size && at[i] >= '0' && at[i] <= '7'; i++){
+		if(value > LONG_MAX / 8){
+			return -1;
+		}
+		value = value * 8 + (at[i] - '0');
+	}
+	return value;
+}
+
+/*
+ *
+ * name: paxPath
+ *
+ * Finds the path in a pax extended header, which names the entry after it.
+ *
+ * @param	text	the records of the header
+ * @param	length	the length of the records
+ * @return	the path allocated with malloc(), or NULL if there is none
+ */
+static char * paxPath(const char * text, long length){
+	long at = 0, size, key;
+
+	while(at < length){
+		size = 0;
+		for(key = at; key < length && text[key] >= '0' && text[key] <= '9'; key++){
+			size = size * 10 + (text[key] - '0');
+		}
+		if(size <= key - at || size > length - at){
+			return NULL;
+		}
+		key++;
+		if(at + size - key > 5 && strncmp(text + key, "path=", 5) == 0){
+			return strndup(text + key + 5, at + size - key - 6);
+		}
+		at += size;
+	}
+	return NULL;
+}
+
+/*
+ *
+ * name: readTar
+ *
+ * Finds the plain files of a tar by walking its headers.  Long names given by
+ * GNU or pax headers are followed, and everything else is passed over.
+ *
+ * @param	holder	the mapped corpus
+ * @return	1 if successful, 0 if the tar is damaged
+ */
+static int readTar(corpus * holder){
+	const char * header;
+	char * longName = NULL;
+	char * name;
+	long offset = 0, length, prefix, base;
+	int capacity = 0;
+
+	while(offset <= holder->size - TAR_BLOCK){
+		header = holder->data + offset;
+		if(header[0] == '\0'){
+			break;
+		}
+		length = octal(header + 124, 12);
+		if(length < 0 || length > holder->size - offset - TAR_BLOCK){
+			free(longName);
+			return 0;
+		}
+		if(header[156] == 'L' || header[156] == 'x'){
+			free(longName);
+			longName = header[156] == 'L' ? strndup(header + TAR_BLOCK, length) :
+					paxPath(header + TAR_BLOCK, length);
+		}
+		else{
+			if(header[156] == '0' || header[156] == '\0' || header[156] == '7'){
+				if(longName != NULL){
+					name = longName;
+				}
+				else{
+					prefix = strnlen(header + 345, 155);
+					base = strnlen(header, 100);
+					name = malloc(prefix + base + 2);
+					if(name != NULL){
+						sprintf(name, prefix ? "%.*s/%.*s" : "%.*s%.*s",
+								(int)prefix, header + 345, (int)base, header);
+					}
+				}
+				longName = NULL;
+				if(!addRecord(holder, &capacity, name, header + TAR_BLOCK, length)){
+					return 0;
+				}
+			}
+			free(longName);
+			longName = NULL;
+		}
+		offset += TAR_BLOCK + (length + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+	}
+	free(longName);
+	return 1;
+}
+
+/*
+ *
+ * name: openCorpus
+ *
+ * Maps a container or tar and finds its records.
+ *
+ * @param	holder	the corpus to fill
+ * @param	fileName	the name of the container
+ * @return	1 if successful, 0 if it could not be read or is damaged
+ */
+int openCorpus(corpus * holder, const char * fileName){
+	struct stat info;
+	void * data;
+	int fd, ok = 0;
+
+	holder->data = NULL;
+	holder->size = 0;
+	holder->records = NULL;
+	holder->count = 0;
+	fd = open(fileName, O_RDONLY);
+	if(fd < 0){
+		return 0;
+	}
+	if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size < CORPUS_HEADER){
+		close(fd);
+		return 0;
+	}
+	data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED){
+		return 0;
+	}
+	holder->data = data;
+	holder->size = info.st_size;
+
+	if(memcmp(holder->data, CORPUS_MAGIC, 8) == 0){
+		ok = readContainer(holder);
+	}
+	else if(holder->size >= TAR_BLOCK && memcmp(holder->data + 257, "ustar", 5) == 0){
+		ok = readTar(holder);
+	}
+	if(!ok){
+		closeCorpus(holder);
+	}
+	return ok;
+}
+
+/*
+ *
+ * name: closeCorpus
+ *
+ * Unmaps a corpus and releases its records.
+ *
+ * @param	holder	the corpus to close
+ */
+void closeCorpus(corpus * holder){
+	int i;
+
+	for(i=0;i<holder->count;i++){
+		free(holder->records[i].name);
+	}
+	free(holder->records);
+	if(holder->data != NULL){
+		munmap((void *)holder->data, holder->size);
+	}
+	holder->data = NULL;
+	holder->records = NULL;
+	holder->count = 0;
+}
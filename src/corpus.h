@@ -0,0 +1,46 @@
+/*
+ *      corpus.h
+ *
+ * This file contains corpus containers, which hold many sources in one file
+ * so a large corpus is a single mapping rather than a file for each source.
+ * Either a plain tar or the container written by mkcorpus can be read.
+ *
+ * The container is laid out as follows, every number little endian:
+ *
+ *	"SPSCORP1"		8 characters
+ *	record count		8 bytes
+ *	index offset		8 bytes
+ *	records, each:
+ *		name length	4 bytes
+ *		name
+ *		text length	8 bytes
+ *		text
+ *	index:
+ *		the offset of each record, 8 bytes each
+ *
+ */
+
+#ifndef corpus_h
+#define corpus_h
+
+#define CORPUS_MAGIC "SPSCORP1"
+#define CORPUS_HEADER 24
+
+// a source held in a corpus
+typedef struct{
+	char * name;
+	const char * text;
+	long length;
+} corpusRecord;
+
+typedef struct{
+	const char * data;
+	long size;
+	corpusRecord * records;
+	int count;
+} corpus;
+
+int openCorpus(corpus *, const char *);
+void closeCorpus(corpus *);
+
+#endif
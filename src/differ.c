@@ -0,0 +1,374 @@
+/*
+ *      differ.c
+ *
+ * Checks that the recursive descent and the table driven parsers recover
+ * from errors alike.  A few sources with known errors are checked for the
+ * number of errors each parser finds, then every source given is mutated
+ * many times over, a word at a time, and each mutant is parsed with both.
+ * Half the mutants are changed only in their heading, where the program's
+ * name and VAR are.  The check fails if a parser crashes, or if the two
+ * print anything different: the listing, the errors or the symbol table.
+ *
+ * Input: The parser to check, and the sources to mutate.
+ *
+ * Output: A line for each source with the number of mutants which differed,
+ * 	and the first of them, kept as mutant.sps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// the mutants made of each source
+#define MUTANTS 200
+// the words from the start of a source which make up its heading
+#define HEADING_WORDS 4
+
+// a source with the number of errors it has
+typedef struct{
+	const char * name;
+	const char * text;
+	int errors;
+} knownCase;
+
+static const knownCase cases[] = {
+	{"number for a name", "PROGRAM 1\nVAR X : INTEGER\nBEGIN X := 1 END.\n", 1},
+	{"bad name", "PROGRAM STEND.ATS\nVAR X : INTEGER\nBEGIN X := 1 END.\n", 1},
+	{"no PROGRAM", "STATS\nVAR X : INTEGER\nBEGIN X := 1 END.\n", 1},
+	{"no VAR", "PROGRAM STATS\nX : INTEGER;\nY : INTEGER\nBEGIN Y := 1 END.\n", 1},
+	{"bad declaration", "PROGRAM P\nVAR X : INTEGR;\nY : INTEGER\nBEGIN Y := 1 END.\n", 1},
+	{"bad statements", "PROGRAM P\nVAR X : INTEGER\nBEGIN\nX := ;\nX := 1 +;\n"
+			"READ(X;\nX := 2\nEND.\n", 3},
+	{"block while skipping", "PROGRAM P\nVAR X : INTEGER\nBEGIN\n"
+			"X X BEGIN X := END;\nX := 1\nEND.\n", 2},
+};
+
+// what a word may be changed into
+static const char * words[] = {"PROGRAM", "VAR", "BEGIN", "END", "END.",
+	"INTEGER", "FOR", "READ", "WRITE", "TO", "DO", ";", ":", ",", ":=", "+",
+	"-", "*", "DIV", "(", ")", "X", "Q9", "12", "9A", "1", "STEND.ATS"};
+
+#define count(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+static unsigned long long seed = 1;
+
+/*
+ *
+ * name: pick
+ *
+ * Picks a random number with xorshift, so the mutants are the same on
+ * every run.
+ *
+ * @param	limit	one more than the largest number wanted
+ * @return	a number from 0 to limit-1
+ */
+static int pick(int limit){
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)((seed >> 16) % limit);
+}
+
+/*
+ *
+ * name: readWhole
+ *
+ * @param	fileName	the file
+ * @param	length	set to the length of the file
+ * @return	the text of the file, NULL if it could not be read
+ */
+static char * readWhole(const char * fileName, long * length){
+	FILE * in = fopen(fileName, "r");
+	char * text;
+
+	if(in == NULL){
+		return NULL;
+	}
+	fseek(in, 0, SEEK_END);
+	*length = ftell(in);
+	rewind(in);
+	text = malloc(*length + 1);
+	if(text != NULL && fread(text, 1, *length, in) != (size_t)*length){
+		free(text);
+		text = NULL;
+	}
+	fclose(in);
+	return text;
+}
+
+/*
+ *
+ * name: runParser
+ *
+ * Runs the parser over a source and keeps everything it prints.
+ *
+ * @param	parser	the parser to run
+ * @param	fileName	the source
+ * @param	table	1 to parse with the tables, 0 by recursive descent
+ * @param	output	set to what it printed, to be freed by the caller
+ * @return	0 if the parser finished, otherwise the signal which killed it,
+ * 	or -1 if it could not be run
+ */
+static int runParser(const char * parser, const char * fileName, int table,
+		char ** output){
+	char command[4096];
+	char block[65536];
+	size_t got, length;
+	FILE * in, * out;
+	int status;
+
+	snprintf(command, sizeof(command), "%s %s%s 2>&1", parser,
+			table ? "-g table " : "", fileName);
+	*output = NULL;
+	out = open_memstream(output, &length);
+	in = popen(command, "r");
+	if(out == NULL || in == NULL){
+		return -1;
+	}
+	while((got = fread(block, 1, sizeof(block), in)) > 0){
+		fwrite(block, 1, got, out);
+	}
+	fclose(out);
+	status = pclose(in);
+	if(status < 0){
+		return -1;
+	}
+	if(WIFSIGNALED(status)){
+		return WTERMSIG(status);
+	}
+	return WEXITSTATUS(status) == 127 ? -1 : 0;
+}
+
+/*
+ *
+ * name: countErrors
+ *
+ * @param	output	what the parser printed
+ * @return	the number of errors it printed
+ */
+static int countErrors(const char * output){
+	int errors = 0;
+
+	while((output = strstr(output, "(!) FAIL:")) != NULL){
+		errors++;
+		output++;
+	}
+	return errors;
+}
+
+/*
+ *
+ * name: mutate
+ *
+ * Writes a source with one to three of its words deleted, changed or
+ * preceded by another word.  Everything between the words is kept.
+ *
+ * @param	out	the mutant to write
+ * @param	text	the source
+ * @param	length	the length of the source
+ * @param	heading	1 to change only the words of the heading
+ */
+static void mutate(FILE * out, const char * text, long length, int heading){
+	static long * starts = NULL;
+	static long capacity = 0;
+	const char * changed[3], * inserted[3];
+	long at[3], i, w, found = 0;
+	int edits = 1 + pick(3), e, done;
+
+	// where each word starts, with one more start past the end
+	for(i=0;i<=length;i++){
+		if(i < length && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' ||
+				text[i] == '\r' || (i > 0 && text[i-1] != ' ' && text[i-1] != '\t' &&
+				text[i-1] != '\n' && text[i-1] != '\r'))){
+			continue;
+		}
+		if(found == capacity){
+			capacity = capacity ? capacity * 2 : 1024;
+			starts = realloc(starts, capacity * sizeof(long));
+			if(starts == NULL){
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+		}
+		starts[found++] = i;
+	}
+	found--;
+	if(found <= 0){
+		fwrite(text, 1, length, out);
+		return;
+	}
+
+	for(e=0;e<edits;e++){
+		at[e] = pick(heading && found > HEADING_WORDS ? HEADING_WORDS : found);
+		changed[e] = NULL;
+		inserted[e] = NULL;
+		switch(pick(3)){
+			case 0:
+				changed[e] = "";
+				break;
+			case 1:
+				changed[e] = words[pick(count(words))];
+				break;
+			default:
+				inserted[e] = words[pick(count(words))];
+				break;
+		}
+	}
+
+	fwrite(text, 1, starts[0], out);
+	for(w=0;w<found;w++){
+		done = 0;
+		for(e=0;e<edits;e++){
+			if(at[e] == w && inserted[e] != NULL){
+				fprintf(out, "%s ", inserted[e]);
+			}
+		}
+		for(e=0;e<edits && !done;e++){
+			if(at[e] == w && changed[e] != NULL){
+				fputs(changed[e], out);
+				done = 1;
+			}
+		}
+		// the word is followed by the space up to the next
+		for(i=starts[w]; i < starts[w+1]; i++){
+			if(!done || text[i] == ' ' || text[i] == '\t' || text[i] == '\n' ||
+					text[i] == '\r'){
+				fputc(text[i], out);
+			}
+		}
+	}
+}
+
+/*
+ *
+ * name: compare
+ *
+ * Parses a file with both parsers.
+ *
+ * @param	parser	the parser to run
+ * @param	fileName	the source
+ * @param	errors	set to the errors found by the recursive descent parser
+ * @return	1 if both printed the same, 0 if not, otherwise the negated
+ * 	signal which killed one, or -1 if it could not be run
+ */
+static int compare(const char * parser, const char * fileName, int * errors){
+	char * descent, * table;
+	int killed, same;
+
+	killed = runParser(parser, fileName, 0, &descent);
+	if(killed == 0){
+		killed = runParser(parser, fileName, 1, &table);
+	}
+	else{
+		table = NULL;
+	}
+	if(killed != 0){
+		free(descent);
+		free(table);
+		return killed < 0 ? -1 : -killed;
+	}
+	*errors = countErrors(descent);
+	same = strcmp(descent, table) == 0;
+	free(descent);
+	free(table);
+	return same;
+}
+
+int main(int argc, char** argv){
+	char fileName[] = "/tmp/differXXXXXX";
+	char * text;
+	long length;
+	int a, c, m, result, errors, differ, failed = 0;
+	int fd;
+	FILE * out;
+
+	if(argc < 2){
+		printf("usage: %s parser [source...]\n", argv[0]);
+		return 1;
+	}
+	fd = mkstemp(fileName);
+	if(fd < 0){
+		printf("Could not create %s!\n", fileName);
+		return 1;
+	}
+	close(fd);
+
+	for(c=0; c < count(cases); c++){
+		out = fopen(fileName, "w");
+		if(out == NULL){
+			printf("Could not write %s!\n", fileName);
+			return 1;
+		}
+		fputs(cases[c].text, out);
+		fclose(out);
+		result = compare(argv[1], fileName, &errors);
+		printf("%-24s", cases[c].name);
+		if(result == -1){
+			printf("  could not run %s\n", argv[1]);
+			unlink(fileName);
+			return 1;
+		}
+		if(result < 0){
+			printf("  FAILED, killed by signal %d\n", -result);
+			failed = 1;
+		}
+		else if(result == 0){
+			printf("  FAILED, the parsers differ\n");
+			failed = 1;
+		}
+		else if(errors != cases[c].errors){
+			printf("  FAILED, %d errors found, %d expected\n", errors, cases[c].errors);
+			failed = 1;
+		}
+		else{
+			printf("  %d errors\n", errors);
+		}
+	}
+
+	for(a=2; a<argc; a++){
+		text = readWhole(argv[a], &length);
+		if(text == NULL){
+			printf("Could not read %s!\n", argv[a]);
+			failed = 1;
+			continue;
+		}
+		printf("%-24s", argv[a]);
+		fflush(stdout);
+		differ = 0;
+		for(m=0; m<MUTANTS; m++){
+			out = fopen(fileName, "w");
+			if(out == NULL){
+				printf("Could not write %s!\n", fileName);
+				return 1;
+			}
+			mutate(out, text, length, m % 2);
+			fclose(out);
+			result = compare(argv[1], fileName, &errors);
+			if(result == -1){
+				printf("  could not run %s\n", argv[1]);
+				unlink(fileName);
+				return 1;
+			}
+			if(result < 0){
+				printf("  FAILED, killed by signal %d", -result);
+			}
+			if(result <= 0 && differ++ == 0){
+				// the first mutant to differ is kept to be looked at
+				rename(fileName, "mutant.sps");
+			}
+		}
+		free(text);
+		if(differ > 0){
+			printf("  %d of %d mutants FAILED, the first kept as mutant.sps\n",
+					differ, MUTANTS);
+			failed = 1;
+		}
+		else{
+			printf("  %d mutants alike\n", MUTANTS);
+		}
+	}
+	unlink(fileName);
+	return failed;
+}
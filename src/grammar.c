@@ -13,51 +13,175 @@
 #include "tokens.h"
 #include "hasher.h"
 #include "scanner.h"
+#include "builders.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "output.h"
+#include "ast.h"
+#include "sps.h"
+#include "session.h"
 #include "grammar.h"
+#include "llparse.h"
+#include "trace.h"
+
+// a rule being parsed, whose leaving is reported at the end of its block
+typedef struct{
+	const spsHandlers * handlers;
+	void * context;
+	int rule;
+} ruleScope;
+
+/*
+ * name: enterRule
+ *
+ * Reports entering a rule, if anyone is listening.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	rule	the rule, one of SPS_PROG to SPS_BODY
+ * @return	the scope to report leaving it with
+ */
+static inline ruleScope enterRule(sourceContainer* source, int rule){
+	ruleScope scope = {source->handlers, source->context, rule};
+	if(scope.handlers != NULL && scope.handlers->enterRule != NULL){
+		scope.handlers->enterRule(scope.context, rule);
+	}
+	return scope;
+}
+
+static inline void leaveRule(ruleScope * scope){
+	if(scope->handlers != NULL && scope->handlers->exitRule != NULL){
+		scope->handlers->exitRule(scope->context, scope->rule);
+	}
+}
+
+// starts every rule, timing it when traced and reporting it to the embedder.
+// The spans of the rules are in the same order as the rules.
+#define RULE_SCOPE(source, rule) TRACE_SCOPE(TRACE_PROG + (rule)); \
+	ruleScope ruleScope_ __attribute__((cleanup(leaveRule))) = enterRule(source, rule)
 
 /*
  * name: err
  *
- * Prints a simple message.  Will attempt to print any scanner message within
- * the token first.
+ * Prints a simple message.  Will attempt to print any scanner error within
+ * the current token first, whose message is only looked up here.  The error
+ * is also recorded in the session, and reported to the embedder.
  *
+ * @param	source	the structure containing all parser information
  * @param	str	the string to print
- * @param	token	the current token which has caused the error.
  */
-void err(char * str, superToken token){
-	if(token.message[0] == '\0'){
-		printf("\n----------\n(!) FAIL: %s\n(!) CURRENT TOKEN: %s\n----------\n",
-				str, token.item.name);
+void err(sourceContainer* source, const char * str){
+	diagnostic * found;
+	// nothing found after a halt is real, the tokens may have been cut short
+	if(source->halted){
+		return;
+	}
+	if(source->currentToken.error != NO_ERROR){
+		str = errorMessage(source->currentToken.error);
+	}
+	found = addDiagnostic(source, str);
+	if(source->handlers != NULL && source->handlers->diagnostic != NULL){
+		source->handlers->diagnostic(source->context, str,
+				found != NULL ? found->tokenName : "",
+				tokenLine(source->currentToken), tokenColumn(source->currentToken));
+	}
+	sinkPrintf(source->output,
+			"\n----------\n(!) FAIL: %s\n(!) CURRENT TOKEN: %s\n----------\n",
+			str, found != NULL ? found->tokenName : "");
+}
+
+/*
+ * name: halt
+ *
+ * Prints an error the parse cannot go on from, such as running out of
+ * memory.  No recovery is tried after it, so it is the last error found.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	str	the string to print
+ */
+void halt(sourceContainer* source, const char * str){
+	err(source, str);
+	source->halted = 1;
+}
+
+/*
+ * name: nextToken
+ *
+ * Reads the next token from the scanner into the current token of the
+ * source structure, or from the scanner threads if the source is pipelined or
+ * split.
+ *
+ * @param	source	the structure containing all parser information
+ */
+void nextToken(sourceContainer* source){
+	TRACE_COUNT(COUNT_TOKENS, 1);
+	if(source->parallel != NULL){
+		source->currentToken = takeToken(source->parallel, source->current,
+				&source->symbols);
+		if(source->parallel->failed && !source->halted){
+			halt(source, "Out of memory for scanner!");
+		}
+	}
+	else if(source->pipeline != NULL){
+		source->currentToken = pullToken(source->pipeline, source->current,
+				&source->symbols);
 	}
 	else{
-		printf("\n----------\n(!) FAIL: %s\n(!) CURRENT TOKEN: %s\n----------\n",
-				token.message, token.item.name);
+		source->currentToken = getToken(source->current, source->keywords,
+				&source->symbols);
+		// a streamed source which could not hold a line ends early
+		if(source->input->failed && !source->halted){
+			halt(source, "Out of memory for source!");
+		}
 	}
 }
 
+/*
+ * name: report
+ *
+ * Reports a variable declared or used at the current token to the given
+ * callback of the embedder.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	callback	the declaration or use callback
+ */
+static void report(sourceContainer* source, void (*callback)(void *, int,
+		const char *, int, int, int)){
+	symbol * entry = &source->symbols.symbols[source->currentToken.symbol];
+	callback(source->context, source->currentToken.symbol, symbolName(entry),
+			entry->length, tokenLine(source->currentToken),
+			tokenColumn(source->currentToken));
+}
+
 /*
  * name: addId
  *
- * Will add the current token to the symbol table within the source structure
- * and set the type of the item to the given type.
+ * Will declare the current token in the symbol table within the source
+ * structure and set the type of the item to the given type.  The scanner has
+ * already interned the name, so this only indexes the symbol by its id.  A
+ * name declared twice is reported, and the parse goes on.
  *
  * @param	source	the structure containing all parser information
  * @param	type	the type to set the item to
- * @return	0 upon error, 1 if successful	
+ * @return	0 upon an error the rule cannot go on from, 1 otherwise
  */
 int addId(sourceContainer* source, int type){
-	if(source->currentToken.error > 0){
-		err(source->currentToken.message, source->currentToken);
+	symbol * entry;
+	if(source->currentToken.error != NO_ERROR){
+		err(source, errorMessage(source->currentToken.error));
 		return 0;
 	}
-	int res = insertHash(source->symbolTable, source->currentToken.item.name, type);
-	if(res == 0){
-		err("Identifier already in symbol table", source->currentToken);
+	if(source->currentToken.symbol < 0){
+		halt(source, "Out of memory for symbol table!");
 		return 0;
 	}
-	else if(res == -1){
-		err("Symbol table full!", source->currentToken);
-		return 0;
+	entry = &source->symbols.symbols[source->currentToken.symbol];
+	if(entry->code != UNDECLARED){
+		err(source, "Identifier already in symbol table");
+		return 1;
+	}
+	entry->code = type;
+	if(source->handlers != NULL && source->handlers->declaration != NULL){
+		report(source, source->handlers->declaration);
 	}
 	return 1;
 }
@@ -66,27 +190,193 @@ int addId(sourceContainer* source, int type){
  * name: lookupId
  *
  * Will look up the current token in the symbol table within the source
- * structure.
+ * structure, by the id the scanner gave it.  A name not declared is
+ * reported, and the parse goes on.
  *
  * @param	source	the structure containing all parser information
- * @return	0 upon error, 1 if successful	
+ * @return	0 upon an error the rule cannot go on from, 1 otherwise
  */
 int lookupId(sourceContainer* source){
-	if(source->currentToken.error > 0){
-		err(source->currentToken.message, source->currentToken);
+	if(source->currentToken.error != NO_ERROR){
+		err(source, errorMessage(source->currentToken.error));
 		return 0;
 	}
-	if(-1 == getHash(source->symbolTable, source->currentToken.item.name)){
-		err("Identifier not declared", source->currentToken);
+	if(source->currentToken.symbol < 0 ||
+			source->symbols.symbols[source->currentToken.symbol].code == UNDECLARED){
+		err(source, "Identifier not declared");
+		return 1;
+	}
+	if(source->handlers != NULL && source->handlers->use != NULL){
+		report(source, source->handlers->use);
+	}
+	return 1;
+}
+
+/*
+ * name: roomForNode
+ *
+ * Makes room for another node in a full syntax tree.  The nodes made for
+ * the tokens read so far are scaled up to the length of the whole source,
+ * so a tree is grown to about its final size once or twice rather than
+ * doubled many times over.  A streamed source, whose length is not known
+ * yet, has its tree doubled.
+ *
+ * @param	source	the structure containing all parser information
+ * @return	0 if out of memory, 1 if successful
+ */
+static int roomForNode(sourceContainer* source){
+	astTree * tree = &source->tree;
+	long read = source->currentToken.offset + 1;
+	long wanted = 0;
+
+	if(tree->count < tree->capacity || !treeKept(tree)){
+		return 1;
+	}
+	if(source->input->atEnd && read < source->input->length){
+		// an eighth more, so a tree denser towards its end rarely grows again
+		wanted = (double)tree->count * source->input->length / read * 1.125;
+	}
+	if(!growTree(tree, wanted)){
+		halt(source, "Out of memory for syntax tree!");
 		return 0;
 	}
 	return 1;
 }
 
+/*
+ * name: addTree
+ *
+ * Adds a node to the syntax tree after all of its children, which were added
+ * from the given index on.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	kind	the kind of node
+ * @param	first	the index its subtree starts at
+ * @param	position	the position of the token it was made from
+ * @param	value	the value of the node, as its kind says
+ * @return	0 upon error, 1 if successful
+ */
+int addTree(sourceContainer* source, int kind, unsigned int first,
+		unsigned long long position, int value){
+	if(!roomForNode(source)){
+		return 0;
+	}
+	if(addNode(&source->tree, kind, first, position, value) < 0){
+		halt(source, "Out of memory for syntax tree!");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * name: addLeaf
+ *
+ * Adds a node to the syntax tree for the current token, a variable or an
+ * integer.
+ *
+ * @param	source	the structure containing all parser information
+ * @return	0 upon error, 1 if successful
+ */
+int addLeaf(sourceContainer* source){
+	int added;
+	if(!roomForNode(source)){
+		return 0;
+	}
+	if(source->currentToken.code == INT){
+		added = addInteger(&source->tree, source->currentToken.position,
+				source->currentToken.value);
+	}
+	else{
+		added = addNode(&source->tree, NODE_VARIABLE, source->tree.count,
+				source->currentToken.position, source->currentToken.symbol);
+	}
+	if(added < 0){
+		halt(source, "Out of memory for syntax tree!");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * name: nest
+ *
+ * Goes one level deeper into parentheses or FOR statements.  Every level is
+ * a few calls deeper on the C stack, so a source nested too deeply is
+ * rejected before the stack runs out.  The caller comes back out by
+ * lowering the depth itself.
+ *
+ * @param	source	the structure containing all parser information
+ * @return	0 upon error, 1 if successful
+ */
+static int nest(sourceContainer* source){
+	if(source->depth >= MAX_NESTING){
+		err(source, "Nesting too deep");
+		return 0;
+	}
+	source->depth++;
+	return 1;
+}
+
+/*
+ * name: recover
+ *
+ * Skips ahead after an error to a token the parse can go on from: a
+ * semicolon, BEGIN, END, END. or the end of the source, and in the heading
+ * VAR.  Among statements a block met on the way is parsed, so the errors
+ * within it are found and its END does not end the statements around it.
+ * A block nested too deeply to parse is skipped whole.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	resume	where the parse goes on, one of RESUME_HEADING to
+ * 	RESUME_STATEMENTS
+ * @return	0 if the parse cannot go on, 1 if successful
+ */
+static int recover(sourceContainer* source, int resume){
+	// the blocks open within one being skipped whole
+	int skipped = 0;
+	int code;
+	while(!source->halted){
+		code = source->currentToken.code;
+		if(endOfTokens(source) || code == ENDDOT){
+			return 1;
+		}
+		if((code == BEGIN && resume != RESUME_STATEMENTS) ||
+				(code == VAR && resume == RESUME_HEADING)){
+			return 1;
+		}
+		if(code == BEGIN && skipped == 0 && source->depth < MAX_NESTING){
+			source->depth++;
+			stmtList(source);
+			source->depth--;
+			if(source->currentToken.code == END){
+				nextToken(source);
+			}
+			else if(!source->halted){
+				err(source, "Expected END");
+			}
+			continue;
+		}
+		if(code == BEGIN){
+			skipped++;
+		}
+		else if(code == END && skipped > 0){
+			skipped--;
+		}
+		else if((code == SEMICOLON || code == END) && skipped == 0){
+			return 1;
+		}
+		nextToken(source);
+	}
+	return 0;
+}
+
 /*
  * name: prog
  *
- * The beginning function of our recursive descent.
+ * The beginning function of our recursive descent.  An error in the heading
+ * is skipped up to the declarations or the statements, and one after the
+ * declarations up to the statements, so the rest of the program is still
+ * checked.
  *
  * Rule: <prog> ::= PROGRAM <prog-name> VAR <dec-list> BEGIN <stmt-list> END.
  *
@@ -94,40 +384,50 @@ int lookupId(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int prog(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if (source->currentToken.item.code == PROGRAM){
+	unsigned long long position = 0;
+	int name = -1;
+	RULE_SCOPE(source, SPS_PROG);
+	nextToken(source);
+	if (source->currentToken.code == PROGRAM){
+		position = source->currentToken.position;
 		if (progName(source)){
-			source->currentToken = getToken(source->current, source->infile, source->hashTable);
-			if (source->currentToken.item.code == VAR){
-				if (decList(source)){
-					if (source->currentToken.item.code == BEGIN){
-						if(stmtList(source)){
-							if(source->currentToken.item.code == ENDDOT){
-								return 1;
-							}
-							else {
-								err("Expected END.", source->currentToken);
-								return 0;
-							}
-						}
-					}
-					else {
-						err("Expected BEGIN", source->currentToken);
-						return 0;
-					}
-				}
+			name = source->currentToken.symbol;
+			nextToken(source);
+			if (source->currentToken.code != VAR){
+				err(source, "Expected VAR");
 			}
-			else {
-				err("Expected VAR", source->currentToken);
+		}
+	}
+	else {
+		err(source, "Expected PROGRAM");
+	}
+	if (source->currentToken.code != VAR && !recover(source, RESUME_HEADING)){
+		return 0;
+	}
+	if (source->currentToken.code == VAR || source->currentToken.code == SEMICOLON){
+		if (!decList(source)){
+			return 0;
+		}
+		if (source->currentToken.code != BEGIN){
+			err(source, "Expected BEGIN");
+			if (!recover(source, RESUME_DECLARATIONS)){
 				return 0;
 			}
 		}
 	}
-	else {
-		err("Expected PROGRAM", source->currentToken);
+	if (source->currentToken.code == BEGIN || source->currentToken.code == SEMICOLON){
+		if (!stmtList(source)){
+			return 0;
+		}
+		if (source->currentToken.code != ENDDOT){
+			err(source, "Expected END.");
+			return 0;
+		}
+	}
+	else if (source->currentToken.code != ENDDOT){
 		return 0;
 	}
-	return 0;
+	return source->errors == 0 && addTree(source, NODE_PROG, 0, position, name);
 }
 
 /*
@@ -139,8 +439,9 @@ int prog(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int progName(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if(source->currentToken.item.code == ID){
+	RULE_SCOPE(source, SPS_PROG_NAME);
+	nextToken(source);
+	if(source->currentToken.code == ID){
 		// add to symbol table
 		if(!addId(source, 0)){
 			return 0;
@@ -148,7 +449,7 @@ int progName(sourceContainer* source){
 		return 1;
 	}
 	else{
-		err("Expected variable name", source->currentToken);
+		err(source, "Expected variable name");
 		return 0;
 	}
 	return 0;
@@ -157,23 +458,28 @@ int progName(sourceContainer* source){
 /*
  * name: decList
  *
+ * A declaration in error is skipped, and the list goes on after it.
+ *
  * Rule: <dec-list> ::= <dec> | { ; <dec> }
  *
  * @param	source	structure containing all parser information
  * @return	0 upon failure, 1 if successful
  */
 int decList(sourceContainer* source){
-	if(dec(source)){
-		source->currentToken = getToken(source->current, source->infile, source->hashTable);
-		while(source->currentToken.item.code == SEMICOLON){
-			if(!dec(source)){
-				return 0;
-			}
-			source->currentToken = getToken(source->current, source->infile, source->hashTable);
+	unsigned int first = source->tree.count;
+	unsigned long long position = source->currentToken.position;
+	int decs = 0;
+	RULE_SCOPE(source, SPS_DEC_LIST);
+	do{
+		if(dec(source)){
+			decs++;
+			nextToken(source);
 		}
-		return 1;
-	}
-	return 0;
+		else if(!recover(source, RESUME_DECLARATIONS)){
+			return 0;
+		}
+	} while(source->currentToken.code == SEMICOLON);
+	return addTree(source, NODE_DECLARATIONS, first, position, decs);
 }
 
 /*
@@ -185,14 +491,17 @@ int decList(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int dec(sourceContainer* source){
+	unsigned int first = source->tree.count;
+	RULE_SCOPE(source, SPS_DEC);
 	if(idList(source, 1)){
-		if(source->currentToken.item.code == COLON){
+		if(source->currentToken.code == COLON){
 			if(type(source)){
-				return 1;
+				return addTree(source, NODE_DECLARE, first,
+						firstNode(source, first, position), source->tree.count - first);
 			}
 		}
 		else{
-			err("Expected :", source->currentToken);
+			err(source, "Expected :");
 			return 0;
 		}
 	}
@@ -208,12 +517,13 @@ int dec(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int type(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if(source->currentToken.item.code == INTEGER){
+	RULE_SCOPE(source, SPS_TYPE);
+	nextToken(source);
+	if(source->currentToken.code == INTEGER){
 		return 1;
 	}
 	else{
-		err("Expected INTEGER", source->currentToken);
+		err(source, "Expected INTEGER");
 		return 0;
 	}
 	return 0;
@@ -228,8 +538,9 @@ int type(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int idList(sourceContainer* source, int buildMode){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if(source->currentToken.item.code == ID){
+	RULE_SCOPE(source, SPS_ID_LIST);
+	nextToken(source);
+	if(source->currentToken.code == ID){
 		if(buildMode){
 			//add to symbol table
 			if(!addId(source, 1)){
@@ -242,30 +553,37 @@ int idList(sourceContainer* source, int buildMode){
 				return 0;
 			}
 		}
-		source->currentToken = getToken(source->current, source->infile, source->hashTable);
-		while(source->currentToken.item.code == COMMA){
-			source->currentToken = getToken(source->current, source->infile, source->hashTable);
-			if(source->currentToken.item.code != ID){
-				return 1;
+		if(!addLeaf(source)){
+			return 0;
+		}
+		nextToken(source);
+		while(source->currentToken.code == COMMA){
+			nextToken(source);
+			if(source->currentToken.code != ID){
+				err(source, "Expected variable name");
+				return 0;
 			}
-			if(buildMode && source->currentToken.item.code == ID){
+			if(buildMode && source->currentToken.code == ID){
 				//add to symbol table
 				if(!addId(source, 1)){
 					return 0;
 				}
 			}
-			else if(source->currentToken.item.code == ID){
+			else if(source->currentToken.code == ID){
 				//look up in symbol table
 				if(!lookupId(source)){
 					return 0;
 				}
 			}
-			source->currentToken = getToken(source->current, source->infile, source->hashTable);
+			if(!addLeaf(source)){
+				return 0;
+			}
+			nextToken(source);
 		}
 		return 1;
 	}
 	else{
-		err("Expected variable name", source->currentToken);
+		err(source, "Expected variable name");
 		return 0;
 	}
 	return 0;
@@ -275,21 +593,33 @@ int idList(sourceContainer* source, int buildMode){
 /*
  * name: stmtList
  *
+ * A statement in error is skipped, and the list goes on after it.
+ *
  * Rule: <stmt-list> ::= <stmt> | { ; <stmt> }
  *
  * @param	source	structure containing all parser information
  * @return	0 upon failure, 1 if successful
  */
 int stmtList(sourceContainer* source){
-	if(stmt(source)){
-		while(source->currentToken.item.code == SEMICOLON){
-			if(!stmt(source)){
-				return 0;
-			}
+	unsigned int first = source->tree.count;
+	unsigned long long position = source->currentToken.position;
+	int stmts = 0, errors;
+	RULE_SCOPE(source, SPS_STMT_LIST);
+	do{
+		errors = source->errors;
+		if(stmt(source)){
+			stmts++;
+			continue;
 		}
-		return 1;
-	}
-	return 0;
+		// a block is the one thing stmt() fails on without saying why
+		if(source->errors == errors){
+			err(source, "Expected statement");
+		}
+		if(!recover(source, RESUME_STATEMENTS)){
+			return 0;
+		}
+	} while(source->currentToken.code == SEMICOLON);
+	return addTree(source, NODE_STATEMENTS, first, position, stmts);
 }
 
 /*
@@ -301,8 +631,9 @@ int stmtList(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int stmt(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	switch(source->currentToken.item.code){
+	RULE_SCOPE(source, SPS_STMT);
+	nextToken(source);
+	switch(source->currentToken.code){
 		case ID:
 			//look up in symbol table
 			if(!lookupId(source)){
@@ -310,33 +641,28 @@ int stmt(sourceContainer* source){
 			}
 			return assign(source);
 		case READ:
-			if(read(source)){
-				source->currentToken = getToken(source->current, source->infile, source->hashTable);
+			if(readStmt(source)){
+				nextToken(source);
 				return 1;
 			}
 			else{
 				return 0;
 			}
 		case WRITE:
-			if(write(source)){
-				source->currentToken = getToken(source->current, source->infile, source->hashTable);
+			if(writeStmt(source)){
+				nextToken(source);
 				return 1;
 			}
 			else{
 				return 0;
 			}
 		case FOR:
-			if(forStmt(source)){
-				source->currentToken = getToken(source->current, source->infile, source->hashTable);
-				return 1;
-			}
-			else{
-				return 0;
-			}
+			// the body already stops on the token after it
+			return forStmt(source);
 		case BEGIN:
 			return 0;
 		default:
-			err("Expected statement", source->currentToken);
+			err(source, "Expected statement");
 			return 0;
 	}
 }
@@ -350,14 +676,22 @@ int stmt(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int assign(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if(source->currentToken.item.code == COLONEQUALS){
+	unsigned int first = source->tree.count;
+	unsigned long long position = source->currentToken.position;
+	int target = source->currentToken.symbol;
+	RULE_SCOPE(source, SPS_ASSIGN);
+	// the variable assigned is the current token
+	if(!addLeaf(source)){
+		return 0;
+	}
+	nextToken(source);
+	if(source->currentToken.code == COLONEQUALS){
 		if(expression(source)){
-			return 1;
+			return addTree(source, NODE_ASSIGN, first, position, target);
 		}
 	}
 	else{
-		err("Expected :=", source->currentToken);
+		err(source, "Expected :=");
 		return 0;
 	}
 	return 0;
@@ -372,9 +706,15 @@ int assign(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int expression(sourceContainer* source){
+	unsigned int first = source->tree.count;
+	unsigned long long position;
+	int kind;
+	RULE_SCOPE(source, SPS_EXPRESSION);
 	if(term(source)){
-		while(source->currentToken.item.code == PLUS || source->currentToken.item.code == MINUS){
-			if(!term(source)){
+		while(source->currentToken.code == PLUS || source->currentToken.code == MINUS){
+			kind = source->currentToken.code == PLUS ? NODE_ADD : NODE_SUBTRACT;
+			position = source->currentToken.position;
+			if(!term(source) || !addTree(source, kind, first, position, 0)){
 				return 0;
 			}
 		}
@@ -392,13 +732,19 @@ int expression(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int term(sourceContainer* source){
+	unsigned int first = source->tree.count;
+	unsigned long long position;
+	int kind;
+	RULE_SCOPE(source, SPS_TERM);
 	if(factor(source)){
-		source->currentToken = getToken(source->current, source->infile, source->hashTable);
-		while(source->currentToken.item.code == ASTRIX || source->currentToken.item.code == DIV){
-			if(!factor(source)){
+		nextToken(source);
+		while(source->currentToken.code == ASTRIX || source->currentToken.code == DIV){
+			kind = source->currentToken.code == ASTRIX ? NODE_MULTIPLY : NODE_DIVIDE;
+			position = source->currentToken.position;
+			if(!factor(source) || !addTree(source, kind, first, position, 0)){
 				return 0;
 			}
-			source->currentToken = getToken(source->current, source->infile, source->hashTable);
+			nextToken(source);
 		}
 		return 1;
 	}
@@ -414,107 +760,131 @@ int term(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int factor(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	switch(source->currentToken.item.code){
+	unsigned int first = source->tree.count;
+	unsigned long long position;
+	int parsed, sign;
+	RULE_SCOPE(source, SPS_FACTOR);
+	nextToken(source);
+	switch(source->currentToken.code){
 		case PLUS:
 		case MINUS:
-			source->currentToken = getToken(source->current, source->infile, source->hashTable);
-			if(source->currentToken.item.code == ID){
+			// a sign only makes a node of its own when it negates
+			sign = source->currentToken.code;
+			position = source->currentToken.position;
+			nextToken(source);
+			if(source->currentToken.code == ID){
 				if(!lookupId(source)){
 					return 0;
 				}
-				else if(source->currentToken.error > 0){
-					err("Invalid identifier format", source->currentToken);
+				else if(source->currentToken.error != NO_ERROR){
+					err(source, "Invalid identifier format");
 					return 0;
 				}
-				return 1;
 			}
-			if(source->currentToken.item.code == INT){
-				if(source->currentToken.error > 0){
-					err("Invalid integer literal", source->currentToken);
+			else if(source->currentToken.code == INT){
+				if(source->currentToken.error != NO_ERROR){
+					err(source, "Invalid integer literal");
 					return 0;
 				}
-				return 1;
 			}
-
-			err("Expected identifier or literal", source->currentToken);
-			return 0;
+			else{
+				err(source, "Expected identifier or literal");
+				return 0;
+			}
+			if(!addLeaf(source)){
+				return 0;
+			}
+			return sign == PLUS || addTree(source, NODE_NEGATE, first, position, 0);
 		case ID:
 			// look up in symbol table
 			if(!lookupId(source)){
 				return 0;
 			}
-			return 1;
+			return addLeaf(source);
 		case INT:
-			if(source->currentToken.error > 0){
-				err("Invalid literal", source->currentToken);
+			if(source->currentToken.error != NO_ERROR){
+				err(source, "Invalid literal");
 				return 0;
 			}
-			return 1;
+			return addLeaf(source);
 		case LEFTPAREN:
-			if(expression(source)){
-				source->currentToken = getToken(source->current, source->infile, source->hashTable);
-				if(source->currentToken.item.code == RIGHTPAREN){
-					return 1;
-				}
+			// the expression stops on the token after it, which must close it
+			if(!nest(source)){
+				return 0;
+			}
+			parsed = expression(source);
+			source->depth--;
+			if(!parsed){
+				return 0;
 			}
+			if(source->currentToken.code == RIGHTPAREN){
+				return 1;
+			}
+			err(source, "Expected )");
+			return 0;
 		default:
-			err("Expected identifier, literal, or expression.", source->currentToken);
+			err(source, "Expected identifier, literal, or expression.");
 			return 0;
 	}
 }
 
 /*
- * name: read
+ * name: readStmt
  *
  * Rule: <read> ::= READ ( <id-list> )
  *
  * @param	source	structure containing all parser information
  * @return	0 upon failure, 1 if successful
  */
-int read(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if(source->currentToken.item.code == LEFTPAREN){
+int readStmt(sourceContainer* source){
+	unsigned int first = source->tree.count;
+	unsigned long long position = source->currentToken.position;
+	RULE_SCOPE(source, SPS_READ_STMT);
+	nextToken(source);
+	if(source->currentToken.code == LEFTPAREN){
 		if(idList(source, 0)){
-			if(source->currentToken.item.code == RIGHTPAREN){
-				return 1;
+			if(source->currentToken.code == RIGHTPAREN){
+				return addTree(source, NODE_READ, first, position, source->tree.count - first);
 			}
 			else{
-				err("Expected )", source->currentToken);
+				err(source, "Expected )");
 				return 0;
 			}
 		}
 	}
 	else{
-		err("Expected (", source->currentToken);
+		err(source, "Expected (");
 		return 0;
 	}
 	return 0;
 }
 
 /*
- * name: write
+ * name: writeStmt
  *
  * Rule: <write> ::= WRITE ( <id-list> )
  *
  * @param	source	structure containing all parser information
  * @return	0 upon failure, 1 if successful
  */
-int write(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if(source->currentToken.item.code == LEFTPAREN){
+int writeStmt(sourceContainer* source){
+	unsigned int first = source->tree.count;
+	unsigned long long position = source->currentToken.position;
+	RULE_SCOPE(source, SPS_WRITE_STMT);
+	nextToken(source);
+	if(source->currentToken.code == LEFTPAREN){
 		if(idList(source, 0)){
-			if(source->currentToken.item.code == RIGHTPAREN){
-				return 1;
+			if(source->currentToken.code == RIGHTPAREN){
+				return addTree(source, NODE_WRITE, first, position, source->tree.count - first);
 			}
 			else{
-				err("Expected )", source->currentToken);
+				err(source, "Expected )");
 				return 0;
 			}
 		}
 	}
 	else{
-		err("Expected (", source->currentToken);
+		err(source, "Expected (");
 		return 0;
 	}
 	return 0;
@@ -529,14 +899,23 @@ int write(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int forStmt(sourceContainer* source){
+	unsigned int first = source->tree.count;
+	unsigned long long position = source->currentToken.position;
+	int parsed;
+	RULE_SCOPE(source, SPS_FOR_STMT);
 	if(indexExp(source)){
-		if(source->currentToken.item.code == DO){
-			if(body(source)){
-				return 1;
+		if(source->currentToken.code == DO){
+			if(!nest(source)){
+				return 0;
 			}
+			parsed = body(source);
+			source->depth--;
+			// the index is the first node of the statement
+			return parsed && addTree(source, NODE_FOR, first, position,
+					firstNode(source, first, value));
 		}
 		else{
-			err("Expected DO", source->currentToken);
+			err(source, "Expected DO");
 			return 0;
 		}
 	}
@@ -553,31 +932,36 @@ int forStmt(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int indexExp(sourceContainer* source){
-	source->currentToken = getToken(source->current, source->infile, source->hashTable);
-	if(source->currentToken.item.code == ID){
+	RULE_SCOPE(source, SPS_INDEX_EXP);
+	nextToken(source);
+	if(source->currentToken.code == ID){
 		// look up in symbol table
-		if(!lookupId(source)){
+		if(!lookupId(source) || !addLeaf(source)){
 			return 0;
 		}
-		source->currentToken = getToken(source->current, source->infile, source->hashTable);
-		if(source->currentToken.item.code == COLONEQUALS){
+		nextToken(source);
+		if(source->currentToken.code == COLONEQUALS){
 			if(expression(source)){
-				if(source->currentToken.item.code == TO){
+				if(source->currentToken.code == TO){
 					if(expression(source)){
 						return 1;
 					}
 				}
 				else{
-					err("Expected TO", source->currentToken);
+					err(source, "Expected TO");
 					return 0;
 				}
 			}
 		}
 		else{
-			err("Expected :=", source->currentToken);
+			err(source, "Expected :=");
 			return 0;
 		}
 	}
+	else{
+		err(source, "Expected variable name");
+		return 0;
+	}
 	return 0;
 }
 	
@@ -590,25 +974,44 @@ int indexExp(sourceContainer* source){
  * @return	0 upon failure, 1 if successful
  */
 int body(sourceContainer* source){
+	int errors = source->errors;
+	RULE_SCOPE(source, SPS_BODY);
 	if(stmt(source)){
 		return 1;
 	}
-	else{
-		if(source->currentToken.item.code == BEGIN){
-			if(stmtList(source)){
-				if(source->currentToken.item.code == END){
-					return 1;
-				}
-				else{
-					err("Expected END", source->currentToken);
-					return 0;
-				}
+	// stmt() has already said why, unless it found a block
+	else if(source->errors == errors){
+		if(stmtList(source)){
+			if(source->currentToken.code == END){
+				nextToken(source);
+				return 1;
+			}
+			else{
+				err(source, "Expected END");
+				return 0;
 			}
-		}
-		else{
-			err("Expected BEGIN", source->currentToken);
-			return 0;
 		}
 	}
 	return 0;
 }
+
+/*
+ * name: parseProgram
+ *
+ * Parses a whole program with the session's engine, by recursive descent
+ * or from the tables generated from SPS.g.  A parse halted, which only
+ * happens when memory runs out, is told apart from a program in error.
+ *
+ * @param	source	structure containing all parser information
+ * @return	1 if the program parsed, 0 if not, -1 if out of memory
+ */
+int parseProgram(sourceContainer* source){
+	int parsed;
+	if(source->engine == ENGINE_TABLE){
+		parsed = llProg(source);
+	}
+	else{
+		parsed = prog(source);
+	}
+	return source->halted ? -1 : parsed;
+}
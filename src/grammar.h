@@ -10,19 +10,31 @@
 #define GRAMMAR_H
 
 #include "line.h"
+#include "source.h"
 #include "tokens.h"
+#include "hasher.h"
+#include "session.h"
 
-typedef struct {
-	superToken currentToken;
-	FILE* infile;
-	token* hashTable[HASH_TABLE_SIZE];
-	token* symbolTable[HASH_TABLE_SIZE];
-	line * current;
-} sourceContainer;
+// a field of the node a subtree starts at, 0 when no tree is kept
+#define firstNode(source, first, field) \
+	(treeKept(&(source)->tree) ? (source)->tree.nodes[first].field : 0)
 
-void err(char *, superToken);
+// the scanner has run out, and returns the same empty token from now on
+#define endOfTokens(source) ((source)->currentToken.length == 0)
+
+// where the parse goes on from after an error: the heading stops at VAR or
+// BEGIN as well as at ; END and END., the declarations at BEGIN, and the
+// statements parse any block they meet
+enum {RESUME_HEADING, RESUME_DECLARATIONS, RESUME_STATEMENTS};
+
+void err(sourceContainer*, const char *);
+void halt(sourceContainer*, const char *);
+void nextToken(sourceContainer*);
 int addId(sourceContainer*, int);
 int lookupId(sourceContainer*);
+int addTree(sourceContainer*, int, unsigned int, unsigned long long, int);
+int addLeaf(sourceContainer*);
+int parseProgram(sourceContainer*);
 
 int prog(sourceContainer*);
 int progName(sourceContainer*);
@@ -36,8 +48,8 @@ int assign(sourceContainer*);
 int expression(sourceContainer*);
 int term(sourceContainer*);
 int factor(sourceContainer*);
-int read(sourceContainer*);
-int write(sourceContainer*);
+int readStmt(sourceContainer*);
+int writeStmt(sourceContainer*);
 int forStmt(sourceContainer*);
 int indexExp(sourceContainer*);
 int body(sourceContainer*);
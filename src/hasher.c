@@ -3,7 +3,8 @@
  *
  * A hashing program which accepts as input a text file.  The program will read
  * the text file into a table and then hash the elements of the table into a
- * hash table for later use.
+ * hash table for later use.  The reserved words are hashed perfectly, which
+ * is normally done once at build time by hashgen.
  *
  * Input: A file containing the token string followed by a space followed by
  * 	the token id.
@@ -15,174 +16,598 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/random.h>
 
 #include "config.h"
 #include "tokens.h"
+#include "arena.h"
+#include "output.h"
 #include "hasher.h"
+#include "trace.h"
 
 /*
  *
  * name: printHash
  *
- * Prints the contents of the token* array passed to it.
+ * Prints the declared symbols held in the given table, in slot order.
  *
- * @param	hashes	pointer to the array of token hashes
+ * @param	table	the symbol table to print
+ * @param	output	the sink to print to
  */
-void printHash(token ** hashes){
+void printHash(symbolTable * table, outputSink * output){
+	symbol * entry;
 	int i;
 
-	printf("\tHash\tName\tType\n");
-	printf("\t----\t-----\t------------\n");
+	sinkPrintf(output, "\tHash\tName\tType\n");
+	sinkPrintf(output, "\t----\t-----\t------------\n");
 
-	for(i=0; i<HASH_TABLE_SIZE; i++){
-		if(hashes[i] == NULL){
-			printf("\t%d\n", i);
-		}
-		else{
-			printf("\t%d\t%s\t%d\n", i, hashes[i]->name, hashes[i]->code);
+	for(i=0; i<table->size; i++){
+		if(isUsed(table, i)){
+			entry = &table->symbols[table->slots[i].id];
+			if(entry->code != UNDECLARED){
+				sinkPrintf(output, "\t%d\t%.*s\t%d\n", i, entry->length,
+						symbolName(entry), entry->code);
+			}
 		}
 	}
 }
 
+/*
+ *
+ * name: foldName
+ *
+ * Converts the lower case letters of a packed name to upper case, all eight
+ * characters at once.  Every character is first cut to seven bits so adding
+ * to it cannot carry into the next, then the top bit of each sum tells
+ * whether it lies from 'a' to 'z'.
+ *
+ * @param	key	the packed name
+ * @return	the packed name in upper case
+ */
+static unsigned long long foldName(unsigned long long key){
+	const unsigned long long ones = 0x0101010101010101ULL;
+	unsigned long long low = key & (ones * 0x7f);
+	unsigned long long fromA = low + ones * (0x80 - 'a');
+	unsigned long long pastZ = low + ones * (0x80 - 'z' - 1);
+	unsigned long long lower = fromA & ~pastZ & ~key & (ones * 0x80);
+	return key ^ (lower >> 2);
+}
+
+// the seed every table starts with, so slots are the same from run to run
+#define HASH_SEED 0x9E3779B97F4A7C15ULL
+
+// mixes one packed word of a name into its hash
+#define mixWord(sum, word) ((sum) = ((sum) ^ (word)) * 0xff51afd7ed558ccdULL, \
+	(sum) ^= (sum) >> 32)
+
+/*
+ *
+ * name: seededName
+ *
+ * Hashes a name from the given seed.  The name is taken eight characters at
+ * a time as an integer in upper case, and each is mixed into the result with
+ * a multiply and a shift.
+ *
+ * @param	sum	the seed
+ * @param	text	the name to be hashed, in any case
+ * @param	length	the length of the name
+ * @return	the full hash, which tables reduce to a slot themselves
+ */
+static unsigned int seededName(unsigned long long sum, const char * text, int length){
+	int n;
+
+	while(length > 0){
+		n = length < 8 ? length : 8;
+		mixWord(sum, foldName(packName(text, n)));
+		text += n;
+		length -= n;
+	}
+	return (unsigned int)sum;
+}
+
+/*
+ *
+ * name: seededWords
+ *
+ * Hashes a short name already packed into two words, just as seededName()
+ * would hash its text.
+ *
+ * @param	sum	the seed
+ * @param	words	the packed name, in upper case
+ * @param	length	the length of the name, at most SHORT_NAME
+ * @return	the full hash of the name
+ */
+static unsigned int seededWords(unsigned long long sum, const unsigned long long * words,
+		int length){
+	if(length > 0){
+		mixWord(sum, words[0]);
+	}
+	if(length > 8){
+		mixWord(sum, words[1]);
+	}
+	return (unsigned int)sum;
+}
+
+/*
+ *
+ * name: hashName
+ *
+ * The hashing method used to determine the position of a name in a table,
+ * from the seed every table starts with.
+ *
+ * @param	text	the name to be hashed, in any case
+ * @param	length	the length of the name
+ * @return	the full hash, which tables reduce to a slot themselves
+ */
+unsigned int hashName(const char * text, int length){
+	return seededName(HASH_SEED, text, length);
+}
+
+/*
+ *
+ * name: shortKey
+ *
+ * Packs a short name into the two words it is kept in, in upper case and
+ * padded with zeros, and hashes it just as seededName() would.
+ *
+ * @param	words	the two words to fill
+ * @param	text	the name, in any case
+ * @param	length	the length of the name, at most SHORT_NAME
+ * @param	seed	the seed of the table
+ * @return	the full hash of the name
+ */
+static unsigned int shortKey(unsigned long long * words, const char * text, int length,
+		unsigned long long seed){
+	words[0] = foldName(packName(text, length < 8 ? length : 8));
+	words[1] = length > 8 ? foldName(packName(text + 8, length - 8)) : 0;
+	return seededWords(seed, words, length);
+}
+
+/*
+ *
+ * name: sameLongName
+ *
+ * Compares a long name from the source with one held in upper case by the
+ * symbol table, eight characters at a time.
+ *
+ * @param	held	the upper case name in the table
+ * @param	text	the name from the source, in any case
+ * @param	length	the length of both names
+ * @return	1 if they are the same name, 0 otherwise
+ */
+static int sameLongName(const char * held, const char * text, int length){
+	int n;
+
+	while(length > 0){
+		n = length < 8 ? length : 8;
+		if(packName(held, n) != foldName(packName(text, n))){
+			return 0;
+		}
+		held += n;
+		text += n;
+		length -= n;
+	}
+	return 1;
+}
 
 /*
  *
- * name: hash
+ * name: findSlot
  *
- * The hashing method used to determine the position of the token in the table.
- * Uses a simple scheme of summing each character's ASCII value and considers
- * the rest of the string as being padded with spaces.
+ * Finds the slot holding the given name, or the empty slot where it would
+ * go.  Names are only compared when their cached hashes match, and short
+ * names are compared as two words.
  *
- * @param	token	the token to be hashed
- * @return	position in table of token
+ * @param	table	the symbol table to search
+ * @param	text	the name, in any case
+ * @param	length	the length of the name
+ * @param	words	the packed name if it is short
+ * @param	full	the full hash of the name
+ * @return	the slot found
  */
-int hash(char * string){
-	int i,sum=0;
+static int findSlot(symbolTable * table, const char * text, int length,
+		const unsigned long long * words, unsigned int full){
+	int slot = full & (table->size - 1);
+	symbol * entry;
 
-	for(i=0;i<MAX_TOKEN_LEN;i++){
-		if(string[i] == '\0'){
-			// When we reach the end of the string read, we add
-			// the remaining characters as if they were padded
-			// spaces.
-	  		sum = sum + (MAX_TOKEN_LEN-i)*(int)' ';
-			return sum % HASH_TABLE_SIZE;
+	while(isUsed(table, slot)){
+		if(table->slots[slot].hash == full){
+			entry = &table->symbols[table->slots[slot].id];
+			if(entry->length == length && (length <= SHORT_NAME ?
+					entry->name.words[0] == words[0] && entry->name.words[1] == words[1] :
+					sameLongName(entry->name.text, text, length))){
+				TRACE_PROBES((slot - full) & (table->size - 1));
+				return slot;
+			}
 		}
-		sum = sum + (int)(string[i]);
+		slot = (slot + 1) & (table->size - 1);
 	}
-	return sum % HASH_TABLE_SIZE;
+	TRACE_PROBES((slot - full) & (table->size - 1));
+	return slot;
 }
 
 /*
  *
- * name: getHash
+ * name: initSymbols
  *
- * Will return the location of the given word in the given hashTable.  This
- * takes into account a possible collision and ensures the correct value is
- * matched before returning the location.
+ * Prepares an empty symbol table of HASH_TABLE_SIZE slots.  All of its
+ * memory comes from the given arena, and is released when that is reset.
  *
- * @param	hashTable	the built hash table to look up
- * @param	word	the word to hash and search for
- * @return	the location of the word in the hash table, -1 if it DNE
+ * @param	table	the symbol table to prepare
+ * @param	memory	the arena to allocate from
+ * @return	1 if successful, 0 if out of memory
  */
-int getHash(token ** hashTable, char * word){
-	int attemptsLeft = HASH_TABLE_SIZE;
-	int hashVal = hash(word);
-	if(hashTable[hashVal] == NULL){
-		return -1;
+int initSymbols(symbolTable * table, arena * memory){
+	table->memory = memory;
+	table->size = HASH_TABLE_SIZE;
+	table->count = 0;
+	table->capacity = HASH_TABLE_SIZE;
+	table->seed = HASH_SEED;
+	table->probes = 0;
+	table->slots = arenaAlloc(memory, table->size * sizeof(bucket));
+	table->used = arenaCalloc(memory, usedWords(table->size) * sizeof(unsigned long long));
+	table->symbols = arenaAlloc(memory, table->capacity * sizeof(symbol));
+	return table->slots != NULL && table->used != NULL && table->symbols != NULL;
+}
+
+/*
+ *
+ * name: growSymbols
+ *
+ * Doubles the number of slots in the given symbol table.  The cached hashes
+ * are used to place the symbols again, so no names are hashed.  The old
+ * slots are left in the arena until it is reset.
+ *
+ * @param	table	the symbol table to grow
+ * @return	1 if successful, 0 if out of memory
+ */
+static int growSymbols(symbolTable * table){
+	symbolTable bigger;
+	int i, slot;
+
+	bigger.size = table->size * 2;
+	bigger.slots = arenaAlloc(table->memory, bigger.size * sizeof(bucket));
+	bigger.used = arenaCalloc(table->memory,
+			usedWords(bigger.size) * sizeof(unsigned long long));
+	if(bigger.slots == NULL || bigger.used == NULL){
+		return 0;
 	}
-	else{
-		while(strcmp(hashTable[hashVal]->name, word) != 0 && attemptsLeft){
-			hashVal = (hashVal+1) % HASH_TABLE_SIZE;
-			if(hashTable[hashVal] == NULL){
-				return -1;
+
+	for(i=0; i<table->size; i++){
+		if(isUsed(table, i)){
+			slot = table->slots[i].hash & (bigger.size - 1);
+			while(isUsed(&bigger, slot)){
+				slot = (slot + 1) & (bigger.size - 1);
 			}
-			attemptsLeft--;
+			bigger.slots[slot] = table->slots[i];
+			setUsed(&bigger, slot);
 		}
-		if(!attemptsLeft){
-			return -1;
+	}
+	table->slots = bigger.slots;
+	table->used = bigger.used;
+	table->size = bigger.size;
+	return 1;
+}
+
+/*
+ *
+ * name: reseedSymbols
+ *
+ * Hashes every symbol again from a random seed, into new slots of the same
+ * number.  This is done once, when names pile up in the same slots far more
+ * than chance allows, as names made to collide under the first seed would.
+ * The names are hashed from the symbols, which hold them in upper case.
+ * The old slots are left in the arena until it is reset.
+ *
+ * @param	table	the symbol table to hash again
+ * @return	1 if successful, 0 if out of memory
+ */
+static int reseedSymbols(symbolTable * table){
+	bucket * slots = arenaAlloc(table->memory, table->size * sizeof(bucket));
+	unsigned long long * used = arenaCalloc(table->memory,
+			usedWords(table->size) * sizeof(unsigned long long));
+	symbol * entry;
+	unsigned long long seed;
+	unsigned int full;
+	int id, slot;
+
+	if(slots == NULL || used == NULL){
+		return 0;
+	}
+	if(getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)){
+		seed = (unsigned long long)time(NULL) * HASH_SEED ^ (unsigned long long)(size_t)slots;
+	}
+	table->seed = seed | 1;
+	table->slots = slots;
+	table->used = used;
+	table->probes = 0;
+
+	for(id=0; id<table->count; id++){
+		entry = &table->symbols[id];
+		if(entry->length <= SHORT_NAME){
+			full = seededWords(table->seed, entry->name.words, entry->length);
+		}
+		else{
+			full = seededName(table->seed, entry->name.text, entry->length);
 		}
+		slot = full & (table->size - 1);
+		while(isUsed(table, slot)){
+			slot = (slot + 1) & (table->size - 1);
+		}
+		table->slots[slot].hash = full;
+		table->slots[slot].id = id;
+		setUsed(table, slot);
 	}
-	return hashVal;
+	return 1;
 }
 
 /*
  *
- * name: insertHash
+ * name: getHash
  *
- * Will locate a free position for the (word, code) in the given hashTable,
- * otherwise will return 0 if already in the table and -1 if the table is full.
+ * Will return the id of the given name in the given table.  This takes into
+ * account a possible collision and ensures the correct value is matched
+ * before returning.
  *
- * @param	hashTable	the built hash table to look up
- * @param	word	the word to hash and search for
- * @param	code	the type code to associate with the word
- * @return	1 upon successful insert, 0 on failure, and -1 on full 
+ * @param	table	the symbol table to look up
+ * @param	text	the name to search for, in any case
+ * @param	length	the length of the name
+ * @return	the id of the name in the table, -1 if it DNE
  */
-int insertHash(token ** hashTable, char * word, int code){
-	int attemptsLeft = HASH_TABLE_SIZE;
-	int hashVal = hash(word);
-	token * newToken = malloc(sizeof(token));
-	newToken->code = code;
-	strncpy(newToken->name, word, MAX_TOKEN_LEN);
-	if(hashTable[hashVal] == NULL){
-		hashTable[hashVal] = newToken;
-		return 1;
+int getHash(symbolTable * table, const char * text, int length){
+	unsigned long long words[2];
+	unsigned int full;
+	int slot;
+
+	if(length <= SHORT_NAME){
+		full = shortKey(words, text, length, table->seed);
 	}
 	else{
-		while(strcmp(hashTable[hashVal]->name, word) != 0 && attemptsLeft){
-			hashVal = (hashVal+1) % HASH_TABLE_SIZE;
-			if(hashTable[hashVal] == NULL){
-				hashTable[hashVal] = newToken;
-				return 1;
-			}
-			attemptsLeft--;
+		full = seededName(table->seed, text, length);
+	}
+	slot = findSlot(table, text, length, words, full);
+	return isUsed(table, slot) ? table->slots[slot].id : -1;
+}
+
+/*
+ *
+ * name: internName
+ *
+ * Will return the id of the given word in the given table, adding it as an
+ * undeclared symbol if it is not there yet.  Ids are handed out in order, so
+ * they can index arrays of per symbol information directly.  The table is
+ * grown before it becomes three quarters full, and hashed again with a
+ * random seed if its insertions have probed more than PROBE_BUDGET slots a
+ * symbol.
+ *
+ * Names of up to SHORT_NAME characters are kept within the symbol itself,
+ * and longer ones are copied into the arena once, in upper case.
+ *
+ * @param	table	the symbol table to insert into
+ * @param	text	the name to insert, read straight from the source in any
+ * 	case
+ * @param	length	the length of the name
+ * @return	the id of the name, -1 if out of memory
+ */
+int internName(symbolTable * table, const char * text, int length){
+	unsigned long long words[2];
+	unsigned int full;
+	int slot, i;
+	symbol * entry;
+	TRACE_SCOPE(TRACE_INTERN);
+
+	if(length <= SHORT_NAME){
+		full = shortKey(words, text, length, table->seed);
+	}
+	else{
+		full = seededName(table->seed, text, length);
+	}
+	slot = findSlot(table, text, length, words, full);
+	if(isUsed(table, slot)){
+		return table->slots[slot].id;
+	}
+
+	// names made to collide are spread out by a seed they were not made for
+	table->probes += (slot - full) & (table->size - 1);
+	if(table->probes > PROBE_BUDGET * (long)table->count + HASH_TABLE_SIZE &&
+			table->seed == HASH_SEED){
+		if(!reseedSymbols(table)){
+			return -1;
+		}
+		if(length <= SHORT_NAME){
+			full = seededWords(table->seed, words, length);
 		}
-		if(!attemptsLeft){
-			// table full
+		else{
+			full = seededName(table->seed, text, length);
+		}
+		slot = findSlot(table, text, length, words, full);
+	}
+
+	if(table->count == table->capacity){
+		entry = arenaAlloc(table->memory, table->capacity * 2 * sizeof(symbol));
+		if(entry == NULL){
 			return -1;
 		}
+		memcpy(entry, table->symbols, table->count * sizeof(symbol));
+		table->symbols = entry;
+		table->capacity *= 2;
 	}
-	return 0;
+	if((table->count + 1) * 4 > table->size * 3){
+		if(!growSymbols(table)){
+			return -1;
+		}
+		slot = full & (table->size - 1);
+		while(isUsed(table, slot)){
+			slot = (slot + 1) & (table->size - 1);
+		}
+	}
+
+	entry = &table->symbols[table->count];
+	entry->code = UNDECLARED;
+	entry->length = length;
+	if(length <= SHORT_NAME){
+		entry->name.words[0] = words[0];
+		entry->name.words[1] = words[1];
+	}
+	else{
+		entry->name.text = arenaAlloc(table->memory, length + 1);
+		if(entry->name.text == NULL){
+			return -1;
+		}
+		for(i=0;i<length;i++){
+			entry->name.text[i] = toupper((unsigned char)text[i]);
+		}
+		entry->name.text[length] = '\0';
+	}
+	table->slots[slot].hash = full;
+	table->slots[slot].id = table->count;
+	setUsed(table, slot);
+	TRACE_COUNT(COUNT_SYMBOLS, 1);
+	return table->count++;
 }
 
 /*
  *
- * name: buildHashes
+ * name: packName
  *
- * Generates the hash table from the given tokens using the hash() routine.
- * If a collision is detected, then linear probing is used.
+ * Packs up to eight characters of a name into a single integer, so reserved
+ * words and the pieces of names can be compared in one step.
  *
- * @param	hashTable	pointer to the hash table to be filled
- * @param	tokens		pointer to the token table to hash from
+ * @param	name	the name to pack
+ * @param	length	the length of the name
+ * @return	the packed name
  */
-void buildHashes(token ** hashTable, token * tokens){
+unsigned long long packName(const char * name, int length){
+	unsigned long long key = 0;
 	int i;
-	for(i=0;i<MAX_TOKENS;i++){
-		insertHash(hashTable, tokens[i].name, tokens[i].code);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if(length == 8){
+		memcpy(&key, name, 8);
+		return key;
+	}
+#endif
+	for(i=0;i<length;i++){
+		key |= (unsigned long long)(unsigned char)name[i] << (8*i);
+	}
+	return key;
+}
+
+/*
+ *
+ * name: findKeyword
+ *
+ * Looks up a name in the reserved words.  As the hash is perfect, only the
+ * one slot the name hashes to needs to be checked.  The name is read
+ * straight from the source in any case.
+ *
+ * @param	keywords	the reserved word table
+ * @param	name	the name to look up
+ * @param	length	the length of the name
+ * @return	the code of the reserved word, -1 if it is not one
+ */
+int findKeyword(const keywordTable * keywords, const char * name, int length){
+	unsigned long long key;
+	const keyword * slot;
+
+	if(length > MAX_TOKEN_LEN){
+		return -1;
+	}
+	key = foldName(packName(name, length));
+	slot = &keywords->slots[(key * keywords->seed) >> keywords->shift];
+	if(slot->key == key && slot->code != 0){
+		return slot->code;
 	}
+	return -1;
 }
 
+/*
+ *
+ * name: buildKeywords
+ *
+ * Searches for a seed which hashes every given token to its own slot, trying
+ * the smallest tables first.  This is run by hashgen at build time for the
+ * default tokens, and at run time only for a custom token file.
+ *
+ * @param	keywords	the reserved word table to fill
+ * @param	tokens	the token table to hash from
+ * @param	count	the number of tokens
+ * @return	1 if a perfect hash was found, 0 otherwise
+ */
+int buildKeywords(keywordTable * keywords, reserved * tokens, int count){
+	unsigned long long state = 0x9E3779B97F4A7C15ULL;
+	unsigned long long key;
+	int size, bits, tries, i, slot;
+
+	for(bits=5, size=32; size <= MAX_KEYWORD_SLOTS; bits++, size*=2){
+		for(tries=0; tries < 100000; tries++){
+			// xorshift for the next seed to try, which must be odd
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			keywords->seed = state | 1;
+			keywords->shift = 64 - bits;
+			memset(keywords->slots, 0, sizeof(keywords->slots));
+			for(i=0;i<count;i++){
+				key = packName(tokens[i].name, strlen(tokens[i].name));
+				slot = (key * keywords->seed) >> keywords->shift;
+				if(keywords->slots[slot].code != 0){
+					break;
+				}
+				keywords->slots[slot].key = key;
+				keywords->slots[slot].code = tokens[i].code;
+			}
+			if(i == count){
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// a word of a token file is read at most MAX_TOKEN_LEN characters at a time
+#define FORMAT_WIDTH(width) #width
+#define TOKEN_FORMAT(width) "%" FORMAT_WIDTH(width) "s %d"
+
 /*
  *
  * name: readTokens
  *
- * Opens the input parameter and reads contents into the token table.
+ * Opens the input parameter and reads contents into the token table, up to
+ * MAX_TOKENS of them.  The words are folded to upper case, as the scanner
+ * looks them up.  A file with a word too long, or a line without its code,
+ * is rejected.
  *
  * @param	tokens	the token table to be read into
  * @param	input	the file name string
+ * @return	the number of tokens read
  */
-void readTokens(token * tokens, char * input){
+int readTokens(reserved * tokens, char * input){
 	FILE* infile;
-	int i;
+	int i, read;
+	char * c;
 
 	infile = fopen(input, "r");
-	if(infile != NULL){
-		for(i=0;i<MAX_TOKENS;i++){
-			fscanf(infile, "%s %d", tokens[i].name,	&tokens[i].code);
-		}
-		fclose(infile);
-	}
-	else{
+	if(infile == NULL){
 		printf("\n\nCould not open token file!\n");
 		exit(1);
 	}
+	for(i=0;i<MAX_TOKENS;i++){
+		read = fscanf(infile, TOKEN_FORMAT(MAX_TOKEN_LEN), tokens[i].name,
+				&tokens[i].code);
+		if(read == EOF){
+			break;
+		}
+		if(read != 2 || tokens[i].code < 1 || tokens[i].code > 255){
+			fclose(infile);
+			printf("\n\nToken file is malformed at entry %d!\n", i + 1);
+			exit(1);
+		}
+		for(c = tokens[i].name; *c != '\0'; c++){
+			*c = toupper((unsigned char)*c);
+		}
+	}
+	fclose(infile);
+	return i;
 }
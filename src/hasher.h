@@ -7,12 +7,78 @@
 #define hasher_h
 
 #include "tokens.h"
+#include "arena.h"
+#include "output.h"
 
-void readTokens(token *, char *);
-int hash(char *);
-int getHash(token **, char *);
-int insertHash(token **, char *, int);
-void buildHashes(token **, token *);
-void printHash(token **);
+// a reserved word, packed into a single integer for comparison
+typedef struct{
+	unsigned long long key;
+	int code;
+} keyword;
+
+// a perfect hash of the reserved words, slot = (key * seed) >> shift
+typedef struct{
+	unsigned long long seed;
+	int shift;
+	keyword slots[MAX_KEYWORD_SLOTS];
+} keywordTable;
+
+// a symbol's code until it has been declared
+#define UNDECLARED -1
+
+// a symbol, which is found by its id.  Names of up to SHORT_NAME characters
+// are kept in upper case within the symbol, padded with zeros so they can be
+// compared as two words, and longer names are kept in the arena.
+typedef struct{
+	int code;
+	int length;
+	union{
+		char inside[SHORT_NAME];
+		unsigned long long words[2];
+		char * text;
+	} name;
+} symbol;
+
+#define symbolName(entry) ((entry)->length <= SHORT_NAME ? \
+	(entry)->name.inside : (entry)->name.text)
+
+// a slot of the symbol table, with the full hash kept beside the symbol's id
+typedef struct{
+	unsigned int hash;
+	int id;
+} bucket;
+
+// an open addressing table of symbols which grows as needed.  Whether a slot
+// is in use is kept in its own bitmap, so probing reads few cache lines, and
+// the symbols themselves are kept in order of their ids.  The slots probed
+// by insertions are counted, and if names pile up in the same slots far
+// more than chance allows the table is hashed again with a random seed.
+typedef struct{
+	bucket * slots;
+	unsigned long long * used;
+	int size;
+	symbol * symbols;
+	int count;
+	int capacity;
+	arena * memory;
+	unsigned long long seed;
+	long probes;
+} symbolTable;
+
+#define usedWords(size) (((size) + 63) / 64)
+#define isUsed(table, slot) (((table)->used[(slot) >> 6] >> ((slot) & 63)) & 1)
+#define setUsed(table, slot) ((table)->used[(slot) >> 6] |= 1ULL << ((slot) & 63))
+
+extern const keywordTable defaultKeywords;
+
+int readTokens(reserved *, char *);
+unsigned int hashName(const char *, int);
+int initSymbols(symbolTable *, arena *);
+int getHash(symbolTable *, const char *, int);
+int internName(symbolTable *, const char *, int);
+unsigned long long packName(const char *, int);
+int findKeyword(const keywordTable *, const char *, int);
+int buildKeywords(keywordTable *, reserved *, int);
+void printHash(symbolTable *, outputSink *);
 
 #endif
@@ -0,0 +1,48 @@
+/*
+ *      hashgen.c
+ *
+ * Generates the perfect hash of the reserved words, so the parser needs no
+ * token file at run time.
+ *
+ * Input: A file containing the token string followed by a space followed by
+ * 	the token id.
+ *
+ * Output: the C source of the reserved word table, which the makefile writes
+ * 	to keytab.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "hasher.h"
+
+int main(int argc, char** argv){
+	reserved tokenList[MAX_TOKENS];
+	keywordTable keywords;
+	int i, count;
+
+	if(argc != 2){
+		fprintf(stderr, "usage: %s tokens\n", argv[0]);
+		return 1;
+	}
+	count = readTokens(tokenList, argv[1]);
+	if(!buildKeywords(&keywords, tokenList, count)){
+		fprintf(stderr, "No perfect hash found for %s\n", argv[1]);
+		return 1;
+	}
+
+	printf("/*\n *      keytab.c\n *\n * Generated by hashgen from %s, do not edit.\n */\n\n", argv[1]);
+	printf("#include \"config.h\"\n#include \"tokens.h\"\n#include \"hasher.h\"\n\n");
+	printf("const keywordTable defaultKeywords = {\n");
+	printf("\t0x%llxULL, %d, {\n", keywords.seed, keywords.shift);
+	for(i=0;i < (1 << (64 - keywords.shift));i++){
+		if(keywords.slots[i].code != 0){
+			printf("\t\t[%d] = {0x%llxULL, %d},\n", i, keywords.slots[i].key,
+					keywords.slots[i].code);
+		}
+	}
+	printf("\t}\n};\n");
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ *      lexbench.c
+ *
+ * A microbenchmark for the scanner.  The table driven buildToken() is timed
+ * against the branching scanner it replaced, which is kept here as a
+ * reference, over the lines of the same source.
+ *
+ * Input: A file containing a program source written in SPS, and optionally
+ * 	the number of passes to make over it.
+ *
+ * Output: The tokens found and bytes per second of each scanner.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "source.h"
+#include "line.h"
+#include "lexer.h"
+#include "builders.h"
+
+/*
+ *
+ * name: isstopper
+ *
+ * Checks if the given character is a stopper.
+ *
+ * @param	character	the character to check
+ * @return	true if the character is a stopper, false otherwise.
+ */
+static int isstopper(char character){
+	if(isspace((unsigned char)character)){
+		return 1;
+	}
+	switch(character){
+		case ':':
+		case ';':
+		case '(':
+		case ')':
+		case ',':
+		case '+':
+		case '-':
+		case '*':
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ *
+ * name: skipWhitespace
+ *
+ * Skips all of the whitespace from the scanIndex in the given line.
+ *
+ * @param	current	the line for whitespace to be skipped
+ */
+static void skipWhitespace(line * current){
+	int i;
+	for(i=current->scanIndex; i < current->length; i++){
+		if(!isspace((unsigned char)current->line[i])){
+			break;
+		}
+	}
+	current->scanIndex=i;
+}
+
+/*
+ *
+ * name: skipComment
+ *
+ * Skips the text on the given line until the end of comment characters.
+ *
+ * @param	current	the line to have comments skipped on
+ * @return	0 if unfinished, 1 if end of comment found
+ */
+static int skipComment(line * current){
+	int i;
+	for(i=current->scanIndex; i+1 < current->length; i++){
+		if(current->line[i] == '*' && current->line[i+1] == ')'){
+			current->scanIndex = i + 2;
+			return 1;
+		}
+	}
+	current->scanIndex = current->length;
+	return 0;
+}
+
+/*
+ *
+ * name: legacyToken
+ *
+ * The branching scanner which buildToken() replaced.  Comments are skipped
+ * here rather than by the caller.
+ *
+ * @param	where	the span to contain the location of the read token
+ * @param	current	the line to be read from
+ * @return	1 if a token was found, 0 if the line ran out first
+ */
+static int legacyToken(span * where, line * current){
+	int i;
+
+	while(1){
+		if(current->lexState == S_COMMENT){
+			if(!skipComment(current)){
+				return 0;
+			}
+			current->lexState = S_START;
+		}
+		skipWhitespace(current);
+		i = current->scanIndex;
+		where->offset = current->offset + i;
+		if(i >= current->length){
+			return 0;
+		}
+		if(current->line[i] == '(' && lineChar(current, i+1) == '*'){
+			current->scanIndex = i + 2;
+			current->lexState = S_COMMENT;
+			continue;
+		}
+		if(current->line[i] == ':' && lineChar(current, i+1) == '='){
+			where->length = 2;
+			current->scanIndex = i + 2;
+			return 1;
+		}
+		if(isstopper(current->line[i])){
+			where->length = 1;
+			current->scanIndex = i + 1;
+			return 1;
+		}
+		for(; i < current->length && !isstopper(current->line[i]); i++);
+		where->length = i - current->scanIndex;
+		current->scanIndex = i;
+		return 1;
+	}
+}
+
+/*
+ *
+ * name: scan
+ *
+ * Runs one of the scanners over every line of the source.
+ *
+ * @param	source	the source to scan
+ * @param	table	true for buildToken(), false for the reference scanner
+ * @return	the number of tokens found
+ */
+static long scan(sourceBuffer * source, int table){
+	line current;
+	span where;
+	long tokens = 0;
+
+	current.source = source;
+	current.offset = 0;
+	current.length = 0;
+	current.lexState = S_START;
+	while((current.length = nextLine(source, current.offset)) > 0){
+		current.line = sourceText(source, current.offset);
+		current.scanIndex = 0;
+		if(table){
+			while(buildToken(&where, &current)){
+				tokens++;
+			}
+		}
+		else{
+			while(legacyToken(&where, &current)){
+				tokens++;
+			}
+		}
+		current.offset += current.length;
+	}
+	return tokens;
+}
+
+/*
+ *
+ * name: seconds
+ *
+ * @return	the current monotonic time in seconds
+ */
+static double seconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ *
+ * name: main
+ *
+ * Times both scanners over the named file.
+ *
+ * @param	argc	the number of arguments passed (including the program)
+ * @param	argv	the argument array of the program call
+ * @return	error code
+ */
+int main(int argc, char** argv){
+	sourceBuffer source;
+	const char * names[2] = {"reference", "table"};
+	long tokens[2];
+	double elapsed;
+	int passes = 20;
+	int i, t;
+
+	if(argc < 2){
+		printf("usage: %s file [passes]\n", argv[0]);
+		return 1;
+	}
+	if(argc > 2){
+		passes = atoi(argv[2]);
+	}
+	if(!openSource(&source, argv[1]) || !source.mapped){
+		printf("Could not map input file!\n");
+		return 1;
+	}
+
+	for(t=0;t<2;t++){
+		// warm up the page cache and tables first
+		scan(&source, t);
+		elapsed = seconds();
+		for(i=0;i<passes;i++){
+			tokens[t] = scan(&source, t);
+		}
+		elapsed = seconds() - elapsed;
+		printf("%-10s %10ld tokens %10.1f MB/s\n", names[t], tokens[t],
+				source.length * (double)passes / elapsed / 1e6);
+	}
+	closeSource(&source);
+
+	if(tokens[0] != tokens[1]){
+		printf("Token counts differ!\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,26 @@
+/*
+ *      lexer.h
+ *
+ * This file contains the character classes and states of the table driven
+ * scanner.  The tables themselves are generated by lexgen into lextab.c.
+ *
+ */
+
+#ifndef lexer_h
+#define lexer_h
+
+// the character classes, C_EOL is fed once at the end of every line
+enum {C_OTHER, C_SPACE, C_ALPHA, C_DIGIT, C_COLON, C_EQUAL, C_LPAREN,
+	C_STAR, C_RPAREN, C_SINGLE, C_EOL, LEX_CLASSES};
+
+// the scanning states, every state from LEX_ACCEPT on ends a token
+enum {S_START, S_COMMENT, S_STAR, S_IDENT, S_WORD, S_INT, S_BADINT,
+	S_COLON, S_LPAREN, LEX_ACCEPT,
+	A_IDENT = LEX_ACCEPT, A_WORD, A_INT, A_BADINT, A_SHORT, A_SYMBOL,
+	LEX_STATES};
+
+extern const unsigned char charClass[256];
+extern const unsigned char lexTable[LEX_ACCEPT][256];
+extern const unsigned char lexEnd[LEX_ACCEPT];
+
+#endif
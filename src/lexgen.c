@@ -0,0 +1,175 @@
+/*
+ *      lexgen.c
+ *
+ * Generates the tables for the table driven scanner.  The DFA is described
+ * below over character classes, and then flattened so the scanner needs a
+ * single lookup of lexTable[state][byte] for every byte of input.
+ *
+ * Output: the C source of the tables, which the makefile writes to lextab.c
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+
+#include "lexer.h"
+
+unsigned char classes[256];
+unsigned char moves[LEX_ACCEPT][LEX_CLASSES];
+
+/*
+ *
+ * name: buildClasses
+ *
+ * Sorts every byte into its character class.  The stoppers of the language
+ * are whitespace and : ; ( ) , + - *
+ */
+void buildClasses(){
+	int c;
+	for(c=0;c<256;c++){
+		if(isspace(c)){
+			classes[c] = C_SPACE;
+		}
+		else if(isalpha(c)){
+			classes[c] = C_ALPHA;
+		}
+		else if(isdigit(c)){
+			classes[c] = C_DIGIT;
+		}
+		else{
+			classes[c] = C_OTHER;
+		}
+	}
+	classes[':'] = C_COLON;
+	classes['='] = C_EQUAL;
+	classes['('] = C_LPAREN;
+	classes['*'] = C_STAR;
+	classes[')'] = C_RPAREN;
+	classes[';'] = C_SINGLE;
+	classes[','] = C_SINGLE;
+	classes['+'] = C_SINGLE;
+	classes['-'] = C_SINGLE;
+}
+
+/*
+ *
+ * name: isstopper
+ *
+ * Checks if the given class ends a word or integer.
+ *
+ * @param	class	the character class to check
+ * @return	true if the class is a stopper, false otherwise.
+ */
+int isstopper(int class){
+	return class != C_ALPHA && class != C_DIGIT && class != C_EQUAL &&
+		class != C_OTHER;
+}
+
+/*
+ *
+ * name: buildMoves
+ *
+ * Fills in the DFA over character classes.  Words and integers run until a
+ * stopper, which is left for the next token.  Words which are not valid
+ * variables and integers with other characters in them are still tokens,
+ * but end in their own accepting states so they can be reported.
+ */
+void buildMoves(){
+	int c;
+	for(c=0;c<LEX_CLASSES;c++){
+		// the first character of a token
+		switch(c){
+			case C_SPACE:
+			case C_EOL:
+				moves[S_START][c] = S_START;
+				break;
+			case C_ALPHA:
+				moves[S_START][c] = S_IDENT;
+				break;
+			case C_DIGIT:
+				moves[S_START][c] = S_INT;
+				break;
+			case C_COLON:
+				moves[S_START][c] = S_COLON;
+				break;
+			case C_LPAREN:
+				moves[S_START][c] = S_LPAREN;
+				break;
+			case C_STAR:
+			case C_RPAREN:
+			case C_SINGLE:
+				moves[S_START][c] = A_SYMBOL;
+				break;
+			default:
+				moves[S_START][c] = S_WORD;
+		}
+
+		// comments run until "*)" and carry on over the end of a line
+		moves[S_COMMENT][c] = (c == C_STAR) ? S_STAR : S_COMMENT;
+		if(c == C_RPAREN){
+			moves[S_STAR][c] = S_START;
+		}
+		else{
+			moves[S_STAR][c] = (c == C_STAR) ? S_STAR : S_COMMENT;
+		}
+		if(c == C_EOL){
+			moves[S_STAR][c] = S_COMMENT;
+		}
+
+		// words, which are variables for as long as they stay alphanumeric
+		if(isstopper(c)){
+			moves[S_IDENT][c] = A_IDENT;
+			moves[S_WORD][c] = A_WORD;
+			moves[S_INT][c] = A_INT;
+			moves[S_BADINT][c] = A_BADINT;
+		}
+		else{
+			moves[S_IDENT][c] = (c == C_ALPHA || c == C_DIGIT) ? S_IDENT : S_WORD;
+			moves[S_WORD][c] = S_WORD;
+			moves[S_INT][c] = (c == C_DIGIT) ? S_INT : S_BADINT;
+			moves[S_BADINT][c] = S_BADINT;
+		}
+
+		// the double tokens := and (*
+		moves[S_COLON][c] = (c == C_EQUAL) ? A_SYMBOL : A_SHORT;
+		moves[S_LPAREN][c] = (c == C_STAR) ? S_COMMENT : A_SHORT;
+	}
+}
+
+/*
+ *
+ * name: main
+ *
+ * Builds the DFA and prints the flattened tables as C source.
+ */
+int main(){
+	int c, s;
+
+	buildClasses();
+	buildMoves();
+
+	printf("/*\n *      lextab.c\n *\n * Generated by lexgen, do not edit.\n */\n\n");
+	printf("#include \"lexer.h\"\n\n");
+
+	printf("const unsigned char charClass[256] = {");
+	for(c=0;c<256;c++){
+		printf("%s%d,", (c % 16) ? " " : "\n\t", classes[c]);
+	}
+	printf("\n};\n\n");
+
+	printf("const unsigned char lexTable[LEX_ACCEPT][256] = {");
+	for(s=0;s<LEX_ACCEPT;s++){
+		printf("\n\t{");
+		for(c=0;c<256;c++){
+			printf("%s%d,", (c % 16) ? " " : "\n\t\t", moves[s][classes[c]]);
+		}
+		printf("\n\t},");
+	}
+	printf("\n};\n\n");
+
+	printf("const unsigned char lexEnd[LEX_ACCEPT] = {\n\t");
+	for(s=0;s<LEX_ACCEPT;s++){
+		printf("%d,%s", moves[s][C_EOL], (s+1 < LEX_ACCEPT) ? " " : "\n");
+	}
+	printf("};\n");
+	return 0;
+}
@@ -1,7 +1,9 @@
 /*
  *      line.h
  *
- * This file contains the line struct needed throughout the program.
+ * This file contains the line struct needed throughout the program.  A line
+ * does not own any text, it simply points at the current line within the
+ * source buffer.
  *
  */
 
@@ -9,12 +11,22 @@
 #define line_h
 
 #include "config.h"
+#include "source.h"
+#include "output.h"
 
 typedef struct{
-	char line[MAX_LINE_LEN+1];
+	const char * line;
+	int length;
 	int scanIndex;
 	int lineNumber;
 	int atEOF;
+	int lexState;
+	outputSink * echo;
+	long offset;
+	sourceBuffer * source;
 } line;
 
+// the character at the given index of a line, or '\0' past its end
+#define lineChar(current, i) ((i) < (current)->length ? (current)->line[(i)] : '\0')
+
 #endif
@@ -0,0 +1,32 @@
+/*
+ *      ll.h
+ *
+ * This file contains how the LL(1) parse tables are encoded.  The tables
+ * themselves are generated by llgen from SPS.g into lltab.c, along with
+ * lltab.h, which names the rules of the grammar and declares the tables.
+ *
+ */
+
+#ifndef ll_h
+#define ll_h
+
+// the symbols a production is made of.  Every symbol below LL_TERMINALS is
+// the code of a token, and nonterminal n is LL_TERMINALS + n.
+#define LL_TERMINALS 32
+#define LL_MAX_NONTERMINALS 96
+
+// nonterminal n has ended, pushed by the parser for each rule it expands
+#define LL_LEAVE (LL_TERMINALS + LL_MAX_NONTERMINALS)
+
+// skipping ahead after an error goes on, once a block met while skipping
+// has been parsed
+#define LL_RESUME 254
+
+// one pass of a repetition has ended
+#define LL_ITERATE 255
+
+// the most productions and symbols the tables can hold
+#define LL_MAX_PRODUCTIONS 127
+#define LL_MAX_SYMBOLS 1024
+
+#endif
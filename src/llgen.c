@@ -0,0 +1,597 @@
+/*
+ *      llgen.c
+ *
+ * Generates the LL(1) parse tables of the grammar.  The rules are read in
+ * their extended form, where { } repeats what it holds and [ ] makes it
+ * optional, and each such group becomes a nonterminal of its own.  The
+ * FIRST and FOLLOW sets of every nonterminal are then worked out, and from
+ * them the production to expand for each nonterminal and lookahead token.
+ * A grammar which is not LL(1) is rejected, naming where it is ambiguous.
+ *
+ * Input: The grammar, written as in SPS.g, the token file, and the name to
+ * 	give the generated files.
+ *
+ * Output: the C source of the tables and a header naming the rules, which
+ * 	the makefile writes to lltab.c and lltab.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "hasher.h"
+#include "ll.h"
+
+// the longest line of the grammar, and the most words on it
+#define MAX_LINE 1024
+#define MAX_WORDS 256
+
+// a set of terminals, bit 0 standing for the end of the source
+typedef unsigned int terminalSet;
+#define END_OF_SOURCE 0
+
+typedef struct{
+	int lhs;
+	int length;
+	unsigned char symbols[LL_MAX_SYMBOLS];
+} production;
+
+char names[LL_MAX_NONTERMINALS][MAX_LINE];
+int nonterminals = 0;
+int named = 0;
+production productions[LL_MAX_PRODUCTIONS];
+int productionCount = 0;
+char spellings[LL_TERMINALS][MAX_TOKEN_LEN + 1];
+terminalSet first[LL_MAX_NONTERMINALS];
+terminalSet follow[LL_MAX_NONTERMINALS];
+int nullable[LL_MAX_NONTERMINALS];
+signed char table[LL_MAX_NONTERMINALS][LL_TERMINALS];
+int grammarLine = 0;
+// the groups read so far in the current rule
+int groups = 0;
+
+static void fail(const char * message, const char * what){
+	fprintf(stderr, "llgen: line %d: %s %s\n", grammarLine, message, what);
+	exit(1);
+}
+
+/*
+ *
+ * name: nonterminalNamed
+ *
+ * @param	name	the name of a rule, without its angle brackets
+ * @return	its number, -1 if no rule has the name
+ */
+static int nonterminalNamed(const char * name){
+	int n;
+	for(n=0;n<named;n++){
+		if(strcmp(names[n], name) == 0){
+			return n;
+		}
+	}
+	return -1;
+}
+
+/*
+ *
+ * name: addNonterminal
+ *
+ * @param	name	the name of the nonterminal
+ * @return	its number
+ */
+static int addNonterminal(const char * name){
+	if(nonterminals == LL_MAX_NONTERMINALS){
+		fail("too many nonterminals at", name);
+	}
+	strcpy(names[nonterminals], name);
+	return nonterminals++;
+}
+
+/*
+ *
+ * name: symbolOf
+ *
+ * Reads one word of a rule as a symbol: a nonterminal in angle brackets,
+ * id or int, or the spelling of a token in the token file.
+ *
+ * @param	word	the word
+ * @return	the symbol
+ */
+static int symbolOf(const char * word){
+	char name[MAX_LINE];
+	int length = strlen(word), n, code;
+
+	if(length > 2 && word[0] == '<' && word[length-1] == '>'){
+		memcpy(name, word + 1, length - 2);
+		name[length - 2] = '\0';
+		n = nonterminalNamed(name);
+		if(n < 0){
+			fail("no rule for", word);
+		}
+		return LL_TERMINALS + n;
+	}
+	if(strcmp(word, "id") == 0){
+		return ID;
+	}
+	if(strcmp(word, "int") == 0){
+		return INT;
+	}
+	for(code=0;code<LL_TERMINALS;code++){
+		if(strcmp(spellings[code], word) == 0){
+			return code;
+		}
+	}
+	fail("unknown token", word);
+	return 0;
+}
+
+static void addProduction(int lhs, const unsigned char * symbols, int length){
+	if(productionCount == LL_MAX_PRODUCTIONS){
+		fail("too many productions for", names[lhs]);
+	}
+	productions[productionCount].lhs = lhs;
+	productions[productionCount].length = length;
+	memcpy(productions[productionCount].symbols, symbols, length);
+	productionCount++;
+}
+
+/*
+ *
+ * name: readChoice
+ *
+ * Reads alternatives separated by | up to the given closing word, adding
+ * each as a production of the given nonterminal.  A group met on the way
+ * is read into a new nonterminal of its own, named after the rule it is
+ * in.  Each pass of a repetition ends with LL_ITERATE and expands it again.
+ *
+ * @param	lhs	the nonterminal the alternatives are productions of
+ * @param	rule	the rule being read, which groups are named after
+ * @param	words	the words of the rule
+ * @param	at	the word to start at, moved past the closing word
+ * @param	closing	the word which ends the alternatives, or NULL for the end
+ * 	of the rule
+ * @param	repeated	1 if the alternatives are those of a repetition
+ */
+static void readChoice(int lhs, int rule, char ** words, int * at,
+		const char * closing, int repeated){
+	unsigned char symbols[LL_MAX_SYMBOLS];
+	char name[MAX_LINE];
+	int length = 0, group;
+
+	for(;;){
+		if(words[*at] == NULL || (closing != NULL && strcmp(words[*at], closing) == 0) ||
+				strcmp(words[*at], "|") == 0){
+			if(repeated){
+				symbols[length++] = LL_ITERATE;
+				symbols[length++] = LL_TERMINALS + lhs;
+			}
+			addProduction(lhs, symbols, length);
+			length = 0;
+			if(words[*at] == NULL){
+				if(closing != NULL){
+					fail("missing", closing);
+				}
+				return;
+			}
+			if(strcmp(words[(*at)++], "|") != 0){
+				return;
+			}
+			continue;
+		}
+		if(length >= LL_MAX_SYMBOLS - 2){
+			fail("too many symbols in", names[rule]);
+		}
+		if(strcmp(words[*at], "{") == 0 || strcmp(words[*at], "[") == 0){
+			sprintf(name, "%s.%d", names[rule], ++groups);
+			group = addNonterminal(name);
+			(*at)++;
+			if(strcmp(words[*at - 1], "{") == 0){
+				readChoice(group, rule, words, at, "}", 1);
+			}
+			else{
+				readChoice(group, rule, words, at, "]", 0);
+			}
+			// either may be left out
+			addProduction(group, symbols, 0);
+			symbols[length++] = LL_TERMINALS + group;
+		}
+		else if(strcmp(words[*at], "}") == 0 || strcmp(words[*at], "]") == 0){
+			fail("unbalanced", words[*at]);
+		}
+		else{
+			symbols[length++] = symbolOf(words[(*at)++]);
+		}
+	}
+}
+
+/*
+ *
+ * name: splitWords
+ *
+ * Splits a line at whitespace, in place.
+ *
+ * @param	line	the line
+ * @param	words	filled with the words, followed by NULL
+ */
+static void splitWords(char * line, char ** words){
+	int count = 0;
+	char * word = strtok(line, " \t\r\n");
+	while(word != NULL && count < MAX_WORDS - 1){
+		words[count++] = word;
+		word = strtok(NULL, " \t\r\n");
+	}
+	words[count] = NULL;
+}
+
+/*
+ *
+ * name: readGrammar
+ *
+ * Reads every rule of the grammar.  The rules are named in a first pass, so
+ * a rule may refer to one defined after it.  The first rule is the start.
+ *
+ * @param	fileName	the grammar file
+ */
+static void readGrammar(const char * fileName){
+	char line[MAX_LINE], name[MAX_LINE];
+	char * words[MAX_WORDS];
+	FILE * in = fopen(fileName, "r");
+	int pass, at, lhs, length;
+
+	if(in == NULL){
+		fprintf(stderr, "llgen: could not open %s\n", fileName);
+		exit(1);
+	}
+	for(pass=0;pass<2;pass++){
+		rewind(in);
+		grammarLine = 0;
+		while(fgets(line, MAX_LINE, in) != NULL){
+			grammarLine++;
+			splitWords(line, words);
+			if(words[0] == NULL){
+				continue;
+			}
+			length = strlen(words[0]);
+			if(length < 3 || words[0][0] != '<' || words[0][length-1] != '>' ||
+					words[1] == NULL || strcmp(words[1], "::=") != 0){
+				fail("expected <rule> ::= at", words[0]);
+			}
+			memcpy(name, words[0] + 1, length - 2);
+			name[length - 2] = '\0';
+			if(pass == 0){
+				if(nonterminalNamed(name) >= 0){
+					fail("second rule for", words[0]);
+				}
+				addNonterminal(name);
+				named++;
+			}
+			else{
+				lhs = nonterminalNamed(name);
+				at = 2;
+				groups = 0;
+				readChoice(lhs, lhs, words, &at, NULL, 0);
+			}
+		}
+	}
+	fclose(in);
+	if(named == 0){
+		fail("no rules in", fileName);
+	}
+}
+
+/*
+ *
+ * name: firstOf
+ *
+ * Works out the FIRST set of a run of symbols from what is known so far.
+ *
+ * @param	symbols	the symbols
+ * @param	length	the number of symbols
+ * @param	empty	set to 1 if the whole run can derive nothing
+ * @return	the terminals the run can start with
+ */
+static terminalSet firstOf(const unsigned char * symbols, int length, int * empty){
+	terminalSet found = 0;
+	int i;
+
+	for(i=0;i<length;i++){
+		if(symbols[i] == LL_ITERATE){
+			continue;
+		}
+		if(symbols[i] < LL_TERMINALS){
+			*empty = 0;
+			return found | 1u << symbols[i];
+		}
+		found |= first[symbols[i] - LL_TERMINALS];
+		if(!nullable[symbols[i] - LL_TERMINALS]){
+			*empty = 0;
+			return found;
+		}
+	}
+	*empty = 1;
+	return found;
+}
+
+/*
+ *
+ * name: findSets
+ *
+ * Works out the FIRST and FOLLOW sets of every nonterminal, repeating until
+ * nothing changes.
+ */
+static void findSets(){
+	terminalSet before, after;
+	production * p;
+	int changed = 1, i, n, empty;
+
+	while(changed){
+		changed = 0;
+		for(i=0;i<productionCount;i++){
+			p = &productions[i];
+			before = first[p->lhs];
+			first[p->lhs] |= firstOf(p->symbols, p->length, &empty);
+			if(first[p->lhs] != before || (empty && !nullable[p->lhs])){
+				nullable[p->lhs] |= empty;
+				changed = 1;
+			}
+		}
+	}
+
+	follow[0] = 1u << END_OF_SOURCE;
+	changed = 1;
+	while(changed){
+		changed = 0;
+		for(i=0;i<productionCount;i++){
+			p = &productions[i];
+			for(n=0;n<p->length;n++){
+				if(p->symbols[n] < LL_TERMINALS || p->symbols[n] == LL_ITERATE){
+					continue;
+				}
+				after = firstOf(p->symbols + n + 1, p->length - n - 1, &empty);
+				if(empty){
+					after |= follow[p->lhs];
+				}
+				before = follow[p->symbols[n] - LL_TERMINALS];
+				follow[p->symbols[n] - LL_TERMINALS] |= after;
+				changed |= follow[p->symbols[n] - LL_TERMINALS] != before;
+			}
+		}
+	}
+}
+
+static const char * spellingOf(int code){
+	if(code == END_OF_SOURCE){
+		return "end of source";
+	}
+	if(code == ID){
+		return "id";
+	}
+	if(code == INT){
+		return "int";
+	}
+	return spellings[code];
+}
+
+/*
+ *
+ * name: fillTable
+ *
+ * Fills in the production to expand for every nonterminal and lookahead: a
+ * production on every terminal it can start with, and one which can derive
+ * nothing on every terminal which can follow its nonterminal.  Two
+ * productions on the same terminal mean the grammar is not LL(1).
+ */
+static void fillTable(){
+	terminalSet starts;
+	production * p;
+	int i, code, empty, clashes = 0;
+
+	memset(table, -1, sizeof(table));
+	for(i=0;i<productionCount;i++){
+		p = &productions[i];
+		starts = firstOf(p->symbols, p->length, &empty);
+		if(empty){
+			starts |= follow[p->lhs];
+		}
+		for(code=0;code<LL_TERMINALS;code++){
+			if(!(starts & 1u << code)){
+				continue;
+			}
+			if(table[p->lhs][code] >= 0){
+				fprintf(stderr, "llgen: <%s> is not LL(1), two productions start with %s\n",
+						names[p->lhs], spellingOf(code));
+				clashes++;
+			}
+			table[p->lhs][code] = i;
+		}
+	}
+	if(clashes > 0){
+		exit(1);
+	}
+}
+
+/*
+ *
+ * name: defaultOf
+ *
+ * Picks the production to expand for a lookahead the table has none for.
+ * That is the empty production if there is one, so the error is found by
+ * whatever expects the token, or the only production if there is just one.
+ *
+ * @param	n	the nonterminal
+ * @return	the production, -1 if the nonterminal has several
+ */
+static int defaultOf(int n){
+	int i, found = -1, count = 0;
+
+	for(i=0;i<productionCount;i++){
+		if(productions[i].lhs != n){
+			continue;
+		}
+		if(productions[i].length == 0){
+			return i;
+		}
+		found = i;
+		count++;
+	}
+	return count == 1 ? found : -1;
+}
+
+static void printSet(FILE * out, terminalSet set){
+	int code;
+	for(code=0;code<LL_TERMINALS;code++){
+		if(set & 1u << code){
+			fprintf(out, " %s", spellingOf(code));
+		}
+	}
+}
+
+/*
+ *
+ * name: writeHeader
+ *
+ * Writes the header naming each rule of the grammar as LL_ and its name in
+ * upper case, and declaring the tables.
+ *
+ * @param	out	the file to write to
+ * @param	base	the name of the generated files
+ * @param	grammar	the grammar file
+ */
+static void writeHeader(FILE * out, const char * base, const char * grammar){
+	char name[MAX_LINE];
+	int n, i;
+
+	fprintf(out, "/*\n *      %s.h\n *\n * Generated by llgen from %s, do not edit.\n */\n\n",
+			base, grammar);
+	fprintf(out, "#ifndef %s_h\n#define %s_h\n\n#include \"ll.h\"\n\n", base, base);
+	fprintf(out, "// the rules of the grammar, in the order written\nenum {");
+	for(n=0;n<named;n++){
+		for(i=0;names[n][i] != '\0';i++){
+			name[i] = names[n][i] == '-' ? '_' : toupper((unsigned char)names[n][i]);
+		}
+		name[i] = '\0';
+		fprintf(out, "%sLL_%s", n % 6 == 0 ? "\n\t" : " ", name);
+		fprintf(out, ",");
+	}
+	fprintf(out, "\n\tLL_NAMED};\n\n");
+	fprintf(out, "#define LL_NONTERMINALS %d\n#define LL_PRODUCTIONS %d\n\n",
+			nonterminals, productionCount);
+	fprintf(out, "extern const signed char llTable[LL_NONTERMINALS][LL_TERMINALS];\n");
+	fprintf(out, "extern const signed char llDefault[LL_NONTERMINALS];\n");
+	fprintf(out, "extern const unsigned short llStart[LL_PRODUCTIONS + 1];\n");
+	fprintf(out, "extern const unsigned char llSymbols[];\n");
+	fprintf(out, "extern const char * const llNames[LL_NONTERMINALS];\n");
+	fprintf(out, "extern const char * const llExpected[LL_TERMINALS];\n\n#endif\n");
+}
+
+/*
+ *
+ * name: writeTables
+ *
+ * Writes the tables.  The symbols of each production are written in
+ * reverse, the order the parser pushes them in.
+ *
+ * @param	out	the file to write to
+ * @param	base	the name of the generated files
+ * @param	grammar	the grammar file
+ */
+static void writeTables(FILE * out, const char * base, const char * grammar){
+	int n, i, code, start = 0;
+
+	fprintf(out, "/*\n *      %s.c\n *\n * Generated by llgen from %s, do not edit.\n *\n",
+			base, grammar);
+	for(n=0;n<nonterminals;n++){
+		fprintf(out, " * <%s>%s\n *\tFIRST", names[n], nullable[n] ? " may be empty" : "");
+		printSet(out, first[n]);
+		fprintf(out, "\n *\tFOLLOW");
+		printSet(out, follow[n]);
+		fprintf(out, "\n");
+	}
+	fprintf(out, " */\n\n#include \"%s.h\"\n\n", base);
+
+	fprintf(out, "const signed char llTable[LL_NONTERMINALS][LL_TERMINALS] = {\n");
+	for(n=0;n<nonterminals;n++){
+		fprintf(out, "\t{");
+		for(code=0;code<LL_TERMINALS;code++){
+			fprintf(out, "%s%d", code ? "," : "", table[n][code]);
+		}
+		fprintf(out, "},\n");
+	}
+	fprintf(out, "};\n\nconst signed char llDefault[LL_NONTERMINALS] = {");
+	for(n=0;n<nonterminals;n++){
+		fprintf(out, "%s%d", n ? ", " : "", defaultOf(n));
+	}
+	fprintf(out, "};\n\nconst unsigned short llStart[LL_PRODUCTIONS + 1] = {");
+	for(i=0;i<productionCount;i++){
+		fprintf(out, "%s%d", i ? ", " : "", start);
+		start += productions[i].length;
+	}
+	fprintf(out, ", %d};\n\nconst unsigned char llSymbols[] = {\n", start);
+	for(i=0;i<productionCount;i++){
+		fprintf(out, "\t/* %d <%s> */", i, names[productions[i].lhs]);
+		for(n=productions[i].length-1;n>=0;n--){
+			fprintf(out, " %d,", productions[i].symbols[n]);
+		}
+		fprintf(out, "\n");
+	}
+	fprintf(out, "\t0\n};\n\nconst char * const llNames[LL_NONTERMINALS] = {");
+	for(n=0;n<nonterminals;n++){
+		fprintf(out, "%s\"%s\"", n % 6 == 0 ? "\n\t" : " ", names[n]);
+		fprintf(out, n < nonterminals - 1 ? "," : "");
+	}
+	fprintf(out, "\n};\n\nconst char * const llExpected[LL_TERMINALS] = {\n");
+	for(code=1;code<LL_TERMINALS;code++){
+		if(code == ID){
+			fprintf(out, "\t[%d] = \"Expected variable name\",\n", code);
+		}
+		else if(code == INT){
+			fprintf(out, "\t[%d] = \"Expected integer\",\n", code);
+		}
+		else if(spellings[code][0] != '\0'){
+			fprintf(out, "\t[%d] = \"Expected %s\",\n", code, spellings[code]);
+		}
+	}
+	fprintf(out, "};\n");
+}
+
+int main(int argc, char** argv){
+	reserved tokenList[MAX_TOKENS];
+	char fileName[MAX_LINE];
+	FILE * out;
+	int i, count;
+
+	if(argc != 4){
+		fprintf(stderr, "usage: %s grammar tokens name\n", argv[0]);
+		return 1;
+	}
+	count = readTokens(tokenList, argv[2]);
+	for(i=0;i<count;i++){
+		if(tokenList[i].code > 0 && tokenList[i].code < LL_TERMINALS){
+			strcpy(spellings[tokenList[i].code], tokenList[i].name);
+		}
+	}
+	readGrammar(argv[1]);
+	findSets();
+	fillTable();
+
+	snprintf(fileName, MAX_LINE, "%s.h", argv[3]);
+	out = fopen(fileName, "w");
+	if(out == NULL){
+		fprintf(stderr, "llgen: could not write %s\n", fileName);
+		return 1;
+	}
+	writeHeader(out, argv[3], argv[1]);
+	fclose(out);
+	snprintf(fileName, MAX_LINE, "%s.c", argv[3]);
+	out = fopen(fileName, "w");
+	if(out == NULL){
+		fprintf(stderr, "llgen: could not write %s\n", fileName);
+		return 1;
+	}
+	writeTables(out, argv[3], argv[1]);
+	fclose(out);
+	return 0;
+}
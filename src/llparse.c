@@ -0,0 +1,526 @@
+/*
+ *      llparse.c
+ *
+ * This file contains the table driven parser.  It runs the LL(1) tables
+ * generated by llgen from SPS.g: the symbols still to be matched are kept
+ * on a stack, and a nonterminal on top is replaced by the production the
+ * table gives for it and the lookahead token.  Nothing recurses, so a
+ * source may nest as deeply as memory allows.
+ *
+ * The grammar only says what is accepted.  What each rule does with its
+ * tokens, declaring and looking up variables and building the syntax tree,
+ * is done here as its tokens are matched and when it ends, in a frame kept
+ * for each rule while it is open.  The tree and the errors found in a
+ * correct prefix are those of the recursive descent parser.
+ *
+ * After an error the parse goes on from the innermost list of statements
+ * or declarations open, which is where the recursive descent parser
+ * recovers too, so the two find the same errors after it.
+ *
+ * Only the tables come from SPS.g.  The actions in matched(), iterate() and
+ * leave(), the messages in missing() and the rules recover() goes on from
+ * are written by hand against the rule names llgen gives, and recover()
+ * counts what is left of <prog> from its production as written, PROGRAM
+ * <prog-name> VAR <dec-list> BEGIN <stmt-list> END.  A rule renamed in
+ * SPS.g stops this file compiling, but a rule added does nothing until it
+ * is given its actions here, and a change to <prog> needs recover() changed
+ * with it.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "arena.h"
+#include "hasher.h"
+#include "ast.h"
+#include "sps.h"
+#include "session.h"
+#include "grammar.h"
+#include "lltab.h"
+#include "llparse.h"
+
+// what is known of an open rule: where its mark to leave it is on the stack,
+// where its subtree starts, the position of the token before it, of the
+// first and last tokens matched in the rule itself and the last one's code,
+// the variable it names and the passes of its repetition
+typedef struct{
+	int rule;
+	int base;
+	unsigned int first;
+	unsigned long long before;
+	unsigned long long where;
+	unsigned long long last;
+	int code;
+	int symbol;
+	int count;
+} llFrame;
+
+// the stacks of symbols and open rules, which come from the session's arena
+// and are moved to larger ones as they fill
+typedef struct{
+	unsigned char * symbols;
+	int top;
+	int capacity;
+	llFrame * frames;
+	int depth;
+	int frameCapacity;
+	arena * memory;
+} llStack;
+
+// the rule each is reported to the embedder as, plus one so 0 is none
+static const signed char ruleEvents[LL_NAMED] = {
+	[LL_PROG] = SPS_PROG + 1, [LL_PROG_NAME] = SPS_PROG_NAME + 1,
+	[LL_DEC_LIST] = SPS_DEC_LIST + 1, [LL_DEC] = SPS_DEC + 1,
+	[LL_TYPE] = SPS_TYPE + 1, [LL_ID_LIST] = SPS_ID_LIST + 1,
+	[LL_STMT_LIST] = SPS_STMT_LIST + 1, [LL_STMT] = SPS_STMT + 1,
+	[LL_ASSIGN] = SPS_ASSIGN + 1, [LL_EXP] = SPS_EXPRESSION + 1,
+	[LL_TERM] = SPS_TERM + 1, [LL_FACTOR] = SPS_FACTOR + 1,
+	[LL_READ] = SPS_READ_STMT + 1, [LL_WRITE] = SPS_WRITE_STMT + 1,
+	[LL_FOR] = SPS_FOR_STMT + 1, [LL_INDEX_EXP] = SPS_INDEX_EXP + 1,
+	[LL_BODY] = SPS_BODY + 1,
+};
+
+/*
+ *
+ * name: growStack
+ *
+ * Moves the symbols or the frames of the stack to an array twice the size.
+ * The old array is left in the arena until it is reset.
+ *
+ * @param	stack	the stack
+ * @param	frames	1 to grow the frames, 0 the symbols
+ * @return	1 if successful, 0 if out of memory
+ */
+static int growStack(llStack * stack, int frames){
+	void * bigger;
+
+	if(frames){
+		bigger = arenaAlloc(stack->memory, stack->frameCapacity * 2 * sizeof(llFrame));
+		if(bigger == NULL){
+			return 0;
+		}
+		memcpy(bigger, stack->frames, stack->depth * sizeof(llFrame));
+		stack->frames = bigger;
+		stack->frameCapacity *= 2;
+	}
+	else{
+		bigger = arenaAlloc(stack->memory, stack->capacity * 2);
+		if(bigger == NULL){
+			return 0;
+		}
+		memcpy(bigger, stack->symbols, stack->top);
+		stack->symbols = bigger;
+		stack->capacity *= 2;
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: missing
+ *
+ * @param	n	a nonterminal the lookahead cannot start
+ * @return	the error to report, as the recursive descent parser words it
+ */
+static const char * missing(int n){
+	switch(n){
+		case LL_STMT:
+		case LL_BODY:
+			return "Expected statement";
+		case LL_FACTOR:
+			return "Expected identifier, literal, or expression.";
+		case LL_OPERAND:
+			return "Expected identifier or literal";
+		default:
+			return "Unexpected token";
+	}
+}
+
+/*
+ *
+ * name: matched
+ *
+ * Does what the rule in the given frame does with the token just matched:
+ * variables are declared or looked up, and made leaves of the tree with
+ * the integers.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	frame	the frame of the rule the token was matched in
+ * @param	parent	the frame of the rule which expanded it
+ * @return	0 upon error, 1 if successful
+ */
+static int matched(sourceContainer* source, llFrame * frame, llFrame * parent){
+	token * item = &source->currentToken;
+
+	if(frame->where == 0){
+		frame->where = item->position;
+	}
+	frame->last = item->position;
+	frame->code = item->code;
+	if(item->code == ID){
+		switch(frame->rule){
+			case LL_PROG_NAME:
+				frame->symbol = item->symbol;
+				return addId(source, 0);
+			case LL_ID_LIST:
+				if(parent != NULL && parent->rule == LL_DEC){
+					return addId(source, 1) && addLeaf(source);
+				}
+				return lookupId(source) && addLeaf(source);
+			case LL_ASSIGN:
+				frame->symbol = item->symbol;
+				return lookupId(source) && addLeaf(source);
+			case LL_FACTOR:
+			case LL_OPERAND:
+			case LL_INDEX_EXP:
+				return lookupId(source) && addLeaf(source);
+		}
+	}
+	else if(item->code == INT){
+		if(item->error != NO_ERROR){
+			err(source, frame->rule == LL_OPERAND ? "Invalid integer literal" :
+					"Invalid literal");
+			return 0;
+		}
+		return addLeaf(source);
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: iterate
+ *
+ * Does what the rule in the given frame does at the end of each pass of
+ * its repetition: an operator is made a node over everything from the
+ * start of the rule, and the items of a list are counted.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	frame	the frame of the rule
+ * @return	0 upon error, 1 if successful
+ */
+static int iterate(sourceContainer* source, llFrame * frame){
+	switch(frame->rule){
+		case LL_EXP:
+			return addTree(source, frame->code == PLUS ? NODE_ADD : NODE_SUBTRACT,
+					frame->first, frame->last, 0);
+		case LL_TERM:
+			return addTree(source, frame->code == ASTRIX ? NODE_MULTIPLY : NODE_DIVIDE,
+					frame->first, frame->last, 0);
+		default:
+			frame->count++;
+			return 1;
+	}
+}
+
+/*
+ *
+ * name: leave
+ *
+ * Does what the rule in the given frame does once it has been parsed,
+ * which is mostly to add the node of its subtree.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	frame	the frame of the rule
+ * @param	parent	the frame of the rule which expanded it
+ * @return	0 upon error, 1 if successful
+ */
+static int leave(sourceContainer* source, llFrame * frame, llFrame * parent){
+	switch(frame->rule){
+		case LL_PROG:
+			return addTree(source, NODE_PROG, 0, frame->where, frame->symbol);
+		case LL_PROG_NAME:
+			parent->symbol = frame->symbol;
+			return 1;
+		case LL_DEC_LIST:
+			return addTree(source, NODE_DECLARATIONS, frame->first, frame->before,
+					frame->count);
+		case LL_DEC:
+			return addTree(source, NODE_DECLARE, frame->first,
+					firstNode(source, frame->first, position),
+					source->tree.count - frame->first);
+		case LL_STMT_LIST:
+			return addTree(source, NODE_STATEMENTS, frame->first, frame->before,
+					frame->count);
+		case LL_ASSIGN:
+			return addTree(source, NODE_ASSIGN, frame->first, frame->where,
+					frame->symbol);
+		case LL_FACTOR:
+			// a sign only makes a node of its own when it negates
+			return frame->code != MINUS ||
+					addTree(source, NODE_NEGATE, frame->first, frame->where, 0);
+		case LL_READ:
+		case LL_WRITE:
+			return addTree(source, frame->rule == LL_READ ? NODE_READ : NODE_WRITE,
+					frame->first, frame->where, source->tree.count - frame->first);
+		case LL_FOR:
+			// the index is the first node of the statement
+			return addTree(source, NODE_FOR, frame->first, frame->where,
+					firstNode(source, frame->first, value));
+		default:
+			return 1;
+	}
+}
+
+/*
+ *
+ * name: leaving
+ *
+ * Reports leaving the rule in the given frame, if it is one the embedder
+ * knows and anyone is listening.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	frame	the frame of the rule
+ */
+static void leaving(sourceContainer* source, llFrame * frame){
+	const spsHandlers * handlers = source->handlers;
+	if(ruleEvents[frame->rule] && handlers != NULL && handlers->exitRule != NULL){
+		handlers->exitRule(source->context, ruleEvents[frame->rule] - 1);
+	}
+}
+
+/*
+ *
+ * name: skipAhead
+ *
+ * Skips the tokens after an error up to one the parse can go on from, as
+ * recover() in grammar.c does: a semicolon, BEGIN, END, END. or the end of
+ * the source, and in the heading VAR.  Among statements a block met on the
+ * way is pushed to be parsed, with the mark to go on skipping after it, so
+ * the errors within it are found and its END does not end the statements
+ * around it.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	stack	the stack
+ * @param	resume	where the parse goes on, one of RESUME_HEADING to
+ * 	RESUME_STATEMENTS
+ * @return	0 if out of memory, 1 if successful
+ */
+static int skipAhead(sourceContainer* source, llStack * stack, int resume){
+	int code;
+	while(!endOfTokens(source)){
+		code = source->currentToken.code;
+		if(code == VAR && resume == RESUME_HEADING){
+			return 1;
+		}
+		if(code == BEGIN && resume == RESUME_STATEMENTS){
+			if(stack->top + 4 > stack->capacity && !growStack(stack, 0)){
+				halt(source, "Out of memory for parse stack!");
+				return 0;
+			}
+			stack->symbols[stack->top++] = LL_RESUME;
+			stack->symbols[stack->top++] = END;
+			stack->symbols[stack->top++] = LL_TERMINALS + LL_STMT_LIST;
+			stack->symbols[stack->top++] = BEGIN;
+			return 1;
+		}
+		if(code == SEMICOLON || code == BEGIN || code == END || code == ENDDOT){
+			return 1;
+		}
+		nextToken(source);
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: recover
+ *
+ * Goes on after an error.  Every rule opened within the innermost list of
+ * statements or declarations is left, and the tokens are skipped up to one
+ * the list's repetition, left on the stack, can go on from.  Outside the
+ * lists the program goes on from its declarations or its statements,
+ * whichever the token skipped to can start, as prog() does.
+ *
+ * @param	source	the structure containing all parser information
+ * @param	stack	the stack
+ * @param	fetch	set if the current token has been matched
+ * @return	0 if the parse cannot go on, 1 if successful
+ */
+static int recover(sourceContainer* source, llStack * stack, int * fetch){
+	llFrame * frame;
+	int remaining, code;
+
+	if(source->halted || stack->depth == 0){
+		return 0;
+	}
+	frame = &stack->frames[stack->depth-1];
+	while(stack->depth > 1 && frame->rule != LL_STMT_LIST &&
+			frame->rule != LL_DEC_LIST){
+		stack->top = frame->base;
+		leaving(source, frame);
+		stack->depth--;
+		frame--;
+	}
+	if(*fetch){
+		nextToken(source);
+		*fetch = 0;
+	}
+	if(frame->rule != LL_PROG){
+		// the repetition of a list is just above its mark
+		stack->top = frame->base + 2;
+		return skipAhead(source, stack, frame->rule == LL_STMT_LIST ?
+				RESUME_STATEMENTS : RESUME_DECLARATIONS);
+	}
+
+	// what is left of the program, which is END. <stmt-list> BEGIN <dec-list>
+	// VAR from the top of the stack down, so 0 once END. was not found
+	remaining = stack->top - frame->base - 1;
+	if(remaining == 0){
+		return 0;
+	}
+	skipAhead(source, stack, remaining >= 4 ? RESUME_HEADING : RESUME_DECLARATIONS);
+	code = source->currentToken.code;
+	if(remaining >= 4 && (code == VAR || code == SEMICOLON)){
+		// the declarations, after the token taken as VAR
+		stack->top = frame->base + 5;
+		*fetch = 1;
+	}
+	else if(remaining >= 3 && code == BEGIN){
+		stack->top = frame->base + 4;
+	}
+	else if(code == BEGIN || code == SEMICOLON){
+		// the statements, after the token taken as BEGIN
+		stack->top = frame->base + 3;
+		*fetch = 1;
+	}
+	else if(code == ENDDOT){
+		stack->top = frame->base + 2;
+	}
+	else{
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: llProg
+ *
+ * Parses a whole program from the tables, in place of prog().  A token is
+ * only read when a symbol needs the lookahead, so the scanner stops at the
+ * same tokens as the recursive descent parser does.  An error is recovered
+ * from, and every rule it leaves is still reported as left.
+ *
+ * @param	source	structure containing all parser information
+ * @return	0 upon failure, 1 if successful
+ */
+int llProg(sourceContainer* source){
+	const spsHandlers * handlers = source->handlers;
+	llStack stack;
+	llFrame * frame;
+	unsigned long long before = 0;
+	int symbol, n, chosen, length, code, fetch = 1, failed = 0;
+
+	stack.memory = &source->memory;
+	stack.capacity = LL_STACK;
+	stack.frameCapacity = LL_STACK;
+	stack.symbols = arenaAlloc(stack.memory, stack.capacity);
+	stack.frames = arenaAlloc(stack.memory, stack.frameCapacity * sizeof(llFrame));
+	if(stack.symbols == NULL || stack.frames == NULL){
+		halt(source, "Out of memory for parse stack!");
+		return 0;
+	}
+	stack.depth = 0;
+	stack.top = 0;
+	// the first rule of the grammar is where it starts
+	stack.symbols[stack.top++] = LL_TERMINALS + LL_PROG;
+
+	while(stack.top > 0){
+		if(failed){
+			if(!recover(source, &stack, &fetch)){
+				break;
+			}
+			failed = 0;
+			continue;
+		}
+		symbol = stack.symbols[--stack.top];
+		if(symbol == LL_RESUME){
+			if(fetch){
+				nextToken(source);
+				fetch = 0;
+			}
+			failed = !skipAhead(source, &stack, RESUME_STATEMENTS);
+			continue;
+		}
+		if(symbol == LL_ITERATE){
+			failed = !iterate(source, &stack.frames[stack.depth-1]);
+			continue;
+		}
+		if(symbol >= LL_LEAVE){
+			frame = &stack.frames[stack.depth-1];
+			failed = !leave(source, frame, stack.depth > 1 ? frame - 1 : NULL);
+			leaving(source, frame);
+			stack.depth--;
+			continue;
+		}
+
+		if(fetch){
+			nextToken(source);
+			fetch = 0;
+		}
+		code = source->currentToken.code;
+		if(symbol < LL_TERMINALS){
+			frame = &stack.frames[stack.depth-1];
+			if(code != symbol){
+				err(source, llExpected[symbol]);
+				failed = 1;
+			}
+			else{
+				failed = !matched(source, frame, stack.depth > 1 ? frame - 1 : NULL);
+				before = source->currentToken.position;
+				fetch = 1;
+			}
+			continue;
+		}
+
+		// a nonterminal is replaced by its production, after a frame and the
+		// mark to leave it if it is one of the rules
+		n = symbol - LL_TERMINALS;
+		chosen = code < LL_TERMINALS ? llTable[n][code] : -1;
+		if(chosen < 0){
+			chosen = llDefault[n];
+		}
+		if(chosen < 0){
+			err(source, missing(n));
+			failed = 1;
+			continue;
+		}
+		length = llStart[chosen+1] - llStart[chosen];
+		// a production is far shorter than the stack, so one doubling will do
+		if((stack.top + length + 1 > stack.capacity && !growStack(&stack, 0)) ||
+				(stack.depth == stack.frameCapacity && !growStack(&stack, 1))){
+			halt(source, "Out of memory for parse stack!");
+			failed = 1;
+			continue;
+		}
+		if(n < LL_NAMED){
+			frame = &stack.frames[stack.depth++];
+			frame->rule = n;
+			frame->base = stack.top;
+			frame->first = source->tree.count;
+			frame->before = before;
+			frame->where = 0;
+			frame->last = 0;
+			frame->code = 0;
+			frame->symbol = -1;
+			frame->count = 1;
+			stack.symbols[stack.top++] = LL_LEAVE + n;
+			if(ruleEvents[n] && handlers != NULL && handlers->enterRule != NULL){
+				handlers->enterRule(source->context, ruleEvents[n] - 1);
+			}
+		}
+		memcpy(stack.symbols + stack.top, llSymbols + llStart[chosen], length);
+		stack.top += length;
+	}
+
+	// the rules still open are left as the recursive descent parser would
+	// unwind them
+	while(failed && stack.depth > 0){
+		leaving(source, &stack.frames[--stack.depth]);
+	}
+	return !failed && source->errors == 0;
+}
@@ -0,0 +1,16 @@
+/*
+ *      llparse.h
+ *
+ * This file contains the table driven parser, which runs the LL(1) tables
+ * generated from SPS.g with a stack of its own rather than the C stack.
+ *
+ */
+
+#ifndef llparse_h
+#define llparse_h
+
+#include "session.h"
+
+int llProg(sourceContainer *);
+
+#endif
@@ -0,0 +1,760 @@
+/*
+ *      loader.c
+ *
+ * This file contains the batch file loader.  Whole files are read into
+ * memory ahead of the threads parsing them, and each is handed over as soon
+ * as it is complete, in whatever order that is.  At most LOAD_WINDOW files
+ * are being read or waiting to be parsed at once.
+ *
+ * The files are opened and read through an io_uring where the kernel has
+ * one, so a window of opens, reads and closes go to the kernel in a single
+ * call and a cold disk has many requests to work on at once.  The ring is
+ * driven with the raw system calls rather than a library.  Without a ring,
+ * or with LOAD_THREADS asked for, LOAD_READERS threads read the files instead.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "config.h"
+#include "batch.h"
+#include "loader.h"
+
+// the largest read asked of the ring at once
+#define READ_MAX (1 << 30)
+
+// an io_uring and the parts of it mapped from the kernel
+struct loadRing{
+	int fd;
+	unsigned entries;
+	unsigned queued;
+	unsigned closing;
+	unsigned * sqHead;
+	unsigned * sqTail;
+	unsigned * sqMask;
+	unsigned * sqArray;
+	struct io_uring_sqe * sqes;
+	unsigned * cqHead;
+	unsigned * cqTail;
+	unsigned * cqMask;
+	struct io_uring_cqe * cqes;
+	void * sqMap;
+	size_t sqSize;
+	void * cqMap;
+	size_t cqSize;
+	size_t sqeSize;
+};
+
+// a file being read through the ring
+typedef struct{
+	int index;
+	int waiting;
+	int opened;
+	int statted;
+	struct statx info;
+	char * data;
+	long length;
+	long done;
+} loadJob;
+
+// what a completion is for, kept in the low bits of its tag with the job
+// above them
+enum {OP_OPEN, OP_STAT, OP_READ, OP_CLOSE};
+
+#define jobTag(job, op) (((unsigned long long)(job) << 2) | (op))
+
+/*
+ *
+ * name: closeRing
+ *
+ * Unmaps and closes a ring, however far it was set up.
+ *
+ * @param	ring	the ring to close
+ */
+static void closeRing(struct loadRing * ring){
+	if(ring->sqes != NULL && ring->sqes != MAP_FAILED){
+		munmap(ring->sqes, ring->sqeSize);
+	}
+	if(ring->cqMap != NULL && ring->cqMap != MAP_FAILED && ring->cqMap != ring->sqMap){
+		munmap(ring->cqMap, ring->cqSize);
+	}
+	if(ring->sqMap != NULL && ring->sqMap != MAP_FAILED){
+		munmap(ring->sqMap, ring->sqSize);
+	}
+	if(ring->fd >= 0){
+		close(ring->fd);
+	}
+	free(ring);
+}
+
+/*
+ *
+ * name: openRing
+ *
+ * Sets up an io_uring and maps its queues.
+ *
+ * @param	entries	the number of submissions it should hold
+ * @return	the ring, or NULL if the kernel does not have io_uring
+ */
+static struct loadRing * openRing(unsigned entries){
+	struct io_uring_params params;
+	struct loadRing * ring;
+	char * sq;
+	char * cq;
+
+	ring = calloc(1, sizeof(struct loadRing));
+	if(ring == NULL){
+		return NULL;
+	}
+	memset(&params, 0, sizeof(params));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if(ring->fd < 0){
+		closeRing(ring);
+		return NULL;
+	}
+
+	ring->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if((params.features & IORING_FEAT_SINGLE_MMAP) && ring->cqSize > ring->sqSize){
+		ring->sqSize = ring->cqSize;
+	}
+	ring->sqMap = mmap(NULL, ring->sqSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if(ring->sqMap == MAP_FAILED){
+		closeRing(ring);
+		return NULL;
+	}
+	if(params.features & IORING_FEAT_SINGLE_MMAP){
+		ring->cqMap = ring->sqMap;
+	}
+	else{
+		ring->cqMap = mmap(NULL, ring->cqSize, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if(ring->cqMap == MAP_FAILED){
+			closeRing(ring);
+			return NULL;
+		}
+	}
+	ring->sqeSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqeSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED){
+		closeRing(ring);
+		return NULL;
+	}
+
+	sq = ring->sqMap;
+	cq = ring->cqMap;
+	ring->entries = params.sq_entries;
+	ring->queued = 0;
+	ring->closing = 0;
+	ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+	ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+	ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+	ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	return ring;
+}
+
+/*
+ *
+ * name: enterRing
+ *
+ * Submits everything queued on the ring, and waits for a completion if
+ * asked to.
+ *
+ * @param	ring	the ring
+ * @param	wait	the number of completions to wait for, 0 or 1
+ * @return	1 if successful, 0 if the ring has failed
+ */
+static int enterRing(struct loadRing * ring, int wait){
+	int submitted;
+
+	while(1){
+		submitted = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait,
+				wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if(submitted >= 0){
+			ring->queued -= submitted;
+			return 1;
+		}
+		if(errno != EINTR && errno != EAGAIN && errno != EBUSY){
+			return 0;
+		}
+	}
+}
+
+/*
+ *
+ * name: ringEntry
+ *
+ * Finds an empty submission on the ring, submitting what is queued first if
+ * the queue is full.  It is queued by pushEntry() once filled in.
+ *
+ * @param	ring	the ring
+ * @param	tag	what the submission is for
+ * @return	the submission to fill in, NULL if the ring has failed
+ */
+static struct io_uring_sqe * ringEntry(struct loadRing * ring, unsigned long long tag){
+	struct io_uring_sqe * entry;
+	unsigned tail = *ring->sqTail;
+	unsigned slot;
+
+	if(tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == ring->entries){
+		if(!enterRing(ring, 0) ||
+				tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == ring->entries){
+			return NULL;
+		}
+	}
+	slot = tail & *ring->sqMask;
+	entry = &ring->sqes[slot];
+	memset(entry, 0, sizeof(struct io_uring_sqe));
+	entry->user_data = tag;
+	ring->sqArray[slot] = slot;
+	return entry;
+}
+
+static void pushEntry(struct loadRing * ring){
+	__atomic_store_n(ring->sqTail, *ring->sqTail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+}
+
+/*
+ *
+ * name: readWhole
+ *
+ * Reads a whole file into memory with plain system calls.  This is used
+ * when there is no ring, and for anything the ring could not read.
+ *
+ * @param	name	the name of the file
+ * @param	file	filled in with the text, or the error
+ */
+static void readWhole(const char * name, loadedFile * file){
+	struct stat info;
+	char * bigger;
+	long size, got;
+	int fd, regular;
+
+	file->data = NULL;
+	file->length = 0;
+	file->error = 0;
+	fd = open(name, O_RDONLY);
+	if(fd < 0){
+		file->error = errno;
+		return;
+	}
+	regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+	size = regular ? info.st_size : SOURCE_BLOCK;
+	file->data = malloc(size + 1);
+	while(file->data != NULL){
+		if(file->length == size){
+			if(regular){
+				break;
+			}
+			// not a plain file, so its size is only known at the end
+			bigger = realloc(file->data, size * 2 + 1);
+			if(bigger == NULL){
+				free(file->data);
+				file->data = NULL;
+				break;
+			}
+			file->data = bigger;
+			size *= 2;
+		}
+		got = read(fd, file->data + file->length, size - file->length);
+		if(got < 0 && errno == EINTR){
+			continue;
+		}
+		if(got < 0){
+			file->error = errno;
+			free(file->data);
+			file->data = NULL;
+			break;
+		}
+		if(got == 0){
+			break;
+		}
+		file->length += got;
+	}
+	if(file->data == NULL && file->error == 0){
+		file->error = ENOMEM;
+	}
+	close(fd);
+}
+
+/*
+ *
+ * name: reserveFile
+ *
+ * Takes the next file to be read, if the window has room for it.
+ *
+ * @param	loader	the loader
+ * @param	wait	true to wait for room rather than give up
+ * @return	the index of the file, -1 if there is no room or no file left
+ */
+static int reserveFile(fileLoader * loader, int wait){
+	int index = -1;
+
+	pthread_mutex_lock(&loader->lock);
+	while(wait && loader->held == LOAD_WINDOW && !loader->stop){
+		pthread_cond_wait(&loader->changed, &loader->lock);
+	}
+	if(!loader->stop && loader->held < LOAD_WINDOW && loader->next < loader->files->count){
+		index = loader->next++;
+		loader->held++;
+	}
+	pthread_mutex_unlock(&loader->lock);
+	return index;
+}
+
+/*
+ *
+ * name: publish
+ *
+ * Hands over a file which has been read, or has failed to be.
+ *
+ * @param	loader	the loader
+ * @param	file	the file
+ */
+static void publish(fileLoader * loader, loadedFile * file){
+	pthread_mutex_lock(&loader->lock);
+	loader->ready[(loader->first + loader->count) % LOAD_WINDOW] = *file;
+	loader->count++;
+	pthread_cond_broadcast(&loader->changed);
+	pthread_mutex_unlock(&loader->lock);
+}
+
+/*
+ *
+ * name: readFiles
+ *
+ * The body of a reading thread when there is no ring, which reads files one
+ * after another until there are none left.
+ *
+ * @param	data	the loader
+ * @return	NULL
+ */
+static void * readFiles(void * data){
+	fileLoader * loader = data;
+	loadedFile file;
+
+	while((file.index = reserveFile(loader, 1)) >= 0){
+		readWhole(loader->files->names[file.index], &file);
+		publish(loader, &file);
+	}
+	return NULL;
+}
+
+/*
+ *
+ * name: startJob
+ *
+ * Queues the open of a file and the statx for its size together.
+ *
+ * @param	loader	the loader
+ * @param	jobs	the ring's jobs
+ * @param	id	the job to use
+ * @param	index	the index of the file
+ * @return	1 if successful, 0 if the ring has failed
+ */
+static int startJob(fileLoader * loader, loadJob * jobs, int id, int index){
+	struct loadRing * ring = loader->ring;
+	loadJob * job = &jobs[id];
+	const char * name = loader->files->names[index];
+	struct io_uring_sqe * entry;
+
+	job->index = index;
+	job->waiting = 2;
+	job->opened = -1;
+	job->data = NULL;
+	job->length = 0;
+	job->done = 0;
+
+	entry = ringEntry(ring, jobTag(id, OP_OPEN));
+	if(entry == NULL){
+		return 0;
+	}
+	entry->opcode = IORING_OP_OPENAT;
+	entry->fd = AT_FDCWD;
+	entry->addr = (unsigned long)name;
+	entry->open_flags = O_RDONLY;
+	pushEntry(ring);
+
+	entry = ringEntry(ring, jobTag(id, OP_STAT));
+	if(entry == NULL){
+		return 0;
+	}
+	entry->opcode = IORING_OP_STATX;
+	entry->fd = AT_FDCWD;
+	entry->addr = (unsigned long)name;
+	entry->len = STATX_TYPE | STATX_SIZE;
+	entry->off = (unsigned long)&job->info;
+	pushEntry(ring);
+	return 1;
+}
+
+/*
+ *
+ * name: readJob
+ *
+ * Queues a read of the rest of a file.
+ *
+ * @param	ring	the ring
+ * @param	job	the file's job
+ * @param	id	the number of the job
+ * @return	1 if successful, 0 if the ring has failed
+ */
+static int readJob(struct loadRing * ring, loadJob * job, int id){
+	struct io_uring_sqe * entry;
+	long left = job->length - job->done;
+
+	entry = ringEntry(ring, jobTag(id, OP_READ));
+	if(entry == NULL){
+		return 0;
+	}
+	entry->opcode = IORING_OP_READ;
+	entry->fd = job->opened;
+	entry->addr = (unsigned long)(job->data + job->done);
+	entry->len = left > READ_MAX ? READ_MAX : left;
+	entry->off = job->done;
+	pushEntry(ring);
+	return 1;
+}
+
+/*
+ *
+ * name: endJob
+ *
+ * Queues the close of a file and hands it over.  A file the ring could not
+ * read is read again with plain system calls, so every file is handed over
+ * with its text or with why it could not be opened.  If the close cannot be
+ * queued the file is closed at once.
+ *
+ * @param	loader	the loader
+ * @param	job	the file's job
+ * @param	failed	true if the ring could not read the file
+ */
+static void endJob(fileLoader * loader, loadJob * job, int failed){
+	struct io_uring_sqe * entry;
+	loadedFile file;
+
+	if(job->opened >= 0){
+		entry = ringEntry(loader->ring, jobTag(0, OP_CLOSE));
+		if(entry == NULL){
+			close(job->opened);
+		}
+		else{
+			entry->opcode = IORING_OP_CLOSE;
+			entry->fd = job->opened;
+			pushEntry(loader->ring);
+			loader->ring->closing++;
+		}
+	}
+	file.index = job->index;
+	if(job->opened < 0){
+		file.data = NULL;
+		file.length = 0;
+		file.error = -job->opened;
+	}
+	else if(failed){
+		free(job->data);
+		readWhole(loader->files->names[job->index], &file);
+	}
+	else{
+		file.data = job->data;
+		file.length = job->done;
+		file.error = 0;
+	}
+	job->index = -1;
+	publish(loader, &file);
+}
+
+/*
+ *
+ * name: stepJob
+ *
+ * Moves a file's job on when one of its requests completes.
+ *
+ * @param	loader	the loader
+ * @param	jobs	the ring's jobs
+ * @param	tag	the tag of the completion
+ * @param	result	the result of the completion
+ * @return	1 if the file has been handed over, 0 if it is still being read,
+ * 	-1 if the ring has failed
+ */
+static int stepJob(fileLoader * loader, loadJob * jobs, unsigned long long tag, int result){
+	int id = tag >> 2;
+	loadJob * job = &jobs[id];
+
+	if((tag & 3) == OP_CLOSE){
+		loader->ring->closing--;
+		return 0;
+	}
+	if((tag & 3) == OP_READ){
+		if(result == -EINTR || result == -EAGAIN){
+			return readJob(loader->ring, job, id) ? 0 : -1;
+		}
+		if(result < 0){
+			endJob(loader, job, 1);
+			return 1;
+		}
+		job->done += result;
+		if(result > 0 && job->done < job->length){
+			return readJob(loader->ring, job, id) ? 0 : -1;
+		}
+		// a file which shrank since its statx simply ends early
+		endJob(loader, job, 0);
+		return 1;
+	}
+
+	if((tag & 3) == OP_OPEN){
+		job->opened = result;
+	}
+	else{
+		job->statted = result;
+	}
+	if(--job->waiting > 0){
+		return 0;
+	}
+	if(job->opened < 0){
+		endJob(loader, job, 0);
+		return 1;
+	}
+	if(job->statted < 0 || !S_ISREG(job->info.stx_mode)){
+		endJob(loader, job, 1);
+		return 1;
+	}
+	job->length = job->info.stx_size;
+	job->data = malloc(job->length + 1);
+	if(job->data == NULL || job->length == 0){
+		endJob(loader, job, job->data == NULL);
+		return 1;
+	}
+	return readJob(loader->ring, job, id) ? 0 : -1;
+}
+
+/*
+ *
+ * name: abandonRing
+ *
+ * Gives up on a ring which has failed.  The opens it has completed are
+ * taken, the closes still queued are done here, and every file it was
+ * reading is closed, freed and read again with plain system calls.
+ *
+ * @param	loader	the loader
+ * @param	jobs	the ring's jobs
+ */
+static void abandonRing(fileLoader * loader, loadJob * jobs){
+	struct loadRing * ring = loader->ring;
+	struct io_uring_cqe * done;
+	struct io_uring_sqe * entry;
+	loadedFile file;
+	unsigned head, tail;
+	int i;
+
+	head = *ring->cqHead;
+	while(head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)){
+		done = &ring->cqes[head & *ring->cqMask];
+		if((done->user_data & 3) == OP_OPEN && done->res >= 0){
+			jobs[done->user_data >> 2].opened = done->res;
+		}
+		head++;
+	}
+	__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+	// the submissions never taken by the kernel are the last ones queued
+	tail = *ring->sqTail;
+	for(; ring->queued > 0; ring->queued--){
+		entry = &ring->sqes[ring->sqArray[(tail - ring->queued) & *ring->sqMask]];
+		if(entry->opcode == IORING_OP_CLOSE){
+			close(entry->fd);
+		}
+	}
+
+	for(i=0;i<LOAD_WINDOW;i++){
+		if(jobs[i].index >= 0){
+			if(jobs[i].opened >= 0){
+				close(jobs[i].opened);
+			}
+			free(jobs[i].data);
+			file.index = jobs[i].index;
+			readWhole(loader->files->names[file.index], &file);
+			publish(loader, &file);
+			jobs[i].index = -1;
+		}
+	}
+}
+
+/*
+ *
+ * name: ringFiles
+ *
+ * The body of the ring's thread, which keeps the window of files moving
+ * through the ring, waiting for completions whenever it has nothing to
+ * submit.  It only ends once the last files have been closed.  If the ring
+ * fails, the rest of the files are read one at a time.
+ *
+ * @param	data	the loader
+ * @return	NULL
+ */
+static void * ringFiles(void * data){
+	fileLoader * loader = data;
+	struct loadRing * ring = loader->ring;
+	struct io_uring_cqe * done;
+	loadJob jobs[LOAD_WINDOW];
+	unsigned head;
+	int active = 0, failed = 0;
+	int i, index, step;
+
+	for(i=0;i<LOAD_WINDOW;i++){
+		jobs[i].index = -1;
+	}
+	while(!failed){
+		// with closes still to be reaped there is no waiting for room
+		while(!failed && active < LOAD_WINDOW &&
+				(index = reserveFile(loader, active == 0 && ring->closing == 0)) >= 0){
+			for(i=0; jobs[i].index >= 0; i++);
+			failed = !startJob(loader, jobs, i, index);
+			active++;
+		}
+		if(failed || (active == 0 && ring->closing == 0)){
+			break;
+		}
+		if(!enterRing(ring, 1)){
+			failed = 1;
+			break;
+		}
+		head = *ring->cqHead;
+		while(!failed && head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)){
+			done = &ring->cqes[head & *ring->cqMask];
+			step = stepJob(loader, jobs, done->user_data, done->res);
+			failed = step < 0;
+			active -= failed ? 0 : step;
+			head++;
+		}
+		__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+	}
+	if(failed){
+		abandonRing(loader, jobs);
+		readFiles(loader);
+	}
+	return NULL;
+}
+
+/*
+ *
+ * name: startLoader
+ *
+ * Starts reading the files of a batch.  LOAD_URING falls back to reading
+ * threads if the kernel has no io_uring.
+ *
+ * @param	files	the files to read
+ * @param	kind	LOAD_URING or LOAD_THREADS
+ * @return	the loader, or NULL if it could not be started
+ */
+fileLoader * startLoader(fileList * files, int kind){
+	fileLoader * loader;
+	int threads;
+
+	loader = malloc(sizeof(fileLoader));
+	if(loader == NULL){
+		return NULL;
+	}
+	loader->files = files;
+	loader->ring = kind == LOAD_URING ? openRing(4 * LOAD_WINDOW) : NULL;
+	loader->kind = loader->ring != NULL ? LOAD_URING : LOAD_THREADS;
+	loader->first = 0;
+	loader->count = 0;
+	loader->next = 0;
+	loader->held = 0;
+	loader->taken = 0;
+	loader->stop = 0;
+	pthread_mutex_init(&loader->lock, NULL);
+	pthread_cond_init(&loader->changed, NULL);
+
+	threads = loader->kind == LOAD_URING ? 1 : LOAD_READERS;
+	for(loader->started=0; loader->started < threads; loader->started++){
+		if(pthread_create(&loader->threads[loader->started], NULL,
+				loader->kind == LOAD_URING ? ringFiles : readFiles, loader) != 0){
+			break;
+		}
+	}
+	if(loader->started == 0){
+		stopLoader(loader);
+		return NULL;
+	}
+	return loader;
+}
+
+/*
+ *
+ * name: nextLoaded
+ *
+ * Takes the next file to be read in full, waiting for one if need be.  The
+ * text is the taker's to free.
+ *
+ * @param	loader	the loader
+ * @param	file	filled in with the file
+ * @return	1 if a file was taken, 0 once every file has been
+ */
+int nextLoaded(fileLoader * loader, loadedFile * file){
+	pthread_mutex_lock(&loader->lock);
+	while(loader->count == 0 && loader->taken < loader->files->count && !loader->stop){
+		pthread_cond_wait(&loader->changed, &loader->lock);
+	}
+	if(loader->count == 0){
+		pthread_mutex_unlock(&loader->lock);
+		return 0;
+	}
+	*file = loader->ready[loader->first];
+	loader->first = (loader->first + 1) % LOAD_WINDOW;
+	loader->count--;
+	loader->held--;
+	loader->taken++;
+	pthread_cond_broadcast(&loader->changed);
+	pthread_mutex_unlock(&loader->lock);
+	return 1;
+}
+
+/*
+ *
+ * name: stopLoader
+ *
+ * Stops the loader's threads and releases everything it holds, including
+ * any files read but not taken.
+ *
+ * @param	loader	the loader to stop
+ */
+void stopLoader(fileLoader * loader){
+	int i;
+
+	pthread_mutex_lock(&loader->lock);
+	loader->stop = 1;
+	pthread_cond_broadcast(&loader->changed);
+	pthread_mutex_unlock(&loader->lock);
+	for(i=0;i<loader->started;i++){
+		pthread_join(loader->threads[i], NULL);
+	}
+	for(i=0;i<loader->count;i++){
+		free(loader->ready[(loader->first + i) % LOAD_WINDOW].data);
+	}
+	if(loader->ring != NULL){
+		closeRing(loader->ring);
+	}
+	pthread_mutex_destroy(&loader->lock);
+	pthread_cond_destroy(&loader->changed);
+	free(loader);
+}
@@ -0,0 +1,49 @@
+/*
+ *      loader.h
+ *
+ * This file contains the batch file loader, which reads whole files into
+ * memory ahead of the threads parsing them.
+ *
+ */
+
+#ifndef loader_h
+#define loader_h
+
+#include <pthread.h>
+
+#include "config.h"
+#include "batch.h"
+
+// how the files of a batch are read
+enum {LOAD_MAP, LOAD_URING, LOAD_THREADS};
+
+// a file read into memory, or the error which stopped it being read
+typedef struct{
+	int index;
+	char * data;
+	long length;
+	int error;
+} loadedFile;
+
+typedef struct{
+	fileList * files;
+	int kind;
+	struct loadRing * ring;
+	pthread_t threads[LOAD_READERS];
+	int started;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	loadedFile ready[LOAD_WINDOW];
+	int first;
+	int count;
+	int next;
+	int held;
+	int taken;
+	int stop;
+} fileLoader;
+
+fileLoader * startLoader(fileList *, int);
+int nextLoaded(fileLoader *, loadedFile *);
+void stopLoader(fileLoader *);
+
+#endif
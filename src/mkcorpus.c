@@ -0,0 +1,144 @@
+/*
+ *      mkcorpus.c
+ *
+ * Packs many sources into one corpus container, which the parser checks with
+ * --corpus.
+ *
+ * Input: The name of the container to write, followed by the sources to pack.
+ * 	If no sources are given their names are read from stdin, one to a line.
+ *
+ * Output: the container, laid out as described in corpus.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+
+/*
+ *
+ * name: writeNumber
+ *
+ * Writes a little endian number of the container.
+ *
+ * @param	out	the container
+ * @param	value	the number
+ * @param	bytes	the number of bytes
+ */
+static void writeNumber(FILE * out, unsigned long long value, int bytes){
+	while(bytes-- > 0){
+		fputc(value & 0xff, out);
+		value >>= 8;
+	}
+}
+
+/*
+ *
+ * name: packFile
+ *
+ * Appends one source to the container as a record.
+ *
+ * @param	out	the container
+ * @param	name	the name of the source
+ * @return	1 if successful, 0 if the source could not be read
+ */
+static int packFile(FILE * out, const char * name){
+	char block[65536];
+	FILE * in;
+	long start, length;
+	size_t got;
+
+	in = fopen(name, "rb");
+	if(in == NULL){
+		return 0;
+	}
+	writeNumber(out, strlen(name), 4);
+	fputs(name, out);
+	start = ftell(out);
+	writeNumber(out, 0, 8);
+	length = 0;
+	while((got = fread(block, 1, sizeof(block), in)) > 0){
+		fwrite(block, 1, got, out);
+		length += got;
+	}
+	fclose(in);
+
+	// the length is only known once the text is written
+	fseek(out, start, SEEK_SET);
+	writeNumber(out, length, 8);
+	fseek(out, 0, SEEK_END);
+	return 1;
+}
+
+int main(int argc, char** argv){
+	unsigned long long * offsets = NULL;
+	unsigned long long * bigger;
+	long count = 0, capacity = 0, index;
+	char * line = NULL;
+	size_t size = 0;
+	const char * name;
+	FILE * out;
+	int i = 2;
+
+	if(argc < 2){
+		fprintf(stderr, "usage: %s container [sources...]\n", argv[0]);
+		return 1;
+	}
+	out = fopen(argv[1], "wb");
+	if(out == NULL){
+		fprintf(stderr, "Could not create %s\n", argv[1]);
+		return 1;
+	}
+	fwrite(CORPUS_MAGIC, 1, 8, out);
+	writeNumber(out, 0, 16);
+
+	while(1){
+		if(argc > 2){
+			if(i == argc){
+				break;
+			}
+			name = argv[i++];
+		}
+		else{
+			if(getline(&line, &size, stdin) < 0){
+				break;
+			}
+			line[strcspn(line, "\r\n")] = '\0';
+			if(line[0] == '\0'){
+				continue;
+			}
+			name = line;
+		}
+		if(count == capacity){
+			capacity = capacity ? capacity * 2 : 1024;
+			bigger = realloc(offsets, capacity * sizeof(unsigned long long));
+			if(bigger == NULL){
+				fprintf(stderr, "Out of memory\n");
+				return 1;
+			}
+			offsets = bigger;
+		}
+		offsets[count] = ftell(out);
+		if(!packFile(out, name)){
+			fprintf(stderr, "Could not read %s\n", name);
+			return 1;
+		}
+		count++;
+	}
+
+	index = ftell(out);
+	for(i=0;i<count;i++){
+		writeNumber(out, offsets[i], 8);
+	}
+	fseek(out, 8, SEEK_SET);
+	writeNumber(out, count, 8);
+	writeNumber(out, index, 8);
+	free(offsets);
+	free(line);
+	if(fclose(out) != 0){
+		fprintf(stderr, "Could not write %s\n", argv[1]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,393 @@
+/*
+ *      output.c
+ *
+ * This file contains the output sink everything the parser prints goes
+ * through.  Output is gathered into blocks of OUTPUT_BLOCK characters and
+ * written with a single writev, so stdio's locking and buffering are kept
+ * off the path of every line.  Long lines of a mapped source are not even
+ * copied, their pieces simply point into the source.
+ *
+ * A buffered sink writes each block itself.  A threaded sink hands the block
+ * to a writer thread and carries on filling a second one.  A null sink
+ * throws everything away without formatting it.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "output.h"
+
+// shared text shorter than this is cheaper to copy than to give a piece
+#define SHARE_MIN 64
+
+// the room sinkPrintf() makes sure of before formatting
+#define PRINT_ROOM 256
+
+/*
+ *
+ * name: writeBatch
+ *
+ * Writes all of a batch, carrying on after short writes, and empties it.
+ *
+ * @param	fd	the descriptor to write to
+ * @param	batch	the batch to write
+ */
+static void writeBatch(int fd, outputBatch * batch){
+	struct iovec * piece = batch->pieces;
+	int left = batch->count;
+	ssize_t wrote;
+
+	while(left > 0){
+		wrote = writev(fd, piece, left);
+		if(wrote < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			break;
+		}
+		while(left > 0 && (size_t)wrote >= piece->iov_len){
+			wrote -= piece->iov_len;
+			piece++;
+			left--;
+		}
+		if(left > 0){
+			piece->iov_base = (char *)piece->iov_base + wrote;
+			piece->iov_len -= wrote;
+		}
+	}
+	batch->used = 0;
+	batch->count = 0;
+}
+
+/*
+ *
+ * name: writeOutput
+ *
+ * The body of the writer thread, which writes each batch it is handed until
+ * the sink is closed.
+ *
+ * @param	data	the sink to write for
+ * @return	NULL
+ */
+static void * writeOutput(void * data){
+	outputSink * sink = data;
+	outputBatch * batch;
+
+	pthread_mutex_lock(&sink->lock);
+	while(1){
+		while(sink->pending == NULL && !sink->closing){
+			pthread_cond_wait(&sink->changed, &sink->lock);
+		}
+		if(sink->pending == NULL){
+			break;
+		}
+		batch = sink->pending;
+		pthread_mutex_unlock(&sink->lock);
+		writeBatch(sink->fd, batch);
+		pthread_mutex_lock(&sink->lock);
+		sink->pending = NULL;
+		pthread_cond_broadcast(&sink->changed);
+	}
+	pthread_mutex_unlock(&sink->lock);
+	return NULL;
+}
+
+/*
+ *
+ * name: initSink
+ *
+ * Prepares a sink of the given kind.
+ *
+ * @param	sink	the sink to prepare
+ * @param	kind	SINK_BUFFERED, SINK_THREAD or SINK_NULL
+ * @param	fd	the descriptor to write to
+ * @return	1 if successful, 0 if out of memory
+ */
+int initSink(outputSink * sink, int kind, int fd){
+	int i;
+
+	sink->kind = kind;
+	sink->fd = fd;
+	sink->pending = NULL;
+	sink->closing = 0;
+	for(i=0;i<2;i++){
+		sink->batches[i].buffer = NULL;
+		sink->batches[i].used = 0;
+		sink->batches[i].count = 0;
+	}
+	sink->filling = &sink->batches[0];
+	if(kind == SINK_NULL){
+		return 1;
+	}
+
+	for(i=0; i < (kind == SINK_THREAD ? 2 : 1); i++){
+		sink->batches[i].buffer = malloc(OUTPUT_BLOCK);
+		if(sink->batches[i].buffer == NULL){
+			return 0;
+		}
+	}
+	if(kind == SINK_THREAD){
+		pthread_mutex_init(&sink->lock, NULL);
+		pthread_cond_init(&sink->changed, NULL);
+		if(pthread_create(&sink->thread, NULL, writeOutput, sink) != 0){
+			// write from this thread instead
+			sink->kind = SINK_BUFFERED;
+		}
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: handOff
+ *
+ * Sends the batch being filled to be written, and starts an empty one.  A
+ * threaded sink only waits if the writer is still busy with the last batch.
+ *
+ * @param	sink	the sink to send from
+ */
+static void handOff(outputSink * sink){
+	if(sink->filling->count == 0){
+		return;
+	}
+	if(sink->kind != SINK_THREAD){
+		writeBatch(sink->fd, sink->filling);
+		return;
+	}
+
+	pthread_mutex_lock(&sink->lock);
+	while(sink->pending != NULL){
+		pthread_cond_wait(&sink->changed, &sink->lock);
+	}
+	sink->pending = sink->filling;
+	pthread_cond_broadcast(&sink->changed);
+	pthread_mutex_unlock(&sink->lock);
+
+	sink->filling = (sink->filling == &sink->batches[0]) ?
+			&sink->batches[1] : &sink->batches[0];
+}
+
+/*
+ *
+ * name: addPiece
+ *
+ * Adds a piece to the batch being filled, joining it to the last piece when
+ * the two are side by side.
+ *
+ * @param	sink	the sink to add to
+ * @param	text	the start of the piece
+ * @param	length	the length of the piece
+ */
+static void addPiece(outputSink * sink, const char * text, long length){
+	outputBatch * batch = sink->filling;
+	struct iovec * last;
+
+	if(batch->count > 0){
+		last = &batch->pieces[batch->count - 1];
+		if((char *)last->iov_base + last->iov_len == text){
+			last->iov_len += length;
+			return;
+		}
+	}
+	if(batch->count == OUTPUT_PIECES){
+		handOff(sink);
+		batch = sink->filling;
+	}
+	batch->pieces[batch->count].iov_base = (void *)text;
+	batch->pieces[batch->count].iov_len = length;
+	batch->count++;
+}
+
+/*
+ *
+ * name: sinkWrite
+ *
+ * Copies text into the sink.
+ *
+ * @param	sink	the sink to write to
+ * @param	text	the text to write
+ * @param	length	the length of the text
+ */
+void sinkWrite(outputSink * sink, const char * text, long length){
+	outputBatch * batch;
+	long room;
+
+	if(sinkQuiet(sink)){
+		return;
+	}
+	while(length > 0){
+		batch = sink->filling;
+		room = OUTPUT_BLOCK - batch->used;
+		if(room == 0 || batch->count == OUTPUT_PIECES){
+			handOff(sink);
+			continue;
+		}
+		if(room > length){
+			room = length;
+		}
+		memcpy(batch->buffer + batch->used, text, room);
+		addPiece(sink, batch->buffer + batch->used, room);
+		batch->used += room;
+		text += room;
+		length -= room;
+	}
+}
+
+/*
+ *
+ * name: sinkShare
+ *
+ * Writes text without copying it.  The text must stay as it is until the
+ * next sinkFlush(), so this is only for text such as a mapped source.
+ *
+ * @param	sink	the sink to write to
+ * @param	text	the text to write
+ * @param	length	the length of the text
+ */
+void sinkShare(outputSink * sink, const char * text, long length){
+	if(length < SHARE_MIN){
+		sinkWrite(sink, text, length);
+	}
+	else if(!sinkQuiet(sink)){
+		addPiece(sink, text, length);
+	}
+}
+
+/*
+ *
+ * name: sinkPrintf
+ *
+ * Formats text into the sink as printf() would.  Nothing is formatted for a
+ * null sink.  A single call writes at most OUTPUT_BLOCK characters.
+ *
+ * @param	sink	the sink to write to
+ * @param	format	the printf() format
+ */
+void sinkPrintf(outputSink * sink, const char * format, ...){
+	outputBatch * batch;
+	va_list args;
+	long room;
+	int length;
+
+	if(sinkQuiet(sink)){
+		return;
+	}
+	batch = sink->filling;
+	if(OUTPUT_BLOCK - batch->used < PRINT_ROOM || batch->count == OUTPUT_PIECES){
+		handOff(sink);
+		batch = sink->filling;
+	}
+	room = OUTPUT_BLOCK - batch->used;
+	va_start(args, format);
+	length = vsnprintf(batch->buffer + batch->used, room, format, args);
+	va_end(args);
+	if(length >= room && batch->used > 0){
+		// too long for what was left, so start an empty block and try again
+		handOff(sink);
+		batch = sink->filling;
+		room = OUTPUT_BLOCK;
+		va_start(args, format);
+		length = vsnprintf(batch->buffer, room, format, args);
+		va_end(args);
+	}
+	if(length >= room){
+		length = room - 1;
+	}
+	if(length > 0){
+		addPiece(sink, batch->buffer + batch->used, length);
+		batch->used += length;
+	}
+}
+
+/*
+ *
+ * name: sinkLine
+ *
+ * Writes a numbered line of the source as the listing shows it.
+ *
+ * @param	sink	the sink to write to
+ * @param	number	the number of the line
+ * @param	text	the text of the line
+ * @param	length	the length of the line
+ * @param	shared	true if the text stays put until the next flush
+ */
+void sinkLine(outputSink * sink, int number, const char * text, long length,
+		int shared){
+	char head[16];
+	char * digit = head + sizeof(head);
+	unsigned int n = number;
+
+	if(sinkQuiet(sink)){
+		return;
+	}
+	*--digit = ' ';
+	*--digit = ':';
+	*--digit = '\t';
+	do{
+		*--digit = '0' + n % 10;
+		n /= 10;
+	}while(n > 0);
+	*--digit = '\n';
+	sinkWrite(sink, digit, head + sizeof(head) - digit);
+	if(shared){
+		sinkShare(sink, text, length);
+	}
+	else{
+		sinkWrite(sink, text, length);
+	}
+}
+
+/*
+ *
+ * name: sinkFlush
+ *
+ * Writes everything sent to the sink so far, and waits until it has been
+ * written.  Shared text may be released after this.
+ *
+ * @param	sink	the sink to flush
+ */
+void sinkFlush(outputSink * sink){
+	if(sinkQuiet(sink)){
+		return;
+	}
+	handOff(sink);
+	if(sink->kind == SINK_THREAD){
+		pthread_mutex_lock(&sink->lock);
+		while(sink->pending != NULL){
+			pthread_cond_wait(&sink->changed, &sink->lock);
+		}
+		pthread_mutex_unlock(&sink->lock);
+	}
+}
+
+/*
+ *
+ * name: closeSink
+ *
+ * Flushes the sink and releases everything it holds, stopping its writer
+ * thread if it has one.
+ *
+ * @param	sink	the sink to close
+ */
+void closeSink(outputSink * sink){
+	sinkFlush(sink);
+	if(sink->kind == SINK_THREAD){
+		pthread_mutex_lock(&sink->lock);
+		sink->closing = 1;
+		pthread_cond_broadcast(&sink->changed);
+		pthread_mutex_unlock(&sink->lock);
+		pthread_join(sink->thread, NULL);
+		pthread_mutex_destroy(&sink->lock);
+		pthread_cond_destroy(&sink->changed);
+	}
+	free(sink->batches[0].buffer);
+	free(sink->batches[1].buffer);
+	sink->batches[0].buffer = NULL;
+	sink->batches[1].buffer = NULL;
+}
@@ -0,0 +1,54 @@
+/*
+ *      output.h
+ *
+ * This file contains the output sink everything the parser prints goes
+ * through.  Output is gathered into large blocks and written with writev,
+ * either directly or by a writer thread, or thrown away altogether.
+ *
+ */
+
+#ifndef output_h
+#define output_h
+
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "config.h"
+
+// the kinds of sink
+enum {SINK_BUFFERED, SINK_THREAD, SINK_NULL};
+
+// a block of output waiting to be written.  Its pieces are either copied
+// into the buffer or point at text which is shared until the next flush.
+typedef struct{
+	char * buffer;
+	long used;
+	struct iovec pieces[OUTPUT_PIECES];
+	int count;
+} outputBatch;
+
+typedef struct{
+	int kind;
+	int fd;
+	outputBatch batches[2];
+	outputBatch * filling;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	outputBatch * pending;
+	int closing;
+} outputSink;
+
+// true when nothing sent to the sink will be written
+#define sinkQuiet(sink) ((sink)->kind == SINK_NULL)
+
+int initSink(outputSink *, int, int);
+void sinkWrite(outputSink *, const char *, long);
+void sinkShare(outputSink *, const char *, long);
+void sinkPrintf(outputSink *, const char *, ...)
+	__attribute__((format(printf, 2, 3)));
+void sinkLine(outputSink *, int, const char *, long, int);
+void sinkFlush(outputSink *);
+void closeSink(outputSink *);
+
+#endif
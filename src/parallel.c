@@ -0,0 +1,489 @@
+/*
+ *      parallel.c
+ *
+ * This file contains the parallel scanner.  A mapped source is split at line
+ * boundaries into pieces of about LEX_CHUNK characters, and worker threads
+ * scan the pieces while the parser takes the tokens of those before them.
+ *
+ * No token spans a line, so the only thing a piece needs from the one before
+ * it is whether it starts inside a comment.  That is not known until the
+ * piece before has been scanned, so every piece but the first is scanned
+ * both ways.  The scan from inside a comment is stopped at the end of the
+ * first line where both scans are in the same state, as from there on they
+ * must agree.  The parser then takes the pieces in order, picking the right
+ * scan of each from the state the last one ended in, so the tokens are just
+ * those the sequential scanner would give.
+ *
+ * Only LEX_WINDOW pieces per worker are held at once, so memory stays
+ * bounded however long the source is.  As with the pipeline, the workers
+ * neither print nor intern, the parser does both as it takes each token.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "line.h"
+#include "source.h"
+#include "arena.h"
+#include "hasher.h"
+#include "lexer.h"
+#include "util.h"
+#include "scanner.h"
+#include "parallel.h"
+
+/*
+ *
+ * name: pushToken
+ *
+ * Adds a token to the end of a list, growing it as needed.
+ *
+ * @param	list	the list to add to
+ * @param	item	the token to add
+ * @return	1 if successful, 0 if out of memory
+ */
+static int pushToken(tokenList * list, const token * item){
+	token * bigger;
+
+	if(list->count == list->capacity){
+		bigger = realloc(list->items,
+				(list->capacity ? list->capacity * 2 : 1024) * sizeof(token));
+		if(bigger == NULL){
+			return 0;
+		}
+		list->items = bigger;
+		list->capacity = list->capacity ? list->capacity * 2 : 1024;
+	}
+	list->items[list->count++] = *item;
+	return 1;
+}
+
+/*
+ *
+ * name: pushLine
+ *
+ * Adds a line number to the end of a list, growing it as needed.
+ *
+ * @param	list	the list to add to
+ * @param	lineNumber	the line number to add
+ * @return	1 if successful, 0 if out of memory
+ */
+static int pushLine(lineList * list, int lineNumber){
+	int * bigger;
+
+	if(list->count == list->capacity){
+		bigger = realloc(list->lines,
+				(list->capacity ? list->capacity * 2 : 64) * sizeof(int));
+		if(bigger == NULL){
+			return 0;
+		}
+		list->lines = bigger;
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+	}
+	list->lines[list->count++] = lineNumber;
+	return 1;
+}
+
+/*
+ *
+ * name: freeList
+ *
+ * Releases the tokens held by a list.
+ *
+ * @param	list	the list to empty
+ */
+static void freeList(tokenList * list){
+	free(list->items);
+	list->items = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+/*
+ *
+ * name: firstAfter
+ *
+ * Finds the first token of a list which lies on a later line than the one
+ * given.  The tokens are in order, so this is a binary search.
+ *
+ * @param	list	the list to search
+ * @param	lineNumber	the line within the piece
+ * @return	the index of the token
+ */
+static long firstAfter(tokenList * list, int lineNumber){
+	long low = 0;
+	long high = list->count;
+	long middle;
+
+	while(low < high){
+		middle = (low + high) / 2;
+		if(tokenLine(list->items[middle]) > lineNumber){
+			high = middle;
+		}
+		else{
+			low = middle + 1;
+		}
+	}
+	return low;
+}
+
+/*
+ *
+ * name: scanPiece
+ *
+ * Scans a piece of the source from the given state.  Scanning from outside
+ * a comment records the lines which end inside one.  Scanning from inside a
+ * comment checks those at the end of each line, and stops once the two
+ * scans are in the same state.
+ *
+ * @param	lexer	the parallel scanner
+ * @param	piece	the piece to scan
+ * @param	state	S_START or S_COMMENT
+ * @param	comments	the lines ending inside a comment, filled when
+ * 	scanning from outside and checked when scanning from inside
+ * @return	1 if successful, 0 if out of memory or stopped
+ */
+static int scanPiece(splitLexer * lexer, lexChunk * piece, int state,
+		lineList * comments){
+	int last = (piece == &lexer->chunks[lexer->count - 1]);
+	int outside = (state == S_START);
+	tokenList * list = outside ? &piece->outside : &piece->inside;
+	sourceBuffer view;
+	line scan;
+	token item;
+	long checked = 0;
+	int other;
+
+	// the piece is read as a source of its own, which keeps the offsets of
+	// the whole file
+	view = *lexer->input;
+	view.data = lexer->input->data + piece->start;
+	view.base = piece->start;
+	view.length = piece->length;
+	initLine(&scan, &view);
+	scan.lexState = state;
+
+	while(1){
+		while(lineToken(&item, &scan, lexer->keywords)){
+			if(!pushToken(list, &item)){
+				return 0;
+			}
+		}
+		if(scan.atEOF){
+			// only the last piece holds the end of the source
+			if(last && !pushToken(list, &item)){
+				return 0;
+			}
+			break;
+		}
+
+		if(scan.lineNumber > 0){
+			if(outside){
+				if(scan.lexState == S_COMMENT && !pushLine(comments, scan.lineNumber)){
+					return 0;
+				}
+			}
+			else{
+				while(checked < comments->count && comments->lines[checked] < scan.lineNumber){
+					checked++;
+				}
+				other = (checked < comments->count &&
+						comments->lines[checked] == scan.lineNumber) ? S_COMMENT : S_START;
+				if(other == scan.lexState){
+					piece->joined = firstAfter(&piece->outside, scan.lineNumber);
+					return 1;
+				}
+			}
+		}
+		if(atomic_load_explicit(&lexer->stop, memory_order_relaxed)){
+			return 0;
+		}
+		getLine(&scan);
+	}
+	piece->endState[outside ? 0 : 1] = scan.lexState;
+	piece->lines = scan.lineNumber;
+	return 1;
+}
+
+/*
+ *
+ * name: scanPieces
+ *
+ * The body of a worker thread, which takes the next piece to be scanned
+ * until there are none left.  A worker waits rather than run more than
+ * the window ahead of the parser.
+ *
+ * @param	data	the parallel scanner
+ * @return	NULL
+ */
+static void * scanPieces(void * data){
+	splitLexer * lexer = data;
+	lineList comments = {NULL, 0, 0};
+	lexChunk * piece;
+	int ok;
+
+	while(1){
+		pthread_mutex_lock(&lexer->lock);
+		while(lexer->next < lexer->count && lexer->next >= lexer->consumed + lexer->window &&
+				!atomic_load(&lexer->stop)){
+			pthread_cond_wait(&lexer->changed, &lexer->lock);
+		}
+		if(lexer->next == lexer->count || atomic_load(&lexer->stop)){
+			pthread_mutex_unlock(&lexer->lock);
+			break;
+		}
+		piece = &lexer->chunks[lexer->next++];
+		pthread_mutex_unlock(&lexer->lock);
+
+		// the first piece is known to start outside a comment
+		comments.count = 0;
+		ok = scanPiece(lexer, piece, S_START, &comments);
+		if(ok && piece != lexer->chunks){
+			ok = scanPiece(lexer, piece, S_COMMENT, &comments);
+		}
+
+		pthread_mutex_lock(&lexer->lock);
+		piece->failed = !ok;
+		piece->done = 1;
+		pthread_cond_broadcast(&lexer->changed);
+		pthread_mutex_unlock(&lexer->lock);
+	}
+	free(comments.lines);
+	return NULL;
+}
+
+/*
+ *
+ * name: startParallel
+ *
+ * Splits a mapped source into pieces and starts the given number of worker
+ * threads scanning them.
+ *
+ * @param	memory	the arena to allocate from
+ * @param	input	the mapped source to be scanned
+ * @param	keywords	the lookup table for reserved words
+ * @param	workers	the number of worker threads
+ * @return	the parallel scanner to take tokens from, NULL if the source
+ * 	cannot be split and should be scanned directly
+ */
+splitLexer * startParallel(arena * memory, sourceBuffer * input,
+		const keywordTable * keywords, int workers){
+	splitLexer * lexer;
+	const char * found;
+	long start, end;
+	int i;
+
+	if(!input->mapped || workers < 1){
+		return NULL;
+	}
+	lexer = arenaAlloc(memory, sizeof(splitLexer));
+	if(lexer == NULL){
+		return NULL;
+	}
+	lexer->count = (input->length + LEX_CHUNK - 1) / LEX_CHUNK;
+	lexer->chunks = arenaCalloc(memory, lexer->count * sizeof(lexChunk));
+	lexer->workers = arenaAlloc(memory, workers * sizeof(pthread_t));
+	if(lexer->chunks == NULL || lexer->workers == NULL){
+		return NULL;
+	}
+
+	// each piece ends just after the first newline LEX_CHUNK characters on
+	for(i=0, start=0; start < input->length; i++, start=end){
+		end = start + LEX_CHUNK;
+		if(end >= input->length){
+			end = input->length;
+		}
+		else{
+			found = memchr(input->data + end - 1, '\n', input->length - end + 1);
+			end = (found == NULL) ? input->length : found - input->data + 1;
+		}
+		lexer->chunks[i].start = start;
+		lexer->chunks[i].length = end - start;
+		lexer->chunks[i].joined = -1;
+	}
+	lexer->count = i;
+
+	lexer->input = input;
+	lexer->keywords = keywords;
+	lexer->next = 0;
+	lexer->consumed = 0;
+	lexer->window = workers * LEX_WINDOW;
+	atomic_init(&lexer->stop, 0);
+	lexer->chunk = -1;
+	lexer->items = NULL;
+	lexer->itemCount = 0;
+	lexer->index = 0;
+	lexer->rest = NULL;
+	lexer->restCount = 0;
+	lexer->lineBase = 0;
+	lexer->state = S_START;
+	lexer->finished = 0;
+	lexer->failed = 0;
+	pthread_mutex_init(&lexer->lock, NULL);
+	pthread_cond_init(&lexer->changed, NULL);
+
+	initKernels();
+	for(lexer->started=0; lexer->started < workers; lexer->started++){
+		if(pthread_create(&lexer->workers[lexer->started], NULL, scanPieces, lexer) != 0){
+			break;
+		}
+	}
+	if(lexer->started == 0){
+		pthread_mutex_destroy(&lexer->lock);
+		pthread_cond_destroy(&lexer->changed);
+		return NULL;
+	}
+	return lexer;
+}
+
+/*
+ *
+ * name: nextPiece
+ *
+ * Releases the piece the parser has finished with and moves on to the next,
+ * waiting for it to be scanned.  The scan of it which started in the state
+ * the last piece ended in is the one taken.
+ *
+ * @param	lexer	the parallel scanner
+ * @return	1 if successful, 0 if the piece could not be scanned
+ */
+static int nextPiece(splitLexer * lexer){
+	lexChunk * piece;
+
+	if(lexer->chunk >= 0){
+		piece = &lexer->chunks[lexer->chunk];
+		if(lexer->state == S_COMMENT && piece->joined < 0){
+			lexer->state = piece->endState[1];
+		}
+		else{
+			lexer->state = piece->endState[0];
+		}
+		lexer->lineBase += piece->lines;
+		freeList(&piece->outside);
+		freeList(&piece->inside);
+	}
+
+	pthread_mutex_lock(&lexer->lock);
+	if(lexer->chunk >= 0){
+		lexer->consumed++;
+		pthread_cond_broadcast(&lexer->changed);
+	}
+	lexer->chunk++;
+	piece = &lexer->chunks[lexer->chunk];
+	while(!piece->done){
+		pthread_cond_wait(&lexer->changed, &lexer->lock);
+	}
+	pthread_mutex_unlock(&lexer->lock);
+
+	if(piece->failed){
+		return 0;
+	}
+	lexer->index = 0;
+	if(lexer->state == S_START){
+		lexer->items = piece->outside.items;
+		lexer->itemCount = piece->outside.count;
+		lexer->rest = NULL;
+	}
+	else{
+		lexer->items = piece->inside.items;
+		lexer->itemCount = piece->inside.count;
+		if(piece->joined >= 0){
+			lexer->rest = piece->outside.items + piece->joined;
+			lexer->restCount = piece->outside.count - piece->joined;
+		}
+		else{
+			lexer->rest = NULL;
+		}
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: takeToken
+ *
+ * Takes the next token, waiting for its piece to be scanned if need be.
+ * Its line number is made relative to the whole file, and the lines up to
+ * it are printed and its name interned, as getToken() would have done.
+ * Once the end of the source is reached it is returned again for every
+ * later call.  If a piece could not be scanned, for want of memory, the
+ * tokens end there and the lexer is marked failed, so the parser can tell
+ * that from a source cut short.
+ *
+ * @param	lexer	the parallel scanner
+ * @param	current	the line the parser prints from
+ * @param	symbols	the symbol table variables are interned into
+ * @return	the token read
+ */
+token takeToken(splitLexer * lexer, line * current, symbolTable * symbols){
+	token item;
+
+	if(lexer->finished){
+		return lexer->last;
+	}
+	while(lexer->index == lexer->itemCount){
+		if(lexer->rest != NULL){
+			lexer->items = lexer->rest;
+			lexer->itemCount = lexer->restCount;
+			lexer->index = 0;
+			lexer->rest = NULL;
+		}
+		else if(lexer->chunk + 1 == lexer->count || !nextPiece(lexer)){
+			// the end of what could be scanned
+			lexer->failed = lexer->chunk + 1 < lexer->count ||
+					lexer->chunks[lexer->chunk].failed;
+			item.code = ID;
+			item.error = lexer->failed ? NO_ERROR : BAD_VARIABLE;
+			item.length = 0;
+			item.offset = lexer->chunks[lexer->chunk].start;
+			item.position = packPosition(lexer->lineBase + 1, 1);
+			item.value = 0;
+			item.symbol = -1;
+			lexer->finished = 1;
+			lexer->last = item;
+			return item;
+		}
+	}
+
+	item = lexer->items[lexer->index++];
+	item.position += (unsigned long long)lexer->lineBase << COLUMN_BITS;
+	while(!current->atEOF && current->offset + current->length <= item.offset){
+		getLine(current);
+	}
+	internToken(&item, current->source, symbols);
+	if(item.length == 0){
+		lexer->finished = 1;
+		lexer->last = item;
+	}
+	return item;
+}
+
+/*
+ *
+ * name: stopParallel
+ *
+ * Stops the worker threads, which may still be scanning if the parse
+ * failed, waits for them to finish and releases the tokens still held.
+ *
+ * @param	lexer	the parallel scanner to stop
+ */
+void stopParallel(splitLexer * lexer){
+	int i;
+
+	pthread_mutex_lock(&lexer->lock);
+	atomic_store(&lexer->stop, 1);
+	pthread_cond_broadcast(&lexer->changed);
+	pthread_mutex_unlock(&lexer->lock);
+	for(i=0;i<lexer->started;i++){
+		pthread_join(lexer->workers[i], NULL);
+	}
+	for(i=0;i<lexer->count;i++){
+		freeList(&lexer->chunks[i].outside);
+		freeList(&lexer->chunks[i].inside);
+	}
+	pthread_mutex_destroy(&lexer->lock);
+	pthread_cond_destroy(&lexer->changed);
+}
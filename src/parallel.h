@@ -0,0 +1,81 @@
+/*
+ *      parallel.h
+ *
+ * This file contains the parallel scanner, which splits a mapped source at
+ * line boundaries and scans the pieces on several threads at once.
+ *
+ */
+
+#ifndef parallel_h
+#define parallel_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "line.h"
+#include "source.h"
+#include "arena.h"
+#include "hasher.h"
+
+// a growing array of tokens
+typedef struct{
+	token * items;
+	long count;
+	long capacity;
+} tokenList;
+
+// a growing array of line numbers
+typedef struct{
+	int * lines;
+	long count;
+	long capacity;
+} lineList;
+
+// a piece of the source of about LEX_CHUNK characters, scanned both as if it
+// started outside a comment and as if it started inside one.  The second
+// scan stops where the two agree, and carries on with the first from joined.
+typedef struct{
+	long start;
+	long length;
+	tokenList outside;
+	tokenList inside;
+	long joined;
+	int endState[2];
+	int lines;
+	int failed;
+	int done;
+} lexChunk;
+
+typedef struct{
+	sourceBuffer * input;
+	const keywordTable * keywords;
+	lexChunk * chunks;
+	int count;
+	int next;
+	int consumed;
+	int window;
+	atomic_int stop;
+	pthread_t * workers;
+	int started;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int chunk;
+	const token * items;
+	long itemCount;
+	long index;
+	const token * rest;
+	long restCount;
+	int lineBase;
+	int state;
+	int finished;
+	int failed;
+	token last;
+} splitLexer;
+
+splitLexer * startParallel(arena *, sourceBuffer *, const keywordTable *, int);
+token takeToken(splitLexer *, line *, symbolTable *);
+void stopParallel(splitLexer *);
+
+#endif
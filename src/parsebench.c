@@ -0,0 +1,268 @@
+/*
+ *      parsebench.c
+ *
+ * A benchmark of the whole parser.  Each engine, that is the plain, the
+ * pipelined or the split scanner with each version of the SIMD kernels, the
+ * plain scanner with the table driven parser, or the plain scanner with the
+ * syntax tree kept, is run in a child process
+ * of its own so the kernels can be chosen afresh and its peak memory
+ * measured alone.  Each phase is timed separately: mapping
+ * the source, scanning it to the end, parsing it and closing it.  The best
+ * time of several passes is kept.  A source with errors is parsed to the end
+ * all the same, so it is timed as any other.
+ *
+ * Input: A file containing a program source written in SPS, such as one
+ * 	made by spsgen, and optionally the number of passes to make over it.
+ *
+ * Output: A line for each engine with the scanner's bytes and tokens per
+ * 	second, the time of each phase, the errors found and the peak resident
+ * 	memory, then what keeping the syntax tree adds to the parse.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "source.h"
+#include "hasher.h"
+#include "output.h"
+#include "session.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "grammar.h"
+
+// the ways the source can be scanned
+enum {ENGINE_PLAIN, ENGINE_PIPELINE, ENGINE_PARALLEL};
+
+typedef struct{
+	const char * name;
+	int engine;
+	int workers;
+	int grammar;
+	int keepTree;
+} benchEngine;
+
+// the plain engine comes first and the plain one keeping the tree second, as
+// the overhead of the tree is worked out from the two
+static const benchEngine engines[] = {
+	{"plain", ENGINE_PLAIN, 0, ENGINE_DESCENT, 0},
+	{"plain tree", ENGINE_PLAIN, 0, ENGINE_DESCENT, 1},
+	{"table", ENGINE_PLAIN, 0, ENGINE_TABLE, 0},
+	{"pipelined", ENGINE_PIPELINE, 0, ENGINE_DESCENT, 0},
+	{"split -j 2", ENGINE_PARALLEL, 2, ENGINE_DESCENT, 0},
+	{"split -j 4", ENGINE_PARALLEL, 4, ENGINE_DESCENT, 0},
+};
+
+#define ENGINES ((int)(sizeof(engines) / sizeof(engines[0])))
+
+static const char * kernels[] = {"none", "sse2", "avx2"};
+
+#define KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+// the phases timed, each the best of the passes
+enum {PHASE_OPEN, PHASE_SCAN, PHASE_PARSE, PHASE_CLOSE, PHASES};
+
+/*
+ *
+ * name: seconds
+ *
+ * @return	the current monotonic time in seconds
+ */
+static double seconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ *
+ * name: startEngine
+ *
+ * Starts the scanner threads of an engine on a session just started.
+ *
+ * @param	source	the session
+ * @param	input	the source
+ * @param	engine	the engine
+ */
+static void startEngine(sourceContainer * source, sourceBuffer * input,
+		const benchEngine * engine){
+	if(engine->engine == ENGINE_PARALLEL){
+		source->parallel = startParallel(&source->memory, input, source->keywords,
+				engine->workers);
+	}
+	else if(engine->engine == ENGINE_PIPELINE){
+		source->pipeline = startPipeline(&source->memory, input, source->keywords);
+	}
+}
+
+static void stopEngine(sourceContainer * source){
+	if(source->parallel != NULL){
+		stopParallel(source->parallel);
+	}
+	if(source->pipeline != NULL){
+		stopPipeline(source->pipeline);
+	}
+}
+
+/*
+ *
+ * name: runEngine
+ *
+ * Times each phase of an engine over a file, keeping the best of each.
+ *
+ * @param	fileName	the file
+ * @param	engine	the engine
+ * @param	passes	the number of passes
+ * @param	best	filled in with the best time of each phase
+ * @param	tokens	set to the number of tokens in the file
+ * @param	bytes	set to the length of the file
+ * @param	errors	set to the number of errors found in the file
+ * @return	1 if every pass went on to the end, 0 otherwise
+ */
+static int runEngine(char * fileName, const benchEngine * engine, int passes,
+		double best[PHASES], long * tokens, long * bytes, int * errors){
+	sourceBuffer input;
+	sourceContainer source;
+	outputSink quiet;
+	double times[PHASES + 1];
+	int pass, phase, parsed = 1;
+
+	initSink(&quiet, SINK_NULL, -1);
+	initSession(&source, &defaultKeywords, &quiet);
+	source.engine = engine->grammar;
+	source.keepTree = engine->keepTree;
+	for(phase=0;phase<PHASES;phase++){
+		best[phase] = -1;
+	}
+
+	for(pass=0;pass<passes;pass++){
+		times[PHASE_OPEN] = seconds();
+		if(!openSource(&input, fileName)){
+			return 0;
+		}
+		*bytes = input.length;
+
+		times[PHASE_SCAN] = seconds();
+		if(!startSession(&source, &input)){
+			return 0;
+		}
+		startEngine(&source, &input, engine);
+		*tokens = 0;
+		do{
+			nextToken(&source);
+			(*tokens)++;
+		}while(source.currentToken.length > 0);
+		stopEngine(&source);
+
+		times[PHASE_PARSE] = seconds();
+		startSession(&source, &input);
+		startEngine(&source, &input, engine);
+		parseProgram(&source);
+		parsed &= !source.halted;
+		*errors = source.errors;
+		stopEngine(&source);
+
+		times[PHASE_CLOSE] = seconds();
+		closeSource(&input);
+		times[PHASES] = seconds();
+
+		for(phase=0;phase<PHASES;phase++){
+			if(best[phase] < 0 || times[phase + 1] - times[phase] < best[phase]){
+				best[phase] = times[phase + 1] - times[phase];
+			}
+		}
+	}
+	freeSession(&source);
+	return parsed;
+}
+
+/*
+ *
+ * name: main
+ *
+ * Runs every engine with every version of the kernels over the named file.
+ *
+ * @param	argc	the number of arguments passed (including the program)
+ * @param	argv	the argument array of the program call
+ * @return	error code
+ */
+int main(int argc, char** argv){
+	struct rusage usage;
+	double best[PHASES];
+	double * parseTimes;
+	long peaks[ENGINES][KERNELS];
+	long tokens, bytes;
+	int errors;
+	int passes = 3;
+	int status, failed = 0;
+	int e, k;
+	pid_t child;
+
+	if(argc < 2){
+		printf("usage: %s file [passes]\n", argv[0]);
+		return 1;
+	}
+	if(argc > 2){
+		passes = atoi(argv[2]);
+	}
+
+	// the children hand back their parse times through a shared page
+	parseTimes = mmap(NULL, ENGINES * KERNELS * sizeof(double),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(parseTimes == MAP_FAILED){
+		printf("Could not share the parse times!\n");
+		return 1;
+	}
+
+	printf("%-12s %-5s %9s %9s %9s %9s %9s %9s %7s %10s\n", "engine", "simd",
+			"scan MB/s", "Mtoken/s", "open ms", "scan ms", "parse ms", "close ms",
+			"errors", "peak RSS");
+	fflush(stdout);
+	for(e=0; e < ENGINES; e++){
+		for(k=0; k < KERNELS; k++){
+			child = fork();
+			if(child == 0){
+				// the kernels are picked when first used, so this child's
+				// choice holds for all of its passes
+				setenv("SPS_SIMD", kernels[k], 1);
+				if(!runEngine(argv[1], &engines[e], passes, best, &tokens, &bytes, &errors)){
+					printf("%-12s %-5s parse failed", engines[e].name, kernels[k]);
+					fflush(stdout);
+					_exit(1);
+				}
+				printf("%-12s %-5s %9.1f %9.2f %9.2f %9.2f %9.2f %9.2f %7d",
+						engines[e].name, kernels[k],
+						bytes / best[PHASE_SCAN] / 1e6, tokens / best[PHASE_SCAN] / 1e6,
+						best[PHASE_OPEN] * 1e3, best[PHASE_SCAN] * 1e3,
+						best[PHASE_PARSE] * 1e3, best[PHASE_CLOSE] * 1e3, errors);
+				fflush(stdout);
+				parseTimes[e * KERNELS + k] = best[PHASE_PARSE];
+				_exit(0);
+			}
+			if(child < 0 || wait4(child, &status, 0, &usage) < 0){
+				printf("Could not run %s!\n", engines[e].name);
+				return 1;
+			}
+			failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+			peaks[e][k] = usage.ru_maxrss;
+			printf(" %7ld KB\n", usage.ru_maxrss);
+			fflush(stdout);
+		}
+	}
+
+	printf("\n%-12s %-5s %9s %10s\n", "tree adds", "simd", "parse", "peak RSS");
+	for(k=0; k < KERNELS && !failed; k++){
+		printf("%-12s %-5s %8.1f%% %7ld KB\n", "", kernels[k],
+				(parseTimes[KERNELS + k] / parseTimes[k] - 1) * 100,
+				peaks[1][k] - peaks[0][k]);
+	}
+	munmap(parseTimes, ENGINES * KERNELS * sizeof(double));
+	return failed;
+}
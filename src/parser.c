@@ -12,81 +12,329 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "config.h"
 #include "tokens.h"
 #include "line.h"
+#include "source.h"
 #include "hasher.h"
 #include "util.h"
 #include "builders.h"
 #include "scanner.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "output.h"
+#include "session.h"
 #include "grammar.h"
+#include "batch.h"
+#include "loader.h"
+#include "trace.h"
 
+/*
+ *
+ * name: quit
+ *
+ * Prints a message after everything already printed, and exits.
+ *
+ * @param	output	the sink to print to
+ * @param	message	the message to print
+ */
+static void quit(outputSink * output, char * message){
+	sinkPrintf(output, "%s\n", message);
+	closeSink(output);
+	exit(1);
+}
+
+/*
+ *
+ * name: usage
+ *
+ * Reports an option given a value it does not take, and exits.
+ *
+ * @param	option	the option
+ * @param	value	the value it was given
+ * @param	choices	the values it takes
+ */
+static void usage(char * option, char * value, char * choices){
+	fprintf(stderr, "Unknown value \"%s\" for %s, expected %s!\n", value, option, choices);
+	exit(2);
+}
 
 /*
  *
  * name: main
  *
  * Receives information from the user of the input and output files, and then
- * makes appropriate calls.
+ * makes appropriate calls.  Several files may be checked in turn.
  *
  * @param	argc	the number of arguments passed (including the program)
  * @param	argv	the argument array of the program call
- * @return	error code
+ * @return	0 if every file parsed, 1 if any did not, 2 for a bad option
  */
 int main(int argc, char** argv){
-	line current;
+	sourceBuffer input;
 	sourceContainer source;
-	source.current = &current;
+	outputSink output;
 
-	char input[MAX_FILE_LEN];
-	int i;
-	token tokenList[MAX_TOKENS];
+	char prompted[MAX_FILE_LEN];
+	char * fileNames[argc > 1 ? argc : 1];
+	char * tokenFile = NULL;
+	int files = 0;
+	int pipelined = 0;
+	int workers = 0;
+	int checkOnly = 0;
+	int printTrees = 0;
+	int engine = ENGINE_DESCENT;
+	int batch = 0;
+	int listSymbols = 0;
+	int loading = LOAD_URING;
+	int corpora = 0;
+	char * cacheFile = NULL;
+	resultCache cache;
+	char * traceFile = NULL;
+	int traceFormat = TRACE_CHROME;
+	int sink = SINK_BUFFERED;
+	int failed = 0;
+	int i, opened, parsed, count;
+	reserved tokenList[MAX_TOKENS];
+	keywordTable customKeywords;
+	const keywordTable * keywords = &defaultKeywords;
 
-	// The user can pass a parameter to the program for the file name.
-	// If no parameter is given, the program will ask explicitly.
-	if(argc == 2){
-		strcpy(input, argv[1]);
+	// The user can pass parameters to the program for the file names, or "-" to
+	// stream the source from stdin, "-t file" to use their own token file, "-p"
+	// to scan on a thread of its own, "-j n" to scan on n threads at once, "-s
+	// buffered", "-s thread" or "-s null" to choose how output is written and
+	// "-g table" to parse with the tables generated from SPS.g rather than by
+	// recursive descent.  With "--check-only" nothing is printed and only the
+	// exit status, which is 1 if any file did not parse, tells whether every
+	// file parsed, and with "--tree" the syntax tree of each file parsed is
+	// printed after its symbol table.  With "--batch" the files, directories
+	// and "@manifest" lists given are checked on a pool of "-j n" threads and
+	// only their errors are printed, the files being read ahead through an
+	// io_uring unless "-l threads" or "-l map" is given.  "--corpus" checks the
+	// records of the corpus containers or tars given in the same way, and
+	// "--cache file" keeps the results of a batch so unchanged files are not
+	// checked again, while "--symbols" prints the symbols each file of a batch
+	// declares after its errors.  "--trace file" writes a Chrome trace of where
+	// the time went, and "--counters file" only its totals, when built with
+	// TRACE=1.  If no file name is given, the program will ask explicitly.
+	for(i=1;i<argc;i++){
+		if(strcmp(argv[i], "-t") == 0 && i+1 < argc){
+			tokenFile = argv[++i];
+		}
+		else if(strcmp(argv[i], "-p") == 0){
+			pipelined = 1;
+		}
+		else if(strcmp(argv[i], "-j") == 0 && i+1 < argc){
+			workers = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-s") == 0 && i+1 < argc){
+			i++;
+			if(strcmp(argv[i], "thread") == 0){
+				sink = SINK_THREAD;
+			}
+			else if(strcmp(argv[i], "null") == 0){
+				sink = SINK_NULL;
+			}
+			else if(strcmp(argv[i], "buffered") == 0){
+				sink = SINK_BUFFERED;
+			}
+			else{
+				usage("-s", argv[i], "buffered, thread or null");
+			}
+		}
+		else if(strcmp(argv[i], "-g") == 0 && i+1 < argc){
+			i++;
+			if(strcmp(argv[i], "table") == 0){
+				engine = ENGINE_TABLE;
+			}
+			else if(strcmp(argv[i], "descent") == 0){
+				engine = ENGINE_DESCENT;
+			}
+			else{
+				usage("-g", argv[i], "descent or table");
+			}
+		}
+		else if(strcmp(argv[i], "--check-only") == 0){
+			checkOnly = 1;
+		}
+		else if(strcmp(argv[i], "--tree") == 0){
+			printTrees = 1;
+		}
+		else if(strcmp(argv[i], "--batch") == 0){
+			batch = 1;
+		}
+		else if(strcmp(argv[i], "--symbols") == 0){
+			listSymbols = 1;
+		}
+		else if(strcmp(argv[i], "--cache") == 0 && i+1 < argc){
+			cacheFile = argv[++i];
+		}
+		else if(strcmp(argv[i], "--trace") == 0 && i+1 < argc){
+			traceFile = argv[++i];
+			traceFormat = TRACE_CHROME;
+		}
+		else if(strcmp(argv[i], "--counters") == 0 && i+1 < argc){
+			traceFile = argv[++i];
+			traceFormat = TRACE_COUNTERS;
+		}
+		else if(strcmp(argv[i], "--corpus") == 0){
+			batch = 1;
+			corpora = 1;
+		}
+		else if(strcmp(argv[i], "-l") == 0 && i+1 < argc){
+			i++;
+			if(strcmp(argv[i], "map") == 0){
+				loading = LOAD_MAP;
+			}
+			else if(strcmp(argv[i], "threads") == 0){
+				loading = LOAD_THREADS;
+			}
+			else if(strcmp(argv[i], "uring") == 0){
+				loading = LOAD_URING;
+			}
+			else{
+				usage("-l", argv[i], "uring, threads or map");
+			}
+		}
+		else{
+			fileNames[files++] = argv[i];
+		}
 	}
-	else{
-		printf("\n Name of your input file (%d characters max): ", MAX_FILE_LEN);
-		scanf("%s", input);
+	if(files == 0){
+		fileNames[files++] = prompted;
+		printf("\n Name of your input file (%d characters max): ", MAX_FILE_LEN-1);
+		if(fgets(prompted, MAX_FILE_LEN, stdin) == NULL){
+			prompted[0] = '\0';
+		}
+		prompted[strcspn(prompted, "\n")] = '\0';
 	}
-	source.infile = fopen(input, "r");
-
-	if(source.infile == NULL){
-		printf("Could not open input file!\n");
+	fflush(stdout);
+	if(!initSink(&output, checkOnly ? SINK_NULL : sink, STDOUT_FILENO)){
+		printf("Could not allocate output buffer!\n");
 		exit(1);
 	}
 
-	// prepare and build the token table
-	for(i=0;i<HASH_TABLE_SIZE;i++){
-		source.hashTable[i] = NULL;
-		source.symbolTable[i] = NULL;
+	// the reserved words are built in unless a token file was given
+	if(tokenFile != NULL){
+		count = readTokens(tokenList, tokenFile);
+		if(!buildKeywords(&customKeywords, tokenList, count)){
+			quit(&output, "Could not hash token file!");
+		}
+		keywords = &customKeywords;
 	}
 
-	readTokens(tokenList, "tokens");
-	buildHashes(source.hashTable, tokenList);
+	// tracing must be on before any thread starts
+	if(traceFile != NULL && !startTrace(traceFile, traceFormat)){
+		quit(&output, "Tracing was not built in, rebuild with make TRACE=1!");
+	}
 
-	source.current->scanIndex = 0;
-	source.current->lineNumber = 0;
-	source.current->atEOF = 0;
-	memset(source.current->line, '\0', MAX_LINE_LEN);
+	// a batch shares the files out between threads with sessions of their own
+	if(batch){
+		fileList list = {NULL, NULL, 0, 0, NULL, 0};
+		for(i=0;i<files;i++){
+			if(corpora ? !addCorpus(&list, fileNames[i]) : !addFiles(&list, fileNames[i])){
+				quit(&output, corpora ? "Could not read corpus!" : "Could not read file list!");
+			}
+		}
+		if(cacheFile != NULL && !openCache(&cache, cacheFile, keywords, engine, list.count)){
+			quit(&output, "Could not allocate result cache!");
+		}
+		failed = runBatch(&list, keywords, engine, &output, workers, loading,
+				cacheFile != NULL ? &cache : NULL, listSymbols);
+		if(failed < 0){
+			quit(&output, "Could not start batch!");
+		}
+		if(cacheFile != NULL){
+			if(!saveCache(&cache)){
+				sinkPrintf(&output, "Could not save result cache!\n");
+			}
+			closeCache(&cache);
+		}
+		// the trace names the files, so is written before they are freed
+		if(!finishTrace()){
+			sinkPrintf(&output, "Could not write trace!\n");
+		}
+		freeFiles(&list);
+		closeSink(&output);
+		return failed > 0;
+	}
 
+	// one session is used for every file, and reset in between
+	initSession(&source, keywords, &output);
+	source.engine = engine;
+	source.keepTree = printTrees && !checkOnly;
+	for(i=0;i<files;i++){
+		if(files > 1){
+			sinkPrintf(&output, "\n==> %s <==\n", fileNames[i]);
+		}
+		TRACE_BEGIN(checking);
+		TRACE_BEGIN(opening);
+		if(strcmp(fileNames[i], "-") == 0){
+			opened = openStream(&input, fileno(stdin));
+		}
+		else{
+			opened = openSource(&input, fileNames[i]);
+		}
+		if(!opened){
+			quit(&output, "Could not open input file!");
+		}
+		TRACE_END(TRACE_OPEN, opening);
+		if(!startSession(&source, &input)){
+			quit(&output, "Out of memory!");
+		}
+		if(workers > 0){
+			source.parallel = startParallel(&source.memory, &input, keywords, workers);
+		}
+		else if(pipelined){
+			source.pipeline = startPipeline(&source.memory, &input, keywords);
+		}
 
-	// parse the source
-	if(prog(&source)){
-		printf("\n\nParse successful!\n");
-	}
-	else{
-		while(!source.current->atEOF){
-			getLine(source.current, source.infile);
+		// parse the source, then stop the scanner threads if still going
+		TRACE_BEGIN(parsing);
+		parsed = parseProgram(&source) > 0;
+		if(source.parallel != NULL){
+			stopParallel(source.parallel);
+		}
+		if(source.pipeline != NULL){
+			stopPipeline(source.pipeline);
+		}
+		TRACE_END(TRACE_PARSE, parsing);
+		TRACE_COUNT(COUNT_LINES, source.current->lineNumber);
+		if(parsed){
+			sinkPrintf(&output, "\n\nParse successful!\n");
+		}
+		else{
+			failed = 1;
+			while(!sinkQuiet(&output) && !source.current->atEOF){
+				getLine(source.current);
+			}
+			sinkPrintf(&output, "\n\nParse failure!\n");
+		}
+
+		if(!checkOnly){
+			sinkPrintf(&output, "\nSymbol table:\n");
+			printHash(&source.symbols, &output);
+		}
+		if(!checkOnly && printTrees && parsed){
+			sinkPrintf(&output, "\nSyntax tree:\n");
+			printTree(&source.tree, &source.symbols, &output);
 		}
-		printf("\n\nParse failure!\n");
-	}
 
-	printf("\nSymbol table:\n");
-	printHash(source.symbolTable);
-	return 0;
+		// the listing may still point into the source
+		sinkFlush(&output);
+		TRACE_BEGIN(closing);
+		closeSource(&input);
+		TRACE_END(TRACE_CLOSE, closing);
+		TRACE_COUNT(COUNT_FILES, 1);
+		TRACE_NAMED(TRACE_FILE, checking, fileNames[i]);
+	}
+	if(!finishTrace()){
+		sinkPrintf(&output, "Could not write trace!\n");
+	}
+	freeSession(&source);
+	closeSink(&output);
+	return failed;
 }
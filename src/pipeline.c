@@ -0,0 +1,187 @@
+/*
+ *      pipeline.c
+ *
+ * This file contains the pipelined scanner.  A thread scans the whole source
+ * ahead of the parser, leaving its tokens in a lock-free ring, so scanning
+ * and parsing each get a core of their own.  When the ring is full the
+ * scanner waits for the parser, and the parser waits when it is empty.
+ *
+ * The scanner thread does nothing which is not safe alongside the parser:
+ * its line has no sink to print to, it does not intern its variables, and allocates no
+ * memory.  The parser does both as it takes each token, so the output and
+ * the symbol table are just as they are without the pipeline.  Only mapped
+ * sources are pipelined, as a streamed source moves its text as it is read.
+ *
+ */
+
+#include <stdio.h>
+#include <sched.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "line.h"
+#include "source.h"
+#include "arena.h"
+#include "hasher.h"
+#include "util.h"
+#include "scanner.h"
+#include "pipeline.h"
+
+// the number of times to check the ring before giving up the core
+#define SPINS 64
+
+/*
+ *
+ * name: relax
+ *
+ * Waits a moment while the other side of the ring catches up.  After a
+ * short spin the core is given up, so the pipeline still moves along when
+ * both threads share one core.
+ *
+ * @param	spins	the number of times the ring has been checked so far
+ */
+static void relax(int * spins){
+	if(++*spins < SPINS){
+#ifdef __x86_64__
+		__builtin_ia32_pause();
+#endif
+	}
+	else{
+		*spins = 0;
+		sched_yield();
+	}
+}
+
+/*
+ *
+ * name: scanSource
+ *
+ * The body of the scanner thread.  Tokens are pushed until the end of the
+ * source has been pushed, or until the parser asks the thread to stop.
+ *
+ * @param	data	the ring to fill
+ * @return	NULL
+ */
+static void * scanSource(void * data){
+	tokenRing * ring = data;
+	unsigned long head = 0;
+	unsigned long tail = 0;
+	token item;
+	int spins;
+
+	do{
+		item = getToken(&ring->scan, ring->keywords, NULL);
+		spins = 0;
+		while(head - tail == TOKEN_RING){
+			if(atomic_load_explicit(&ring->stop, memory_order_relaxed)){
+				return NULL;
+			}
+			tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+			if(head - tail == TOKEN_RING){
+				relax(&spins);
+			}
+		}
+		ring->slots[head & (TOKEN_RING - 1)] = item;
+		atomic_store_explicit(&ring->head, ++head, memory_order_release);
+	}while(item.length > 0 && !atomic_load_explicit(&ring->stop, memory_order_relaxed));
+	return NULL;
+}
+
+/*
+ *
+ * name: startPipeline
+ *
+ * Allocates a ring from the given arena and starts a scanner thread on the
+ * source.
+ *
+ * @param	memory	the arena to allocate the ring from
+ * @param	input	the mapped source to be scanned
+ * @param	keywords	the lookup table for reserved words
+ * @return	the ring to pull tokens from, NULL if the source cannot be
+ * 	pipelined and should be scanned directly
+ */
+tokenRing * startPipeline(arena * memory, sourceBuffer * input,
+		const keywordTable * keywords){
+	tokenRing * ring;
+
+	if(!input->mapped){
+		return NULL;
+	}
+	ring = arenaAlloc(memory, sizeof(tokenRing));
+	if(ring == NULL){
+		return NULL;
+	}
+	ring->slots = arenaAlloc(memory, TOKEN_RING * sizeof(token));
+	if(ring->slots == NULL){
+		return NULL;
+	}
+	initLine(&ring->scan, input);
+	ring->keywords = keywords;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->stop, 0);
+	ring->seenHead = 0;
+	ring->finished = 0;
+	initKernels();
+	if(pthread_create(&ring->thread, NULL, scanSource, ring) != 0){
+		return NULL;
+	}
+	return ring;
+}
+
+/*
+ *
+ * name: pullToken
+ *
+ * Takes the next token from the ring, waiting for the scanner if need be.
+ * The lines up to the token are printed and its name interned, as getToken()
+ * would have done.  Once the end of the source is reached it is returned
+ * again for every later call.
+ *
+ * @param	ring	the ring to take from
+ * @param	current	the line the parser prints from
+ * @param	symbols	the symbol table variables are interned into
+ * @return	the token read
+ */
+token pullToken(tokenRing * ring, line * current, symbolTable * symbols){
+	unsigned long tail;
+	token item;
+	int spins = 0;
+
+	if(ring->finished){
+		return ring->last;
+	}
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	while(ring->seenHead == tail){
+		ring->seenHead = atomic_load_explicit(&ring->head, memory_order_acquire);
+		if(ring->seenHead == tail){
+			relax(&spins);
+		}
+	}
+	item = ring->slots[tail & (TOKEN_RING - 1)];
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+	while(!current->atEOF && current->offset + current->length <= item.offset){
+		getLine(current);
+	}
+	internToken(&item, current->source, symbols);
+	if(item.length == 0){
+		ring->finished = 1;
+		ring->last = item;
+	}
+	return item;
+}
+
+/*
+ *
+ * name: stopPipeline
+ *
+ * Stops the scanner thread, which may still be scanning if the parse failed,
+ * and waits for it to finish.
+ *
+ * @param	ring	the ring to stop
+ */
+void stopPipeline(tokenRing * ring){
+	atomic_store_explicit(&ring->stop, 1, memory_order_relaxed);
+	pthread_join(ring->thread, NULL);
+}
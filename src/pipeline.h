@@ -0,0 +1,45 @@
+/*
+ *      pipeline.h
+ *
+ * This file contains the pipelined scanner, which reads tokens on a thread
+ * of its own and hands them to the parser through a ring buffer.
+ *
+ */
+
+#ifndef pipeline_h
+#define pipeline_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "line.h"
+#include "source.h"
+#include "arena.h"
+#include "hasher.h"
+
+// a single producer, single consumer ring of TOKEN_RING tokens.  The scanner
+// thread only writes head and the parser only writes tail, each on its own
+// cache line, and neither ever waits on a lock.
+typedef struct{
+	token * slots;
+	line scan;
+	const keywordTable * keywords;
+	pthread_t thread;
+	char headLine[64];
+	atomic_ulong head;
+	char tailLine[64];
+	atomic_ulong tail;
+	unsigned long seenHead;
+	int finished;
+	token last;
+	char stopLine[64];
+	atomic_int stop;
+} tokenRing;
+
+tokenRing * startPipeline(arena *, sourceBuffer *, const keywordTable *);
+token pullToken(tokenRing *, line *, symbolTable *);
+void stopPipeline(tokenRing *);
+
+#endif
@@ -20,112 +20,173 @@
 #include "hasher.h"
 #include "util.h"
 #include "builders.h"
+#include "lexer.h"
 #include "scanner.h"
+#include "trace.h"
 
 /*
  *
- * name: getLine
+ * name: initLine
  *
- * Will read into the given line from input a new string.
+ * Prepares the given line to be read from the start of the source buffer,
+ * which need not be the start of the file.  Lines are not printed until the
+ * line is given a sink to echo to.
  *
- * @param	current	the line to be read into
- * @param	input	the file handler to be read from
+ * @param	current	the line to be prepared
+ * @param	source	the source buffer to be read from
  */
-void getLine(line * current, FILE* input){
-	if(!feof(input)){
-		memset(current->line, '\0', MAX_LINE_LEN);
-		fgets(current->line, MAX_LINE_LEN+1, input);
-		current->scanIndex = 0;
-		current->lineNumber++;
+void initLine(line * current, sourceBuffer * source){
+	current->source = source;
+	current->line = source->data;
+	current->length = 0;
+	current->offset = source->base;
+	current->scanIndex = 0;
+	current->lineNumber = 0;
+	current->atEOF = (nextLine(source, source->base) == 0);
+	current->lexState = S_START;
+	current->echo = NULL;
+}
 
-		if(current->line[0] != '\0'){
-			printf("\n%d\t: %s", current->lineNumber, current->line);
-		}
+/*
+ *
+ * name: getLine
+ *
+ * Will advance the given line to the next line of the source buffer.  The line
+ * is only pointed at, so no text is copied and lines of any length are kept
+ * whole.  On a streamed source this may release the previous line.  The line
+ * is printed to the echo sink if there is one.
+ *
+ * @param	current	the line to be advanced
+ */
+void getLine(line * current){
+	TRACE_SCOPE(TRACE_LINE);
+	current->offset += current->length;
+	current->scanIndex = 0;
+	current->length = nextLine(current->source, current->offset);
+	current->line = sourceText(current->source, current->offset);
+	if(current->length == 0){
+		current->atEOF = 1;
+		return;
+	}
 
-		up(current->line);
-		if(feof(input)){
-			current->atEOF = 1;
-			return;
-		}
+	current->lineNumber++;
+	if(current->echo != NULL){
+		sinkLine(current->echo, current->lineNumber, current->line,
+				current->length, current->source->mapped);
 	}
-	else{
+
+	if(sourceEnd(current->source, current->offset + current->length)){
 		current->atEOF = 1;
-		return;
 	}
 }
 
 /*
  *
- * name: getToken
+ * name: internToken
  *
- * The main function of the scanner.  It will call all the other functions
- * as needed.  This will handle all the work of the scanner.
+ * Interns the name of a valid variable into the symbol table and gives the
+ * token its id.  The name is hashed straight from the source, so nothing is
+ * copied unless it is new and too long to be kept within its symbol.  Any
+ * other token is left alone.
  *
- * @param	current	the line to be read into
- * @param	input	the file to be read from
- * @param	hashTable	the lookup table for tokens
- * @return	a wrapper token which includes the token and error information
+ * @param	item	the token to be interned
+ * @param	input	the source the token was read from
+ * @param	symbols	the symbol table to intern into
  */
-superToken getToken(line * current,FILE* input,token ** hashTable){
-	superToken toReturn;
-	int i, err, hashVal;
-	char word[9];
+void internToken(token * item, sourceBuffer * input, symbolTable * symbols){
+	if(item->code == ID && item->error == NO_ERROR){
+		item->symbol = internName(symbols, sourceText(input, item->offset),
+				item->length);
+	}
+}
 
-	toReturn.error = 0;
-	memset(word, '\0', MAX_TOKEN_LEN+1);
-	memset(toReturn.message, '\0', MAX_MESSAGE_LEN);
-	while(word[0] == '\0' && !current->atEOF){
-		i= current->scanIndex;
-		if(current->line[i] == '\0'){
-			if(!current->atEOF){
-				getLine(current, input);
-			}
-			else{
-				toReturn.error = -1;
-				return toReturn;
-			}
-		}
-		err = buildToken(word, current);
+/*
+ *
+ * name: lineToken
+ *
+ * Reads the next token from the current line without moving on to the
+ * next line.  No text is copied, the token only records where it lies in
+ * the source.  When the line has run out the token is the one getToken()
+ * gives at the end of the source.
+ *
+ * @param	item	the token to be read into
+ * @param	current	the line to be read from
+ * @param	keywords	the lookup table for reserved words
+ * @return	1 if a token was read, 0 if the line has run out
+ */
+int lineToken(token * item, line * current, const keywordTable * keywords){
+	span where;
+	const char * text;
+	int kind, code;
 
-		// on 1 an integer was detected and we should verify
-		if(err == 1){
-			if(!isinteger(word)){
-				buildError(&toReturn, 3);
-			}
-			buildSuper(&toReturn, word, 23);
-			return toReturn;
-		}
+	kind = buildToken(&where, current);
 
-		// on 2 a comment was detected so we should skip and try to get another token
-		while(err == 2){
-			//comment mode on, ignore until "*)" is found
-			while(!skipComment(current) && !current->atEOF){
-				getLine(current, input);
-			}
-			err = buildToken(word, current);
+	// integers never need to be looked up, and their value is worked out
+	// while their digits are still in the cache
+	if(kind == A_INT || kind == A_BADINT){
+		buildItem(item, current, where, INT);
+		if(kind == A_BADINT){
+			item->error = BAD_INTEGER;
+		}
+		else if(!parseDigits(sourceText(current->source, where.offset),
+				where.length, &item->value)){
+			item->error = INT_OVERFLOW;
 		}
+		return 1;
 	}
 
-	hashVal = getHash(hashTable, word);
+	buildItem(item, current, where, ID);
+	if(kind == 0){
+		item->error = BAD_VARIABLE;
+		return 0;
+	}
 
-	// on -1 from getHash the word was not in the table, so it must be a variable
-	if(hashVal == -1){
-		if(!isvariable(word)){
-			buildError(&toReturn, 2);
+	// on -1 from findKeyword the word was not reserved, so it must be a variable
+	text = sourceText(current->source, where.offset);
+	code = findKeyword(keywords, text, where.length);
+	if(code == -1){
+		// variables may be any length a token can record
+		if(kind != A_IDENT){
+			item->error = BAD_VARIABLE;
 		}
-
-		// on -1 from buildToken then the variable's length was too long.
-		if(err == -1){
-			buildError(&toReturn, 1);
-			// skip the remainder of the offending token
-			while(!isstopper(current->line[current->scanIndex])){
-					current->scanIndex++;
-			}
+		if(where.length > MAX_LENGTH){
+			item->error = TOO_LONG;
 		}
-		buildSuper(&toReturn, word, 22);
 	}
 	else{
-		toReturn.item = *hashTable[hashVal];
+		// a reserved word carries no symbol id, so its value is cleared
+		item->code = code;
+		item->value = 0;
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: getToken
+ *
+ * The main function of the scanner.  It will call all the other functions
+ * as needed.  This will handle all the work of the scanner.
+ *
+ * @param	current	the line to be read from
+ * @param	keywords	the lookup table for reserved words
+ * @param	symbols	the symbol table variables are interned into, or NULL to
+ * 	leave that to the caller
+ * @return	the token read, with any error found in it
+ */
+token getToken(line * current, const keywordTable * keywords,
+		symbolTable * symbols){
+	token toReturn;
+	TRACE_SCOPE(TRACE_TOKEN);
+
+	while(!lineToken(&toReturn, current, keywords) && !current->atEOF){
+		getLine(current);
+	}
+
+	// valid variables are interned once here, so the parser can check them
+	// by id
+	if(symbols != NULL){
+		internToken(&toReturn, current->source, symbols);
 	}
 	return toReturn;
 }
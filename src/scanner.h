@@ -10,8 +10,13 @@
 
 #include "tokens.h"
 #include "line.h"
+#include "source.h"
+#include "hasher.h"
 
-void getLine(line *, FILE* );
-superToken getToken(line *, FILE*, token **);
+void initLine(line *, sourceBuffer *);
+void getLine(line *);
+void internToken(token *, sourceBuffer *, symbolTable *);
+int lineToken(token *, line *, const keywordTable *);
+token getToken(line *, const keywordTable *, symbolTable *);
 
 #endif
@@ -0,0 +1,143 @@
+/*
+ *      session.c
+ *
+ * This file contains the parse session, which holds everything the parser
+ * needs for one source.  All of it is allocated from the session's arena,
+ * so a session is cleared for the next source with a single reset.
+ *
+ */
+
+#include <stdio.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "line.h"
+#include "source.h"
+#include "arena.h"
+#include "output.h"
+#include "hasher.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "scanner.h"
+#include "builders.h"
+#include "ast.h"
+#include "sps.h"
+#include "session.h"
+
+/*
+ *
+ * name: initSession
+ *
+ * Prepares a session which will use the given reserved words for every
+ * source it parses, and print to the given sink.  It parses by recursive
+ * descent, keeps no syntax tree and reports no events until told otherwise.
+ *
+ * @param	source	the session to prepare
+ * @param	keywords	the lookup table for reserved words
+ * @param	output	the sink the listing and errors are printed to
+ */
+void initSession(sourceContainer * source, const keywordTable * keywords,
+		outputSink * output){
+	source->keywords = keywords;
+	source->output = output;
+	source->input = NULL;
+	source->current = NULL;
+	source->pipeline = NULL;
+	source->parallel = NULL;
+	source->keepTree = 0;
+	source->engine = ENGINE_DESCENT;
+	source->handlers = NULL;
+	source->context = NULL;
+	initArena(&source->memory);
+}
+
+/*
+ *
+ * name: startSession
+ *
+ * Releases everything left from the last source and prepares the session to
+ * parse the given one.
+ *
+ * @param	source	the session to start
+ * @param	input	the source buffer to be parsed
+ * @return	1 if successful, 0 if out of memory, the first line of a streamed
+ * 	source included
+ */
+int startSession(sourceContainer * source, sourceBuffer * input){
+	resetArena(&source->memory);
+	source->input = input;
+	source->diagnostics = NULL;
+	source->lastDiagnostic = NULL;
+	source->errors = 0;
+	source->halted = 0;
+	source->depth = 0;
+	source->pipeline = NULL;
+	source->parallel = NULL;
+	source->current = arenaAlloc(&source->memory, sizeof(line));
+	if(source->current == NULL || !initSymbols(&source->symbols, &source->memory)){
+		return 0;
+	}
+	// a kept tree grows with the tokens parsed, each of which makes at most
+	// one node, rather than being sized from the length of the source
+	if(!initTree(&source->tree, source->keepTree ? &source->memory : NULL, 0)){
+		return 0;
+	}
+	initLine(source->current, input);
+	if(input->failed){
+		return 0;
+	}
+	if(!sinkQuiet(source->output)){
+		source->current->echo = source->output;
+	}
+	return 1;
+}
+
+/*
+ *
+ * name: addDiagnostic
+ *
+ * Records an error against the current token.  The messages are all either
+ * constant strings or from the scanner's table, so they are not copied.
+ *
+ * @param	source	the session the error was found in
+ * @param	message	the text of the error
+ * @return	the diagnostic recorded, NULL if out of memory
+ */
+diagnostic * addDiagnostic(sourceContainer * source, const char * message){
+	diagnostic * found = arenaAlloc(&source->memory, sizeof(diagnostic));
+
+	source->errors++;
+	if(found == NULL){
+		return NULL;
+	}
+	found->next = NULL;
+	found->lineNumber = tokenLine(source->currentToken);
+	found->column = tokenColumn(source->currentToken);
+	found->message = message;
+	found->tokenName = arenaAlloc(&source->memory, source->currentToken.length + 1);
+	if(found->tokenName == NULL){
+		return NULL;
+	}
+	tokenName(found->tokenName, source->input, &source->currentToken);
+
+	if(source->lastDiagnostic == NULL){
+		source->diagnostics = found;
+	}
+	else{
+		source->lastDiagnostic->next = found;
+	}
+	source->lastDiagnostic = found;
+	return found;
+}
+
+/*
+ *
+ * name: freeSession
+ *
+ * Returns all of the session's memory to the system.
+ *
+ * @param	source	the session to free
+ */
+void freeSession(sourceContainer * source){
+	freeArena(&source->memory);
+}
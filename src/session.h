@@ -0,0 +1,65 @@
+/*
+ *      session.h
+ *
+ * This file contains the parse session, which holds everything the parser
+ * needs for one source.  All of it is allocated from the session's arena,
+ * so a session is cleared for the next source with a single reset.
+ *
+ */
+
+#ifndef session_h
+#define session_h
+
+#include "config.h"
+#include "tokens.h"
+#include "line.h"
+#include "source.h"
+#include "arena.h"
+#include "output.h"
+#include "hasher.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "ast.h"
+#include "sps.h"
+
+// the parsers a session can be checked with: the recursive descent of
+// grammar.c, or the tables generated from SPS.g run by llparse.c
+enum {ENGINE_DESCENT, ENGINE_TABLE};
+
+// an error reported while parsing, kept in the order found
+typedef struct diagnostic{
+	struct diagnostic * next;
+	int lineNumber;
+	int column;
+	const char * message;
+	char * tokenName;
+} diagnostic;
+
+typedef struct {
+	token currentToken;
+	sourceBuffer * input;
+	const keywordTable * keywords;
+	symbolTable symbols;
+	astTree tree;
+	line * current;
+	tokenRing * pipeline;
+	splitLexer * parallel;
+	outputSink * output;
+	arena memory;
+	diagnostic * diagnostics;
+	diagnostic * lastDiagnostic;
+	int errors;
+	int halted;
+	int depth;
+	int keepTree;
+	int engine;
+	const spsHandlers * handlers;
+	void * context;
+} sourceContainer;
+
+void initSession(sourceContainer *, const keywordTable *, outputSink *);
+int startSession(sourceContainer *, sourceBuffer *);
+diagnostic * addDiagnostic(sourceContainer *, const char *);
+void freeSession(sourceContainer *);
+
+#endif
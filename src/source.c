@@ -0,0 +1,262 @@
+/*
+ *      source.c
+ *
+ * This file contains the source buffer which holds the program text for the
+ * scanner.  Files are mapped into memory whole so lines and tokens can be
+ * handed out as spans into them rather than copied.  Anything which cannot
+ * be mapped, such as stdin or a pipe, is streamed through a double buffer
+ * of SOURCE_BLOCK sized blocks instead.  Text already read into memory by
+ * the caller, or lying in a mapping of its own, can be scanned where it is.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "source.h"
+#include "trace.h"
+
+/*
+ *
+ * name: openSource
+ *
+ * Opens the named file and maps its contents into the given source buffer.
+ * Files which cannot be mapped are streamed instead.
+ *
+ * @param	source	the source buffer to be filled
+ * @param	fileName	the name of the file to open
+ * @return	1 if successful, 0 otherwise
+ */
+int openSource(sourceBuffer * source, char * fileName){
+	struct stat info;
+	void * data;
+	int fd;
+
+	fd = open(fileName, O_RDONLY);
+	if(fd < 0){
+		return 0;
+	}
+	if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+		data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data != MAP_FAILED){
+			// the scanner only ever walks forward through the text
+			madvise(data, info.st_size, MADV_SEQUENTIAL);
+			source->data = data;
+			source->length = info.st_size;
+			source->base = 0;
+			source->mapped = 1;
+			source->owned = 1;
+			source->fd = -1;
+			source->atEnd = 1;
+			source->failed = 0;
+			source->buffer = NULL;
+			source->size = 0;
+			close(fd);
+			return 1;
+		}
+	}
+	return openStream(source, fd);
+}
+
+/*
+ *
+ * name: openStream
+ *
+ * Prepares the given source buffer to stream from an already open descriptor.
+ * The descriptor is read in SOURCE_BLOCK sized blocks into a buffer of two
+ * blocks, so one block can still be scanned while the other is filled.
+ *
+ * @param	source	the source buffer to be filled
+ * @param	fd	the descriptor to read from, closed with the source
+ * @return	1 if successful, 0 otherwise
+ */
+int openStream(sourceBuffer * source, int fd){
+	source->buffer = malloc(2*SOURCE_BLOCK);
+	if(source->buffer == NULL){
+		close(fd);
+		return 0;
+	}
+	source->size = 2*SOURCE_BLOCK;
+	source->data = source->buffer;
+	source->length = 0;
+	source->base = 0;
+	source->mapped = 0;
+	source->owned = 1;
+	source->fd = fd;
+	source->atEnd = 0;
+	source->failed = 0;
+	return 1;
+}
+
+/*
+ *
+ * name: openMemory
+ *
+ * Prepares the given source buffer to scan text which has already been read
+ * into memory.  The text is taken over and freed with the source.
+ *
+ * @param	source	the source buffer to be filled
+ * @param	text	the text, allocated with malloc()
+ * @param	length	the length of the text
+ */
+void openMemory(sourceBuffer * source, char * text, long length){
+	source->buffer = text;
+	source->size = length;
+	source->data = text;
+	source->length = length;
+	source->base = 0;
+	source->mapped = 0;
+	source->owned = 1;
+	source->fd = -1;
+	source->atEnd = 1;
+	source->failed = 0;
+}
+
+/*
+ *
+ * name: openView
+ *
+ * Prepares the given source buffer to scan text which stays put elsewhere,
+ * such as a record of a mapped corpus.  The text is treated as mapped, and
+ * is left alone when the source is closed.
+ *
+ * @param	source	the source buffer to be filled
+ * @param	text	the text
+ * @param	length	the length of the text
+ */
+void openView(sourceBuffer * source, const char * text, long length){
+	source->buffer = NULL;
+	source->size = 0;
+	source->data = text;
+	source->length = length;
+	source->base = 0;
+	source->mapped = 1;
+	source->owned = 0;
+	source->fd = -1;
+	source->atEnd = 1;
+	source->failed = 0;
+}
+
+/*
+ *
+ * name: refill
+ *
+ * Drops everything before the given offset from a streamed source and reads
+ * the next block into the space left over.  A line longer than the buffer
+ * will grow it, so memory is bounded by the longest line and not the input.
+ * If it cannot grow the source is ended there and marked failed, so it is
+ * not taken for the end of the stream.
+ *
+ * @param	source	the streamed source buffer
+ * @param	keep	the first offset which must stay resident
+ * @return	1 if more input was read, 0 at the end of the stream
+ */
+static int refill(sourceBuffer * source, long keep){
+	long skip = keep - source->base;
+	long got;
+	char * bigger;
+	TRACE_BEGIN(start);
+
+	if(skip > 0){
+		source->length -= skip;
+		memmove(source->buffer, source->buffer + skip, source->length);
+		source->base = keep;
+	}
+	if(source->size - source->length < SOURCE_BLOCK){
+		bigger = realloc(source->buffer, source->size * 2);
+		if(bigger == NULL){
+			source->atEnd = 1;
+			source->failed = 1;
+			return 0;
+		}
+		source->buffer = bigger;
+		source->data = bigger;
+		source->size *= 2;
+	}
+
+	do{
+		got = read(source->fd, source->buffer + source->length,
+				source->size - source->length);
+	}while(got < 0 && errno == EINTR);
+	TRACE_END(TRACE_READ, start);
+	if(got <= 0){
+		source->atEnd = 1;
+		return 0;
+	}
+	source->length += got;
+	TRACE_COUNT(COUNT_BYTES_READ, got);
+	return 1;
+}
+
+/*
+ *
+ * name: nextLine
+ *
+ * Finds the line starting at the given offset and makes sure all of it, plus
+ * the first byte after it, is resident.  Spans before the offset may be
+ * released once this is called on a streamed source.
+ *
+ * @param	source	the source buffer to be read
+ * @param	offset	the offset of the start of the line
+ * @return	the length of the line including its newline, 0 at the end,
+ * 	which comes early if a streamed source has failed
+ */
+long nextLine(sourceBuffer * source, long offset){
+	const char * start;
+	const char * end;
+	long avail;
+	long searched = offset;
+
+	while(1){
+		start = sourceText(source, offset);
+		avail = source->base + source->length - offset;
+		end = NULL;
+		// only what was read since the last search can hold the newline, so a
+		// long line is searched once however many reads it takes
+		if(source->base + source->length > searched){
+			end = memchr(sourceText(source, searched), '\n',
+					source->base + source->length - searched);
+		}
+		if(end != NULL && (end - start + 1 < avail || source->atEnd)){
+			return end - start + 1;
+		}
+		if(source->atEnd){
+			return avail > 0 ? avail : 0;
+		}
+		if(end == NULL){
+			searched = source->base + source->length;
+		}
+		refill(source, offset);
+	}
+}
+
+/*
+ *
+ * name: closeSource
+ *
+ * Releases the memory and descriptor held by the given source buffer.
+ *
+ * @param	source	the source buffer to be released
+ */
+void closeSource(sourceBuffer * source){
+	// a view's text belongs to someone else
+	if(source->owned && source->mapped){
+		munmap((void *)source->data, source->length);
+	}
+	else if(source->owned){
+		free(source->buffer);
+		if(source->fd >= 0){
+			close(source->fd);
+		}
+	}
+	source->data = NULL;
+	source->buffer = NULL;
+	source->length = 0;
+}
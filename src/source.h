@@ -0,0 +1,44 @@
+/*
+ *      source.h
+ *
+ * This file contains the source buffer which holds the program text for the
+ * scanner.  Files are mapped into memory whole so lines and tokens can be
+ * handed out as spans into them rather than copied.  Anything which cannot
+ * be mapped, such as stdin or a pipe, is streamed through a double buffer
+ * of SOURCE_BLOCK sized blocks instead.  Text already read into memory by
+ * the caller, or lying in a mapping of its own, can be scanned where it is.
+ *
+ */
+
+#ifndef source_h
+#define source_h
+
+typedef struct{
+	const char * data;
+	long length;
+	long base;
+	int mapped;
+	int owned;
+	int fd;
+	int atEnd;
+	int failed;
+	char * buffer;
+	long size;
+} sourceBuffer;
+
+// true when nothing follows the given offset, which nextLine() ensures is known.
+// A streamed source which ran out of memory also ends early, with failed set.
+#define sourceEnd(source, offset) \
+	((source)->atEnd && (offset) >= (source)->base + (source)->length)
+
+// the text at the given offset of the source, which must still be resident
+#define sourceText(source, offset) ((source)->data + ((offset) - (source)->base))
+
+int openSource(sourceBuffer *, char *);
+int openStream(sourceBuffer *, int);
+void openMemory(sourceBuffer *, char *, long);
+void openView(sourceBuffer *, const char *, long);
+long nextLine(sourceBuffer *, long);
+void closeSource(sourceBuffer *);
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *      sps.c
+ *
+ * This file contains the entry points of libsps.  Each parse has a session
+ * of its own on the caller's stack, printing to a null sink and keeping no
+ * syntax tree, and scans the caller's text where it lies.
+ *
+ */
+
+#include <stdio.h>
+
+#include "config.h"
+#include "tokens.h"
+#include "util.h"
+#include "source.h"
+#include "output.h"
+#include "hasher.h"
+#include "ast.h"
+#include "session.h"
+#include "grammar.h"
+#include "sps.h"
+
+// the names of the rules, by rule
+static const char * ruleNames[] = {"prog", "progName", "decList", "dec", "type",
+	"idList", "stmtList", "stmt", "assign", "expression", "term", "factor",
+	"readStmt", "writeStmt", "forStmt", "indexExp", "body"};
+
+/*
+ *
+ * name: spsParse
+ *
+ * Checks a program held in memory with the built in reserved words,
+ * reporting to the given callbacks as it goes.  The text is not copied, and
+ * must stay put until the parse returns.  Any number of threads may parse
+ * at once, their first parses included.
+ *
+ * @param	text	the program
+ * @param	length	the length of the program
+ * @param	handlers	the callbacks to report to, or NULL
+ * @param	context	passed to every callback
+ * @return	1 if the program parsed, 0 if not, -1 if out of memory
+ */
+int spsParse(const char * text, long length, const spsHandlers * handlers,
+		void * context){
+	sourceBuffer input;
+	sourceContainer source;
+	outputSink quiet;
+	int parsed;
+
+	// the kernels are picked before scanning, as a thread which only reads
+	// them would race with another picking them
+	initKernels();
+	initSink(&quiet, SINK_NULL, -1);
+	initSession(&source, &defaultKeywords, &quiet);
+	source.handlers = handlers;
+	source.context = context;
+	openView(&input, text, length);
+	if(!startSession(&source, &input)){
+		parsed = -1;
+	}
+	else{
+		parsed = parseProgram(&source);
+	}
+	closeSource(&input);
+	freeSession(&source);
+	return parsed;
+}
+
+/*
+ *
+ * name: spsRuleName
+ *
+ * @param	rule	the rule, one of SPS_PROG to SPS_BODY
+ * @return	the name of the rule as the grammar has it, NULL if not a rule
+ */
+const char * spsRuleName(int rule){
+	if(rule < 0 || rule >= SPS_RULES){
+		return NULL;
+	}
+	return ruleNames[rule];
+}
@@ -0,0 +1,40 @@
+/*
+ *      sps.h
+ *
+ * This file is the interface of libsps, which checks SPS source held in
+ * memory and reports what it finds to callbacks as it goes: each grammar
+ * rule entered and left, each variable declared or used, and each error.
+ * Nothing is printed and no syntax tree is kept, so an embedder only pays
+ * for what it does with the events.  Every parse keeps all of its state to
+ * itself, so any number of threads may parse at once.
+ *
+ */
+
+#ifndef sps_h
+#define sps_h
+
+// the rules of the grammar, as reported on entering and leaving them
+enum {SPS_PROG, SPS_PROG_NAME, SPS_DEC_LIST, SPS_DEC, SPS_TYPE, SPS_ID_LIST,
+	SPS_STMT_LIST, SPS_STMT, SPS_ASSIGN, SPS_EXPRESSION, SPS_TERM, SPS_FACTOR,
+	SPS_READ_STMT, SPS_WRITE_STMT, SPS_FOR_STMT, SPS_INDEX_EXP, SPS_BODY,
+	SPS_RULES};
+
+// the callbacks of a parse, any of which may be NULL.  Each is passed the
+// context given to spsParse().  Names are in upper case and are not
+// terminated, and are only valid during the call.  Variables are numbered
+// from 0 in the order first seen, the program's name included.
+typedef struct{
+	void (*enterRule)(void * context, int rule);
+	void (*exitRule)(void * context, int rule);
+	void (*declaration)(void * context, int id, const char * name, int length,
+			int line, int column);
+	void (*use)(void * context, int id, const char * name, int length,
+			int line, int column);
+	void (*diagnostic)(void * context, const char * message, const char * text,
+			int line, int column);
+} spsHandlers;
+
+int spsParse(const char *, long, const spsHandlers *, void *);
+const char * spsRuleName(int);
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ *      spsgen.c
+ *
+ * Generates synthetic SPS programs for benchmarking.  Each program follows
+ * the rules of SPS.g, declares its variables before using them, and so
+ * parses successfully, unless errors are asked for.  The same options and
+ * seed always give the same program.
+ *
+ * Input: Options for the size of the program, the number of variables, the
+ * 	nesting depth of FOR statements and of parentheses, how often comments
+ * 	and errors appear, and the random seed.
+ *
+ * Output: the program, on stdout
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// the stems of variable names, which are followed by a number so none can
+// be a reserved word
+static const char * stems[] = {"X", "N", "SUM", "TOTAL", "COUNT", "INDEX",
+	"LIMIT", "VALUE", "RESULT", "ACCUMULATOR", "TEMPORARYVALUE",
+	"RUNNINGTOTALOFALLVALUES"};
+
+static const char * words[] = {"the", "loop", "adds", "each", "value", "to",
+	"a", "running", "total", "and", "then", "checks", "its", "limit"};
+
+#define count(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+// how the program is shaped
+typedef struct{
+	long size;
+	int variables;
+	int forDepth;
+	int parenDepth;
+	int comments;
+	int errors;
+	unsigned long long seed;
+} shape;
+
+static shape wanted = {1 << 20, 100, 3, 3, 10, 0, 1};
+static long written = 0;
+static char ** names;
+
+/*
+ *
+ * name: pick
+ *
+ * Picks a random number with xorshift, so the programs do not depend on the
+ * C library.
+ *
+ * @param	limit	one more than the largest number wanted
+ * @return	a number from 0 to limit-1
+ */
+static int pick(int limit){
+	wanted.seed ^= wanted.seed << 13;
+	wanted.seed ^= wanted.seed >> 7;
+	wanted.seed ^= wanted.seed << 17;
+	return (int)((wanted.seed >> 16) % limit);
+}
+
+static void emit(const char * text){
+	fputs(text, stdout);
+	written += strlen(text);
+}
+
+static void indent(int depth){
+	int i;
+	for(i=0;i<=depth;i++){
+		emit("    ");
+	}
+}
+
+/*
+ *
+ * name: emitName
+ *
+ * Writes a random declared variable, in a random mix of case as the
+ * scanner folds it.
+ */
+static void emitName(){
+	char name[64];
+	int i;
+
+	strcpy(name, names[pick(wanted.variables)]);
+	if(pick(4) == 0){
+		for(i=0; name[i] != '\0'; i++){
+			name[i] = tolower((unsigned char)name[i]);
+		}
+	}
+	emit(name);
+}
+
+static void emitComment(int depth){
+	int i, length = 2 + pick(12);
+
+	indent(depth);
+	emit("(*");
+	for(i=0;i<length;i++){
+		emit(" ");
+		emit(words[pick(count(words))]);
+		if(pick(16) == 0){
+			// a comment may run over several lines
+			emit("\n");
+			indent(depth);
+		}
+	}
+	emit(" *)\n");
+}
+
+static void expression(int parens);
+
+/*
+ *
+ * name: factor
+ *
+ * Rule: <factor> ::= id | int | ( <exp> )
+ *
+ * @param	parens	the parentheses already open
+ */
+static void factor(int parens){
+	char number[16];
+	int choice = pick(8);
+
+	if(choice < 2 && parens < wanted.parenDepth){
+		emit("( ");
+		expression(parens + 1);
+		emit(" )");
+	}
+	else if(choice < 5){
+		sprintf(number, "%d", pick(choice == 4 ? 1000000 : 100));
+		emit(number);
+	}
+	else{
+		emitName();
+	}
+}
+
+/*
+ *
+ * name: term
+ *
+ * Rule: <term> ::= <factor> { * DIV <factor> }
+ *
+ * @param	parens	the parentheses already open
+ */
+static void term(int parens){
+	int i, factors = 1 + pick(2);
+
+	for(i=0;i<factors;i++){
+		if(i > 0){
+			emit(pick(2) ? " * " : " DIV ");
+		}
+		factor(parens);
+	}
+}
+
+/*
+ *
+ * name: expression
+ *
+ * Rule: <exp> ::= <term> { +- <term> }
+ *
+ * @param	parens	the parentheses already open
+ */
+static void expression(int parens){
+	int i, terms = 1 + pick(3);
+
+	for(i=0;i<terms;i++){
+		if(i > 0){
+			emit(pick(2) ? " + " : " - ");
+		}
+		term(parens);
+	}
+}
+
+/*
+ *
+ * name: idList
+ *
+ * Rule: <id-list> ::= id | { , id }
+ */
+static void idList(){
+	int i, ids = 1 + pick(3);
+
+	for(i=0;i<ids;i++){
+		if(i > 0){
+			emit(", ");
+		}
+		emitName();
+	}
+}
+
+static void stmtList(int depth, int stmts);
+
+/*
+ *
+ * name: mistake
+ *
+ * Writes a statement with one of the errors most often made, each of which
+ * the parser recovers from by the end of the statement.
+ */
+static void mistake(){
+	switch(pick(4)){
+		case 0:
+			// a variable never declared
+			emit("UNDECLARED := ");
+			expression(0);
+			break;
+		case 1:
+			// an operand left out
+			emitName();
+			emit(" := ");
+			expression(0);
+			emit(" +");
+			break;
+		case 2:
+			// a parenthesis left open
+			emit("WRITE ( ");
+			idList();
+			break;
+		default:
+			// the assignment left out
+			emitName();
+			emit(" ");
+			expression(0);
+			break;
+	}
+}
+
+/*
+ *
+ * name: stmt
+ *
+ * Rule: <stmt> ::= <assign> | <read> | <write> | <for>
+ *
+ * @param	depth	the FOR statements already open
+ */
+static void stmt(int depth){
+	int choice = pick(100);
+
+	if(pick(100) < wanted.comments){
+		emitComment(depth);
+	}
+	indent(depth);
+	// no number is picked without errors, so the programs are as they were
+	if(wanted.errors > 0 && pick(100) < wanted.errors){
+		mistake();
+	}
+	else if(choice < 12){
+		emit("READ ( ");
+		idList();
+		emit(" )");
+	}
+	else if(choice < 24){
+		emit("WRITE ( ");
+		idList();
+		emit(" )");
+	}
+	else if(choice < 34 && depth < wanted.forDepth){
+		emit("FOR ");
+		emitName();
+		emit(" := ");
+		expression(0);
+		emit(" TO ");
+		expression(0);
+		emit(" DO");
+		// <body> ::= <stmt> | BEGIN <stmt-list> END
+		if(pick(3) == 0){
+			emit("\n");
+			stmt(depth + 1);
+		}
+		else{
+			emit("\n");
+			indent(depth);
+			emit("BEGIN\n");
+			stmtList(depth + 1, 1 + pick(4));
+			emit("\n");
+			indent(depth);
+			emit("END");
+		}
+	}
+	else{
+		emitName();
+		emit(" := ");
+		expression(0);
+	}
+}
+
+/*
+ *
+ * name: stmtList
+ *
+ * Rule: <stmt-list> ::= <stmt> | { ; <stmt> }
+ *
+ * @param	depth	the FOR statements already open
+ * @param	stmts	the number of statements
+ */
+static void stmtList(int depth, int stmts){
+	int i;
+
+	for(i=0;i<stmts;i++){
+		if(i > 0){
+			emit(";\n");
+		}
+		stmt(depth);
+	}
+}
+
+/*
+ *
+ * name: prog
+ *
+ * Rule: <prog> ::= PROGRAM <prog-name> VAR <dec-list> BEGIN <stmt-list> END.
+ * The statements go on until the program is as large as wanted.
+ */
+static void prog(){
+	int i;
+
+	emit("PROGRAM BENCH\nVAR\n");
+	// <dec-list> ::= <dec> | { ; <dec> }, with up to eight names to a <dec>
+	for(i=0;i<wanted.variables;i++){
+		if(i % 8 == 0){
+			emit(i > 0 ? " : INTEGER;\n    " : "    ");
+		}
+		else{
+			emit(", ");
+		}
+		emit(names[i]);
+	}
+	emit(" : INTEGER\nBEGIN\n");
+	stmt(0);
+	while(written < wanted.size){
+		emit(";\n");
+		stmt(0);
+	}
+	emit("\nEND.\n");
+}
+
+int main(int argc, char** argv){
+	int i;
+
+	for(i=1;i<argc;i++){
+		if(i+1 < argc && strcmp(argv[i], "-s") == 0){
+			wanted.size = atol(argv[++i]);
+		}
+		else if(i+1 < argc && strcmp(argv[i], "-d") == 0){
+			wanted.variables = atoi(argv[++i]);
+		}
+		else if(i+1 < argc && strcmp(argv[i], "-f") == 0){
+			wanted.forDepth = atoi(argv[++i]);
+		}
+		else if(i+1 < argc && strcmp(argv[i], "-p") == 0){
+			wanted.parenDepth = atoi(argv[++i]);
+		}
+		else if(i+1 < argc && strcmp(argv[i], "-c") == 0){
+			wanted.comments = atoi(argv[++i]);
+		}
+		else if(i+1 < argc && strcmp(argv[i], "-e") == 0){
+			wanted.errors = atoi(argv[++i]);
+		}
+		else if(i+1 < argc && strcmp(argv[i], "-r") == 0){
+			wanted.seed = strtoull(argv[++i], NULL, 10);
+		}
+		else{
+			fprintf(stderr, "usage: %s [-s bytes] [-d variables] [-f for depth] "
+					"[-p paren depth] [-c comment percent] [-e error percent] "
+					"[-r seed]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(wanted.variables < 1){
+		wanted.variables = 1;
+	}
+	if(wanted.seed == 0){
+		wanted.seed = 1;
+	}
+
+	names = malloc(wanted.variables * sizeof(char *));
+	if(names == NULL){
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	for(i=0;i<wanted.variables;i++){
+		names[i] = malloc(40);
+		if(names[i] == NULL){
+			fprintf(stderr, "Out of memory\n");
+			return 1;
+		}
+		sprintf(names[i], "%s%d", stems[i % count(stems)], i);
+	}
+	prog();
+	return 0;
+}
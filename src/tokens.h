@@ -16,15 +16,46 @@ enum {PROGRAM=1, VAR, BEGIN, END, ENDDOT, INTEGER, FOR, READ, WRITE, TO,
 	DO, SEMICOLON, COLON, COMMA, COLONEQUALS, PLUS, MINUS, ASTRIX, DIV,
 	LEFTPAREN, RIGHTPAREN, ID, INT};
 
+// the errors the scanner can find in a token, whose messages are only
+// looked up when a diagnostic is printed
+enum {NO_ERROR, TOO_LONG, BAD_VARIABLE, BAD_INTEGER, INT_OVERFLOW};
+
+// a reserved word as read from a token file
 typedef struct{
 	char name[MAX_TOKEN_LEN+1];
 	int code;
-} token;
+} reserved;
+
+// the location of a lexeme within the source buffer
+typedef struct{
+	long offset;
+	int length;
+} span;
 
+// a scanned token in 24 bytes.  Its text is left in the source, at an offset
+// of up to 48 bits, and the line and column it starts at are packed together,
+// with the column saturating.  Lines are counted in an int, so a source may
+// have up to 2^31 - 1 of them.  A variable carries its symbol id and any
+// other token a value, which is 0 but for an integer, as the two share
+// their room.
 typedef struct{
-	token item;
-	int error;
-	char message[MAX_MESSAGE_LEN];
-} superToken;
+	unsigned long long offset : 48;
+	unsigned long long length : 16;
+	unsigned long long position : 48;
+	unsigned long long code : 8;
+	unsigned long long error : 8;
+	union{
+		int symbol;
+		long long value;
+	};
+} token;
+
+#define COLUMN_BITS 8
+#define MAX_COLUMN ((1 << COLUMN_BITS) - 1)
+#define MAX_LENGTH 65535
+#define packPosition(line, column) (((unsigned long long)(line) << COLUMN_BITS) | \
+	((column) > MAX_COLUMN ? MAX_COLUMN : (column)))
+#define tokenLine(item) ((int)((item).position >> COLUMN_BITS))
+#define tokenColumn(item) ((int)((item).position & MAX_COLUMN))
 
 #endif
@@ -0,0 +1,397 @@
+/*
+ *      trace.c
+ *
+ * This file contains the instrumentation of the scanner, hasher and parser.
+ * Each thread times its spans and counts into a record of its own, so
+ * nothing is shared while tracing.  The records are gathered and written
+ * out once, by finishTrace(), either as a Chrome trace of events or as flat
+ * counters in JSON.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "trace.h"
+
+#ifdef SPS_TRACE
+
+// the names of the spans, by span
+static const char * spanNames[] = {"file", "open", "parse", "close",
+	"prog", "progName", "decList", "dec", "type", "idList", "stmtList", "stmt",
+	"assign", "expression", "term", "factor", "readStmt", "writeStmt",
+	"forStmt", "indexExp", "body",
+	"getToken", "getLine", "read", "internName"};
+
+// the categories of the spans in a Chrome trace
+static const char * spanKinds[] = {"phase", "phase", "phase", "phase",
+	"rule", "rule", "rule", "rule", "rule", "rule", "rule", "rule", "rule",
+	"rule", "rule", "rule", "rule", "rule", "rule", "rule", "rule"};
+
+// the names of the counters, by counter
+static const char * counterNames[] = {"lines", "tokens", "comments", "lookups",
+	"symbols", "bytesRead", "files"};
+
+// one span which ended, as a Chrome trace keeps it
+typedef struct{
+	int span;
+	long long start;
+	long long length;
+	const char * name;
+} traceEvent;
+
+// what one thread timed and counted
+typedef struct traceThread{
+	int id;
+	long long calls[TRACE_SPANS];
+	long long total[TRACE_SPANS];
+	long long longest[TRACE_SPANS];
+	long long counts[COUNTERS];
+	long long probes[TRACE_PROBE_BUCKETS];
+	traceEvent * events;
+	long eventCount, eventCapacity;
+	long long dropped;
+	struct traceThread * next;
+} traceThread;
+
+int tracing = 0;
+
+static _Thread_local traceThread * mine = NULL;
+static traceThread * threads = NULL;
+static int threadCount = 0;
+static pthread_mutex_t joining = PTHREAD_MUTEX_INITIALIZER;
+static long long started;
+static char * traceFile;
+static int traceFormat;
+
+/*
+ *
+ * name: now
+ *
+ * @return	the current monotonic time in nanoseconds
+ */
+static long long now(){
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/*
+ *
+ * name: thisThread
+ *
+ * Finds the record of the calling thread, making it on first use.  Records
+ * are kept until the trace is written, even after their thread ends.
+ *
+ * @return	the record, NULL if out of memory
+ */
+static traceThread * thisThread(){
+	if(mine == NULL){
+		mine = calloc(1, sizeof(traceThread));
+		if(mine == NULL){
+			return NULL;
+		}
+		pthread_mutex_lock(&joining);
+		mine->id = ++threadCount;
+		mine->next = threads;
+		threads = mine;
+		pthread_mutex_unlock(&joining);
+	}
+	return mine;
+}
+
+long long traceBegin(){
+	return now();
+}
+
+/*
+ *
+ * name: traceEnd
+ *
+ * Ends a span, adding it to the thread's totals and, unless it is one of
+ * the detailed spans, keeping it as an event while there is room.
+ *
+ * @param	span	the span
+ * @param	start	when it began, from traceBegin()
+ * @param	name	the file the span belongs to, or NULL
+ */
+void traceEnd(int span, long long start, const char * name){
+	traceThread * thread = thisThread();
+	long long length = now() - start;
+	traceEvent * bigger;
+
+	if(thread == NULL){
+		return;
+	}
+	thread->calls[span]++;
+	thread->total[span] += length;
+	if(length > thread->longest[span]){
+		thread->longest[span] = length;
+	}
+	if(span >= TRACE_DETAIL){
+		return;
+	}
+
+	if(thread->eventCount == thread->eventCapacity){
+		bigger = NULL;
+		if(thread->eventCapacity < TRACE_EVENTS){
+			thread->eventCapacity = thread->eventCapacity ? thread->eventCapacity * 2 : 4096;
+			bigger = realloc(thread->events, thread->eventCapacity * sizeof(traceEvent));
+		}
+		if(bigger == NULL){
+			thread->eventCapacity = thread->eventCount;
+			thread->dropped++;
+			return;
+		}
+		thread->events = bigger;
+	}
+	thread->events[thread->eventCount].span = span;
+	thread->events[thread->eventCount].start = start;
+	thread->events[thread->eventCount].length = length;
+	thread->events[thread->eventCount].name = name;
+	thread->eventCount++;
+}
+
+void traceCount(int counter, long amount){
+	traceThread * thread = thisThread();
+	if(thread != NULL){
+		thread->counts[counter] += amount;
+	}
+}
+
+/*
+ *
+ * name: traceProbes
+ *
+ * Counts one search of a symbol table by the number of slots it probed.
+ *
+ * @param	probes	the slots probed past the first
+ */
+void traceProbes(int probes){
+	traceThread * thread = thisThread();
+	if(thread != NULL){
+		thread->counts[COUNT_LOOKUPS]++;
+		thread->probes[probes < TRACE_PROBE_BUCKETS ? probes : TRACE_PROBE_BUCKETS - 1]++;
+	}
+}
+
+/*
+ *
+ * name: writeString
+ *
+ * Writes a string as JSON, escaping what it must.
+ *
+ * @param	out	the file to write to
+ * @param	text	the string
+ */
+static void writeString(FILE * out, const char * text){
+	fputc('"', out);
+	for(; *text != '\0'; text++){
+		if(*text == '"' || *text == '\\'){
+			fprintf(out, "\\%c", *text);
+		}
+		else if((unsigned char)*text < ' '){
+			fprintf(out, "\\u%04x", (unsigned char)*text);
+		}
+		else{
+			fputc(*text, out);
+		}
+	}
+	fputc('"', out);
+}
+
+/*
+ *
+ * name: writeCounters
+ *
+ * Writes the totals of every thread as a JSON object: the counters, the
+ * calls and times of each span, the histogram of symbol table probes and
+ * the slowest files.
+ *
+ * @param	out	the file to write to
+ */
+static void writeCounters(FILE * out){
+	long long calls[TRACE_SPANS] = {0}, total[TRACE_SPANS] = {0};
+	long long longest[TRACE_SPANS] = {0}, counts[COUNTERS] = {0};
+	long long probes[TRACE_PROBE_BUCKETS] = {0}, dropped = 0;
+	traceEvent * slowest[TRACE_SLOWEST] = {NULL};
+	traceEvent * event;
+	traceThread * thread;
+	long i;
+	int j, k;
+
+	for(thread=threads; thread != NULL; thread=thread->next){
+		for(j=0;j<TRACE_SPANS;j++){
+			calls[j] += thread->calls[j];
+			total[j] += thread->total[j];
+			if(thread->longest[j] > longest[j]){
+				longest[j] = thread->longest[j];
+			}
+		}
+		for(j=0;j<COUNTERS;j++){
+			counts[j] += thread->counts[j];
+		}
+		for(j=0;j<TRACE_PROBE_BUCKETS;j++){
+			probes[j] += thread->probes[j];
+		}
+		dropped += thread->dropped;
+
+		// the slowest files are kept in order, slowest first
+		for(i=0;i<thread->eventCount;i++){
+			event = &thread->events[i];
+			if(event->span != TRACE_FILE || event->name == NULL){
+				continue;
+			}
+			for(j=0; j<TRACE_SLOWEST && slowest[j] != NULL &&
+					slowest[j]->length >= event->length; j++);
+			if(j < TRACE_SLOWEST){
+				for(k=TRACE_SLOWEST-1;k>j;k--){
+					slowest[k] = slowest[k-1];
+				}
+				slowest[j] = event;
+			}
+		}
+	}
+
+	fprintf(out, "{\n  \"threads\": %d,\n  \"droppedEvents\": %lld,\n  \"counters\": {",
+			threadCount, dropped);
+	for(j=0;j<COUNTERS;j++){
+		fprintf(out, "%s\n    \"%s\": %lld", j ? "," : "", counterNames[j], counts[j]);
+	}
+	fprintf(out, "\n  },\n  \"spans\": {");
+	for(j=0;j<TRACE_SPANS;j++){
+		fprintf(out, "%s\n    \"%s\": {\"calls\": %lld, \"totalNs\": %lld, \"longestNs\": %lld}",
+				j ? "," : "", spanNames[j], calls[j], total[j], longest[j]);
+	}
+	fprintf(out, "\n  },\n  \"probes\": [");
+	for(j=0;j<TRACE_PROBE_BUCKETS;j++){
+		fprintf(out, "%s%lld", j ? ", " : "", probes[j]);
+	}
+	fprintf(out, "],\n  \"slowest\": [");
+	for(j=0; j<TRACE_SLOWEST && slowest[j] != NULL; j++){
+		fprintf(out, "%s\n    {\"file\": ", j ? "," : "");
+		writeString(out, slowest[j]->name);
+		fprintf(out, ", \"ns\": %lld}", slowest[j]->length);
+	}
+	fprintf(out, "\n  ]\n}");
+}
+
+/*
+ *
+ * name: writeChrome
+ *
+ * Writes every event kept as a Chrome trace, which chrome://tracing and
+ * Perfetto can load, with the totals written by writeCounters() alongside.
+ *
+ * @param	out	the file to write to
+ */
+static void writeChrome(FILE * out){
+	traceThread * thread;
+	traceEvent * event;
+	const char * comma = "";
+	long i;
+
+	fprintf(out, "{\"traceEvents\": [");
+	for(thread=threads; thread != NULL; thread=thread->next){
+		fprintf(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+				"\"tid\": %d, \"args\": {\"name\": \"thread %d\"}}", comma, thread->id,
+				thread->id);
+		comma = ",";
+		for(i=0;i<thread->eventCount;i++){
+			event = &thread->events[i];
+			fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+					"\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d",
+					spanNames[event->span], spanKinds[event->span],
+					(event->start - started) / 1e3, event->length / 1e3, thread->id);
+			if(event->name != NULL){
+				fprintf(out, ", \"args\": {\"file\": ");
+				writeString(out, event->name);
+				fputc('}', out);
+			}
+			fputc('}', out);
+		}
+	}
+	fprintf(out, "\n],\n\"displayTimeUnit\": \"ns\",\n\"otherData\": ");
+	writeCounters(out);
+	fprintf(out, "}\n");
+}
+
+#endif
+
+/*
+ *
+ * name: startTrace
+ *
+ * Turns tracing on, to be written to the given file when finished.  This
+ * must be called before any other thread is started.
+ *
+ * @param	fileName	the file to write the trace to
+ * @param	format	TRACE_CHROME or TRACE_COUNTERS
+ * @return	1 if successful, 0 if tracing was not compiled in
+ */
+int startTrace(const char * fileName, int format){
+#ifdef SPS_TRACE
+	traceFile = strdup(fileName);
+	if(traceFile == NULL){
+		return 0;
+	}
+	traceFormat = format;
+	started = now();
+	tracing = 1;
+	return 1;
+#else
+	(void)fileName;
+	(void)format;
+	return 0;
+#endif
+}
+
+/*
+ *
+ * name: finishTrace
+ *
+ * Turns tracing off and writes out what was gathered.  Every traced thread
+ * must have finished, and the names of the files traced must still be held.
+ *
+ * @return	1 if written or not tracing, 0 if the file could not be written
+ */
+int finishTrace(){
+#ifdef SPS_TRACE
+	traceThread * thread;
+	FILE * out;
+	int written;
+
+	if(!tracing){
+		return 1;
+	}
+	tracing = 0;
+	out = fopen(traceFile, "w");
+	if(out != NULL){
+		if(traceFormat == TRACE_CHROME){
+			writeChrome(out);
+		}
+		else{
+			writeCounters(out);
+			fputc('\n', out);
+		}
+	}
+	written = out != NULL && fclose(out) == 0;
+
+	while(threads != NULL){
+		thread = threads;
+		threads = thread->next;
+		free(thread->events);
+		free(thread);
+	}
+	mine = NULL;
+	threadCount = 0;
+	free(traceFile);
+	return written;
+#else
+	return 1;
+#endif
+}
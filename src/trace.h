@@ -0,0 +1,78 @@
+/*
+ *      trace.h
+ *
+ * This file contains the instrumentation of the scanner, hasher and parser.
+ * It is only compiled in when SPS_TRACE is defined (make TRACE=1), and
+ * otherwise every hook below expands to nothing.  Once compiled in it does
+ * nothing until startTrace() is called.
+ *
+ */
+
+#ifndef trace_h
+#define trace_h
+
+// the spans timed.  Those from TRACE_TOKEN on happen too often to be kept as
+// events of a Chrome trace, and are only counted.
+enum {TRACE_FILE, TRACE_OPEN, TRACE_PARSE, TRACE_CLOSE,
+	TRACE_PROG, TRACE_PROG_NAME, TRACE_DEC_LIST, TRACE_DEC, TRACE_TYPE,
+	TRACE_ID_LIST, TRACE_STMT_LIST, TRACE_STMT, TRACE_ASSIGN, TRACE_EXPRESSION,
+	TRACE_TERM, TRACE_FACTOR, TRACE_READ_STMT, TRACE_WRITE_STMT, TRACE_FOR_STMT,
+	TRACE_INDEX_EXP, TRACE_BODY,
+	TRACE_TOKEN, TRACE_LINE, TRACE_READ, TRACE_INTERN,
+	TRACE_SPANS};
+
+#define TRACE_DETAIL TRACE_TOKEN
+
+// the things counted
+enum {COUNT_LINES, COUNT_TOKENS, COUNT_COMMENTS, COUNT_LOOKUPS, COUNT_SYMBOLS,
+	COUNT_BYTES_READ, COUNT_FILES, COUNTERS};
+
+// the ways a trace can be written
+enum {TRACE_CHROME, TRACE_COUNTERS};
+
+int startTrace(const char *, int);
+int finishTrace();
+
+#ifdef SPS_TRACE
+
+extern int tracing;
+
+// a span timed until the end of the block declaring it
+typedef struct{
+	int span;
+	long long start;
+} traceScope;
+
+long long traceBegin();
+void traceEnd(int, long long, const char *);
+void traceCount(int, long);
+void traceProbes(int);
+
+// ends a span at the end of its block, checked inline so the parser only
+// pays for a test while tracing is off
+static inline void traceLeave(traceScope * scope){
+	if(tracing){
+		traceEnd(scope->span, scope->start, NULL);
+	}
+}
+
+#define TRACE_BEGIN(start) long long start = tracing ? traceBegin() : 0
+#define TRACE_END(span, start) if(tracing){ traceEnd(span, start, NULL); }
+#define TRACE_NAMED(span, start, name) if(tracing){ traceEnd(span, start, name); }
+#define TRACE_SCOPE(span) traceScope traceScope_ __attribute__((cleanup(traceLeave))) = \
+		{span, tracing ? traceBegin() : 0}
+#define TRACE_COUNT(counter, amount) if(tracing){ traceCount(counter, amount); }
+#define TRACE_PROBES(probes) if(tracing){ traceProbes(probes); }
+
+#else
+
+#define TRACE_BEGIN(start)
+#define TRACE_END(span, start)
+#define TRACE_NAMED(span, start, name)
+#define TRACE_SCOPE(span)
+#define TRACE_COUNT(counter, amount)
+#define TRACE_PROBES(probes)
+
+#endif
+
+#endif
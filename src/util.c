@@ -4,147 +4,408 @@
  * This file contains several utility functions required by the scanner which will help verity and
  * modify characters and lines.
  *
+ * The run finding functions have SSE2 and AVX2 versions which look at 16 or
+ * 32 characters at a time.  The best version for the CPU is picked the first
+ * time one of them is called, once even when several threads are scanning,
+ * and the plain versions simply step the scanner tables one character at a
+ * time.
+ *
  */
 
 #include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "line.h"
+#include "lexer.h"
 #include "util.h"
 
+#ifdef __x86_64__
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+static int pickBlanks(const unsigned char *, int, int);
+static int pickStopper(const unsigned char *, int, int, int *);
+static int pickCommentEnd(const unsigned char *, int, int);
+
+int (*skipBlanks)(const unsigned char *, int, int) = pickBlanks;
+int (*findStopper)(const unsigned char *, int, int, int *) = pickStopper;
+int (*findCommentEnd)(const unsigned char *, int, int) = pickCommentEnd;
+
 /*
  *
- * name: up
+ * name: upCopy
  *
- * Converts the given string to upper case.
+ * Copies the given number of characters into the destination string,
+ * converting them to upper case and terminating the result.
  *
- * @param	string	the string to be converted
+ * @param	dest	the string to be written
+ * @param	src	the characters to be converted
+ * @param	length	the number of characters to copy
  */
-void up(char * string){
-	int i;
-	for(i=0;i<MAX_LINE_LEN;i++){
-		string[i] = toupper(string[i]);
+void upCopy(char * dest, const char * src, int length){
+	int i = 0;
+#ifdef HAVE_X86
+	// lower case letters are moved down by 32, everything else is kept
+	const __m128i a = _mm_set1_epi8('a');
+	const __m128i span = _mm_set1_epi8('z' - 'a');
+	const __m128i gap = _mm_set1_epi8('a' - 'A');
+	__m128i v, lower;
+	for(; i + 16 <= length; i += 16){
+		v = _mm_loadu_si128((const __m128i *)(src + i));
+		lower = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(v, a), span),
+				_mm_setzero_si128());
+		v = _mm_sub_epi8(v, _mm_and_si128(lower, gap));
+		_mm_storeu_si128((__m128i *)(dest + i), v);
 	}
+#endif
+	for(; i < length; i++){
+		dest[i] = toupper((unsigned char)src[i]);
+	}
+	dest[length] = '\0';
 }
 
 /*
  *
- * name: isvariable
+ * name: eightDigits
  *
- * Checks the given word if it follows the valid variable format.
+ * Works out the value of eight digits packed into an integer, the first
+ * digit in the lowest byte, with three multiplies in place of eight.  Pairs
+ * of digits are joined first, then pairs of pairs, then the two halves.
  *
- * @param	word	the string to be checked
- * @return	true if the string is valid, false otherwise.
+ * @param	chunk	the packed digits
+ * @return	the value of the digits
  */
-int isvariable(char* word){
-	int i;
-	if(!isalpha(word[0])){
-		return 0;
-	}
-	for(i=1; i < MAX_TOKEN_LEN; i++){
-		if(word[i] == '\0'){
-			return 1;
-		}
-		if(!isalnum(word[i])){
-			return 0;
-		}
-	}
-	return 1;
+static unsigned long long eightDigits(unsigned long long chunk){
+	chunk -= 0x3030303030303030ULL;
+	chunk = chunk * 10 + (chunk >> 8);
+	chunk = ((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)) +
+			((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+	return chunk;
 }
 
 /*
  *
- * name: isinteger
+ * name: parseDigits
  *
- * Checks the given word if it follows the valid integer format.
+ * Works out the value of a run of digits, eight at a time.  A shorter run
+ * at the front is padded with leading zeros to make eight.
  *
- * @param	word	the string to be checked
- * @return	true if the string is valid, false otherwise.
+ * @param	text	the digits
+ * @param	length	the number of digits
+ * @param	value	the value to be written
+ * @return	1 if the value fits in 63 bits, 0 if it overflowed
  */
-int isinteger(char* word){
+int parseDigits(const char * text, int length, long long * value){
+	static const unsigned long long scale[] = {1, 10, 100, 1000, 10000,
+			100000, 1000000, 10000000, 100000000};
+	unsigned long long sum = 0;
+	unsigned long long chunk;
+	int n = length % 8;
 	int i;
-	if(word[0] != '-' && word[0] != '+' && !isdigit(word[0])){
-		return 0;
+
+	if(n == 0){
+		n = 8;
 	}
-	for(i=1; i< MAX_TOKEN_LEN; i++){
-		if(word[i] == '\0'){
-			return 1;
+	while(length > 0){
+		chunk = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if(n == 8){
+			memcpy(&chunk, text, 8);
+		}
+		else
+#endif
+		for(i=0;i<n;i++){
+			chunk |= (unsigned long long)(unsigned char)text[i] << (8*i);
 		}
-		if(!isdigit(word[i])){
+		if(n < 8){
+			chunk = (chunk << (8*(8-n))) | (0x3030303030303030ULL >> (8*n));
+		}
+		if(__builtin_mul_overflow(sum, scale[n], &sum) ||
+				__builtin_add_overflow(sum, eightDigits(chunk), &sum) ||
+				sum > 0x7fffffffffffffffULL){
+			*value = 0;
 			return 0;
 		}
+		text += n;
+		length -= n;
+		n = 8;
 	}
+	*value = sum;
 	return 1;
 }
 
 /*
  *
- * name: isstopper
+ * name: skipBlanksPlain
  *
- * Checks if the given character is a stopper.
+ * Finds the first character at or after i in the text which is not
+ * whitespace.
  *
- * @param	stuff	the character to check
- * @return	true if the character is a stopper, false otherwise.
+ * @param	text	the text to search
+ * @param	i	the index to start from
+ * @param	length	the length of the text
+ * @return	the index of the character, or length if there is none
  */
-int isstopper(char character){
-	if(isspace(character)){
-		return 1;
+static int skipBlanksPlain(const unsigned char * text, int i, int length){
+	while(i < length && charClass[text[i]] == C_SPACE){
+		i++;
 	}
-	switch(character){
-		case ':':
-		case ';':
-		case '(':
-		case ')':
-		case ',':
-		case '+':
-		case '-':
-		case '*':
-			return 1;
+	return i;
+}
+
+/*
+ *
+ * name: findStopperPlain
+ *
+ * Finds the stopper which ends the word or integer being scanned.  The state
+ * is moved along as the characters are passed, so a variable becomes an
+ * invalid word and an integer an invalid integer if need be.
+ *
+ * @param	text	the text to search
+ * @param	i	the index to start from
+ * @param	length	the length of the text
+ * @param	state	the scanning state, S_IDENT, S_WORD, S_INT or S_BADINT
+ * @return	the index of the stopper, or length if there is none
+ */
+static int findStopperPlain(const unsigned char * text, int i, int length, int * state){
+	int next;
+	for(; i < length; i++){
+		next = lexTable[*state][text[i]];
+		if(next >= LEX_ACCEPT){
+			break;
+		}
+		*state = next;
 	}
-	return 0;
+	return i;
 }
 
 /*
  *
- * name: skipWhitespace
+ * name: findCommentEndPlain
  *
- * Skips all of the whitespace from the scanIndex in the given line.
- * Will set scanIndex at the first character from its previous location.
+ * Finds the end of the comment being scanned.
  *
- * @param	current	the line for whitespace to be skipped
+ * @param	text	the text to search
+ * @param	i	the index to start from
+ * @param	length	the length of the text
+ * @return	the index just past the "*)", or -1 if the comment carries on
  */
-void skipWhitespace(line * current){
-	int i;
-	// will hopefully skip all whitespace on line
-	for(i=current->scanIndex; i < MAX_LINE_LEN; i++){
-		if(!isspace(current->line[i])){
-			current->scanIndex=i;
-			return;
+static int findCommentEndPlain(const unsigned char * text, int i, int length){
+	int state = S_COMMENT;
+	for(; i < length; i++){
+		state = lexTable[state][text[i]];
+		if(state == S_START){
+			return i + 1;
 		}
 	}
+	return -1;
 }
 
+#ifdef HAVE_X86
+
+// a mask of the bytes of v which lie within [lo, hi]
+#define inRange128(v, lo, hi) _mm_cmpeq_epi8(_mm_subs_epu8( \
+	_mm_sub_epi8((v), _mm_set1_epi8(lo)), _mm_set1_epi8((hi) - (lo))), \
+	_mm_setzero_si128())
+#define inRange256(v, lo, hi) _mm256_cmpeq_epi8(_mm256_subs_epu8( \
+	_mm256_sub_epi8((v), _mm256_set1_epi8(lo)), _mm256_set1_epi8((hi) - (lo))), \
+	_mm256_setzero_si256())
+
+// whitespace is 9 to 13 and the space, the other stoppers are ( ) * + , -
+// which lie together, and : ;
+#define blanks128(v) _mm_or_si128(inRange128(v, 9, 13), \
+	_mm_cmpeq_epi8((v), _mm_set1_epi8(' ')))
+#define stoppers128(v) _mm_or_si128(blanks128(v), \
+	_mm_or_si128(inRange128(v, '(', '-'), inRange128(v, ':', ';')))
+#define blanks256(v) _mm256_or_si256(inRange256(v, 9, 13), \
+	_mm256_cmpeq_epi8((v), _mm256_set1_epi8(' ')))
+#define stoppers256(v) _mm256_or_si256(blanks256(v), \
+	_mm256_or_si256(inRange256(v, '(', '-'), inRange256(v, ':', ';')))
+
 /*
  *
- * name: skipComment
+ * name: passRun
  *
- * Will skip all the text on the given line until the end of comment characters
- * are found.  It will return 0 if unsuccessful or needs a new line.
+ * Moves the state of a word or integer along for a run of characters which
+ * holds no stoppers, given masks of its digits and letters.
  *
- * @param	current	the line to have comments skipped on
- * @return	0 if unfinished, 1 if end of comment found
+ * @param	state	the scanning state
+ * @param	digits	bitmask of the digits in the run
+ * @param	letters	bitmask of the letters in the run
+ * @param	run	bitmask of the whole run
+ */
+static void passRun(int * state, unsigned int digits, unsigned int letters,
+		unsigned int run){
+	if(*state == S_IDENT && (run & ~(digits | letters))){
+		*state = S_WORD;
+	}
+	else if(*state == S_INT && (run & ~digits)){
+		*state = S_BADINT;
+	}
+}
+
+/*
+ * The SSE2 versions of the functions above, each of which looks at 16
+ * characters at a time and finishes the tail of the text with the plain
+ * version.
  */
-int skipComment(line * current){
-	int i = current->scanIndex;
-	if(current->line[i] == '\0' && !current->atEOF){
-		return 0;
-	}
-	for(;i < MAX_LINE_LEN; i++){
-		if(current->line[i] == '*' &&
-			current->line[i+1] == ')'){
-			current->scanIndex = i + 2;
-			return 1;
+static int skipBlanksSSE2(const unsigned char * text, int i, int length){
+	unsigned int mask;
+	for(; i + 16 <= length; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+		mask = ~_mm_movemask_epi8(blanks128(v)) & 0xffff;
+		if(mask){
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return skipBlanksPlain(text, i, length);
+}
+
+static int findStopperSSE2(const unsigned char * text, int i, int length, int * state){
+	unsigned int stops, digits, letters, run;
+	for(; i + 16 <= length; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+		stops = _mm_movemask_epi8(stoppers128(v));
+		digits = _mm_movemask_epi8(inRange128(v, '0', '9'));
+		letters = _mm_movemask_epi8(inRange128(_mm_or_si128(v,
+				_mm_set1_epi8(0x20)), 'a', 'z'));
+		run = stops ? (stops & -stops) - 1 : 0xffff;
+		passRun(state, digits, letters, run);
+		if(stops){
+			return i + __builtin_ctz(stops);
 		}
 	}
-	return 0;
+	return findStopperPlain(text, i, length, state);
+}
+
+static int findCommentEndSSE2(const unsigned char * text, int i, int length){
+	unsigned int mask;
+	for(; i + 17 <= length; i += 16){
+		__m128i stars = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text + i)),
+				_mm_set1_epi8('*'));
+		__m128i closes = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text + i + 1)),
+				_mm_set1_epi8(')'));
+		mask = _mm_movemask_epi8(_mm_and_si128(stars, closes));
+		if(mask){
+			return i + __builtin_ctz(mask) + 2;
+		}
+	}
+	return findCommentEndPlain(text, i, length);
+}
+
+/*
+ * The AVX2 versions, which look at 32 characters at a time and finish with
+ * the plain versions.
+ */
+__attribute__((target("avx2")))
+static int skipBlanksAVX2(const unsigned char * text, int i, int length){
+	unsigned int mask;
+	for(; i + 32 <= length; i += 32){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(text + i));
+		mask = ~(unsigned int)_mm256_movemask_epi8(blanks256(v));
+		if(mask){
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return skipBlanksPlain(text, i, length);
+}
+
+__attribute__((target("avx2")))
+static int findStopperAVX2(const unsigned char * text, int i, int length, int * state){
+	unsigned int stops, digits, letters, run;
+	for(; i + 32 <= length; i += 32){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(text + i));
+		stops = _mm256_movemask_epi8(stoppers256(v));
+		digits = _mm256_movemask_epi8(inRange256(v, '0', '9'));
+		letters = _mm256_movemask_epi8(inRange256(_mm256_or_si256(v,
+				_mm256_set1_epi8(0x20)), 'a', 'z'));
+		run = stops ? (stops & -stops) - 1 : 0xffffffff;
+		passRun(state, digits, letters, run);
+		if(stops){
+			return i + __builtin_ctz(stops);
+		}
+	}
+	return findStopperPlain(text, i, length, state);
+}
+
+__attribute__((target("avx2")))
+static int findCommentEndAVX2(const unsigned char * text, int i, int length){
+	unsigned int mask;
+	for(; i + 33 <= length; i += 32){
+		__m256i stars = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(text + i)),
+				_mm256_set1_epi8('*'));
+		__m256i closes = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(text + i + 1)),
+				_mm256_set1_epi8(')'));
+		mask = _mm256_movemask_epi8(_mm256_and_si256(stars, closes));
+		if(mask){
+			return i + __builtin_ctz(mask) + 2;
+		}
+	}
+	return findCommentEndPlain(text, i, length);
+}
+
+#endif
+
+/*
+ *
+ * name: pickKernels
+ *
+ * Points the run finding functions at the SSE2 versions if the CPU has
+ * them.  The runs in a source are mostly short, and the AVX2 versions
+ * measured slower on them, so they are only used when SPS_SIMD is set to
+ * "avx2".  It may also be set to "none" or "sse2".
+ */
+static void pickKernels(){
+	skipBlanks = skipBlanksPlain;
+	findStopper = findStopperPlain;
+	findCommentEnd = findCommentEndPlain;
+#ifdef HAVE_X86
+	const char * choice = getenv("SPS_SIMD");
+	if(choice != NULL && strcmp(choice, "none") == 0){
+		return;
+	}
+	__builtin_cpu_init();
+	if(choice != NULL && strcmp(choice, "avx2") == 0 && __builtin_cpu_supports("avx2")){
+		skipBlanks = skipBlanksAVX2;
+		findStopper = findStopperAVX2;
+		findCommentEnd = findCommentEndAVX2;
+	}
+	else if(__builtin_cpu_supports("sse2")){
+		skipBlanks = skipBlanksSSE2;
+		findStopper = findStopperSSE2;
+		findCommentEnd = findCommentEndSSE2;
+	}
+#endif
+}
+
+static pthread_once_t picked = PTHREAD_ONCE_INIT;
+
+/*
+ *
+ * name: initKernels
+ *
+ * Picks the run finding functions straight away.  This is called before
+ * starting threads which scan, so none of them sees the choice being made.
+ */
+void initKernels(){
+	pthread_once(&picked, pickKernels);
+}
+
+static int pickBlanks(const unsigned char * text, int i, int length){
+	pthread_once(&picked, pickKernels);
+	return skipBlanks(text, i, length);
+}
+
+static int pickStopper(const unsigned char * text, int i, int length, int * state){
+	pthread_once(&picked, pickKernels);
+	return findStopper(text, i, length, state);
+}
+
+static int pickCommentEnd(const unsigned char * text, int i, int length){
+	pthread_once(&picked, pickKernels);
+	return findCommentEnd(text, i, length);
 }
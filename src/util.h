@@ -11,11 +11,11 @@
 
 #include "line.h"
 
-void up(char *);
-int isvariable(char *);
-int isinteger(char *);
-int isstopper(char);
-void skipWhitespace(line *);
-int skipComment(line *);
+void upCopy(char *, const char *, int);
+int parseDigits(const char *, int, long long *);
+void initKernels();
+extern int (*skipBlanks)(const unsigned char *, int, int);
+extern int (*findStopper)(const unsigned char *, int, int, int *);
+extern int (*findCommentEnd)(const unsigned char *, int, int);
 
 #endif
@@ -0,0 +1,248 @@
+/*
+ *      xref.c
+ *
+ * This program prints a cross reference of SPS programs, built on libsps
+ * alone: where each variable is declared and every line it is used on.
+ * Each file is read into memory and parsed on a thread of its own, with
+ * nothing shared between the parses.
+ *
+ * Input: The files containing the programs
+ *
+ * Output: For each file, its variables in the order declared, with the line
+ * 	each was declared on and the lines it was used on, then any errors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sps.h"
+
+// a variable and the lines it was used on
+typedef struct{
+	char * name;
+	int declared;
+	int * uses;
+	int useCount;
+	int useCapacity;
+} variable;
+
+// everything found in one file, written into only by the thread parsing it
+typedef struct{
+	char * fileName;
+	variable * variables;
+	int count;
+	int capacity;
+	char * errors;
+	size_t errorLength;
+	FILE * report;
+	int parsed;
+	pthread_t thread;
+	int threaded;
+} crossReference;
+
+/*
+ *
+ * name: variableAt
+ *
+ * Finds the variable with the given id, making room for it if it is new.
+ *
+ * @param	refs	the cross reference
+ * @param	id	the id of the variable
+ * @return	the variable, NULL if out of memory
+ */
+static variable * variableAt(crossReference * refs, int id){
+	variable * bigger;
+	int capacity;
+
+	if(id >= refs->capacity){
+		capacity = refs->capacity ? refs->capacity * 2 : 64;
+		while(capacity <= id){
+			capacity *= 2;
+		}
+		bigger = realloc(refs->variables, capacity * sizeof(variable));
+		if(bigger == NULL){
+			return NULL;
+		}
+		memset(bigger + refs->capacity, 0, (capacity - refs->capacity) * sizeof(variable));
+		refs->variables = bigger;
+		refs->capacity = capacity;
+	}
+	if(id >= refs->count){
+		refs->count = id + 1;
+	}
+	return &refs->variables[id];
+}
+
+static void declared(void * context, int id, const char * name, int length,
+		int line, int column){
+	variable * found = variableAt(context, id);
+
+	(void)column;
+	if(found != NULL){
+		found->name = strndup(name, length);
+		found->declared = line;
+	}
+}
+
+static void used(void * context, int id, const char * name, int length,
+		int line, int column){
+	variable * found = variableAt(context, id);
+	int * bigger;
+
+	(void)name;
+	(void)length;
+	(void)column;
+	if(found == NULL){
+		return;
+	}
+	// a line is only listed once, however often it uses the variable
+	if(found->useCount > 0 && found->uses[found->useCount - 1] == line){
+		return;
+	}
+	if(found->useCount == found->useCapacity){
+		found->useCapacity = found->useCapacity ? found->useCapacity * 2 : 8;
+		bigger = realloc(found->uses, found->useCapacity * sizeof(int));
+		if(bigger == NULL){
+			return;
+		}
+		found->uses = bigger;
+	}
+	found->uses[found->useCount++] = line;
+}
+
+static void reported(void * context, const char * message, const char * text,
+		int line, int column){
+	crossReference * refs = context;
+	fprintf(refs->report, "%d:%d: %s (%s)\n", line, column, message, text);
+}
+
+static const spsHandlers handlers = {NULL, NULL, declared, used, reported};
+
+/*
+ *
+ * name: readWhole
+ *
+ * @param	fileName	the file to read
+ * @param	length	set to the length of the file
+ * @return	the text of the file, NULL if it could not be read
+ */
+static char * readWhole(const char * fileName, long * length){
+	FILE * in = fopen(fileName, "rb");
+	char * text = NULL;
+
+	if(in == NULL){
+		return NULL;
+	}
+	if(fseek(in, 0, SEEK_END) == 0 && (*length = ftell(in)) >= 0 &&
+			fseek(in, 0, SEEK_SET) == 0){
+		text = malloc(*length > 0 ? *length : 1);
+		if(text != NULL && (long)fread(text, 1, *length, in) != *length){
+			free(text);
+			text = NULL;
+		}
+	}
+	fclose(in);
+	return text;
+}
+
+/*
+ *
+ * name: crossFile
+ *
+ * Reads and parses one file, gathering its cross reference.
+ *
+ * @param	data	the file's crossReference
+ * @return	NULL
+ */
+static void * crossFile(void * data){
+	crossReference * refs = data;
+	long length;
+	char * text;
+
+	refs->report = open_memstream(&refs->errors, &refs->errorLength);
+	if(refs->report == NULL){
+		refs->parsed = -1;
+		return NULL;
+	}
+	text = readWhole(refs->fileName, &length);
+	if(text == NULL){
+		fprintf(refs->report, "could not be read\n");
+		refs->parsed = 0;
+	}
+	else{
+		refs->parsed = spsParse(text, length, &handlers, refs);
+		if(refs->parsed < 0){
+			fprintf(refs->report, "out of memory\n");
+		}
+		free(text);
+	}
+	fclose(refs->report);
+	return NULL;
+}
+
+/*
+ *
+ * name: printReference
+ *
+ * Prints the cross reference of one file, and frees it.
+ *
+ * @param	refs	the cross reference
+ */
+static void printReference(crossReference * refs){
+	variable * found;
+	int i, j;
+
+	printf("==> %s <==\n", refs->fileName);
+	for(i=0;i<refs->count;i++){
+		found = &refs->variables[i];
+		if(found->name == NULL){
+			continue;
+		}
+		printf("%-16s %6d  ", found->name, found->declared);
+		for(j=0;j<found->useCount;j++){
+			printf(" %d", found->uses[j]);
+		}
+		printf("\n");
+		free(found->name);
+		free(found->uses);
+	}
+	if(refs->errors != NULL){
+		fwrite(refs->errors, 1, refs->errorLength, stdout);
+		free(refs->errors);
+	}
+	free(refs->variables);
+}
+
+int main(int argc, char** argv){
+	crossReference * files;
+	int i, failed = 0;
+
+	if(argc < 2){
+		printf("usage: %s file...\n", argv[0]);
+		return 1;
+	}
+	files = calloc(argc - 1, sizeof(crossReference));
+	if(files == NULL){
+		printf("Out of memory\n");
+		return 1;
+	}
+	for(i=0;i<argc-1;i++){
+		files[i].fileName = argv[i+1];
+		files[i].threaded = pthread_create(&files[i].thread, NULL, crossFile,
+				&files[i]) == 0;
+		if(!files[i].threaded){
+			crossFile(&files[i]);
+		}
+	}
+	for(i=0;i<argc-1;i++){
+		if(files[i].threaded){
+			pthread_join(files[i].thread, NULL);
+		}
+		printReference(&files[i]);
+		failed |= files[i].parsed != 1;
+	}
+	free(files);
+	return failed;
+}